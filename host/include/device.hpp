@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xmodem.hpp"
+
+// Time allowed for the device to reach a prompt, programming and reading get a longer step timeout
+#define DEVICE_PROMPT_TIMEOUT_MS 5000
+#define DEVICE_JOB_TIMEOUT_MS 120000
+#define DEVICE_SYNC_INTERVAL_MS 500
+
+typedef enum {
+    STEP_SYNC,          // Return to the main menu
+    STEP_SEND,          // Send a menu key
+    STEP_EXPECT,        // Wait for text
+    STEP_RESULT,        // Wait for one of several texts, the leading ones are a pass
+    STEP_XMODEM_SEND,
+    STEP_XMODEM_RECEIVE,
+    STEP_DIGEST         // Compare the received image with the uploaded one
+} step_type_t;
+
+typedef enum {
+    PHASE_NONE,
+    PHASE_UPLOAD,
+    PHASE_PROGRAM,
+    PHASE_VERIFY,
+    PHASE_READBACK,
+    PHASE_COUNT
+} phase_t;
+
+extern const char * PhaseNames[PHASE_COUNT];
+
+typedef struct {
+    step_type_t type;
+    phase_t phase;
+    std::vector<std::string> text;
+    uint64_t timeout_ms;
+    size_t passes;      // Number of leading result texts which are a pass
+} step_t;
+
+class Device {
+
+public:
+    Device(const std::string & port, const std::vector<uint8_t> * image, const std::vector<step_t> * steps);
+    ~Device();
+
+    bool open();
+    int get_fd() const;
+    const std::string & get_port() const;
+
+    void on_readable(uint64_t now_ms);
+    void on_writable();
+    void on_hangup();
+    void poll(uint64_t now_ms);
+    bool wants_write() const;
+
+    bool is_finished() const;
+    bool is_passed() const;
+    const std::string & get_error() const;
+    uint64_t get_phase_ms(phase_t phase) const;
+    uint64_t get_total_ms() const;
+    uint32_t get_digest() const;
+
+private:
+    std::string port;
+    int fd;
+    const std::vector<uint8_t> * image;
+    const std::vector<step_t> * steps;
+    size_t step;
+
+    std::string rx;
+    std::string tx;
+    std::vector<uint8_t> readback;
+    std::unique_ptr<XmodemSender> sender;
+    std::unique_ptr<XmodemReceiver> receiver;
+
+    uint64_t start_ms;
+    uint64_t step_ms;
+    uint64_t deadline;
+    uint64_t sync_ms;
+    uint64_t phase_ms[PHASE_COUNT];
+
+    bool finished;
+    bool passed;
+    std::string error;
+    uint32_t digest;
+
+    void begin_step(uint64_t now_ms);
+    void end_step(uint64_t now_ms);
+    void run(uint64_t now_ms);
+    void fail(const std::string & error);
+
+};
+
+uint32_t crc32(const uint8_t * data, size_t size);
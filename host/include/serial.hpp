@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Opens a serial port in raw non-blocking mode, returns -1 on failure
+int serial_open(const char * path);
+
+// Serial ports which look like a PicoPROM (Raspberry Pi Pico USB CDC devices)
+std::vector<std::string> serial_discover();
@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+// Event driven XMODEM-CRC, fed with received bytes and polled for timeouts
+
+#define XMODEM_BLOCK_SIZE 128
+#define XMODEM_RETRIES 10
+#define XMODEM_TIMEOUT_MS 10000
+#define XMODEM_START_INTERVAL_MS 3000
+
+#define XMODEM_SOH 0x01
+#define XMODEM_STX 0x02
+#define XMODEM_EOT 0x04
+#define XMODEM_ACK 0x06
+#define XMODEM_NAK 0x15
+#define XMODEM_CAN 0x18
+#define XMODEM_CRC 'C'
+#define XMODEM_PAD 0x1A
+
+typedef enum {
+    XMODEM_BUSY,
+    XMODEM_DONE,
+    XMODEM_FAILED
+} xmodem_status_t;
+
+uint16_t xmodem_crc16(const uint8_t * data, size_t size);
+
+class XmodemSender {
+
+public:
+    XmodemSender(const std::vector<uint8_t> * data);
+
+    // Returns the number of input bytes consumed, output is appended to tx
+    size_t feed(const uint8_t * data, size_t size, std::string * tx, uint64_t now_ms);
+    void poll(std::string * tx, uint64_t now_ms);
+    xmodem_status_t get_status() const;
+    const char * get_error() const;
+
+private:
+    const std::vector<uint8_t> * data;
+    size_t block;
+    size_t blocks;
+    bool started;
+    bool crc;
+    bool eot;
+    uint retries;
+    uint64_t deadline;
+    xmodem_status_t status;
+    const char * error;
+
+    void send_block(std::string * tx, uint64_t now_ms);
+    void fail(const char * error);
+
+};
+
+class XmodemReceiver {
+
+public:
+    XmodemReceiver(std::vector<uint8_t> * data);
+
+    size_t feed(const uint8_t * data, size_t size, std::string * tx, uint64_t now_ms);
+    void poll(std::string * tx, uint64_t now_ms);
+    xmodem_status_t get_status() const;
+    const char * get_error() const;
+
+private:
+    std::vector<uint8_t> * data;
+    std::vector<uint8_t> packet;
+    uint8_t block;
+    bool started;
+    uint retries;
+    uint64_t deadline;
+    xmodem_status_t status;
+    const char * error;
+
+    void fail(const char * error);
+
+};
@@ -0,0 +1,256 @@
+#include "device.hpp"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "serial.hpp"
+
+#define MAIN_MENU "Main Menu:"
+#define PROMPT "Enter command: "
+#define RESUME_PROMPT "resume the session"
+
+const char * PhaseNames[PHASE_COUNT] = {
+    "",
+    "Upload",
+    "Program",
+    "Verify",
+    "Readback"
+};
+
+uint32_t crc32(const uint8_t * data, size_t size) {
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (uint8_t j = 0; j < 8; j++) crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    return ~crc;
+};
+
+Device::Device(const std::string & port, const std::vector<uint8_t> * image, const std::vector<step_t> * steps) {
+    this->port = port;
+    this->fd = -1;
+    this->image = image;
+    this->steps = steps;
+    this->step = 0;
+    this->start_ms = this->step_ms = this->deadline = this->sync_ms = 0;
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) this->phase_ms[i] = 0;
+    this->finished = false;
+    this->passed = true;
+    this->digest = 0;
+};
+
+Device::~Device() {
+    if (this->fd >= 0) close(this->fd);
+};
+
+bool Device::open() {
+    this->fd = serial_open(this->port.c_str());
+    if (this->fd < 0) {
+        this->fail("unable to open port");
+        return false;
+    }
+    return true;
+};
+
+int Device::get_fd() const {
+    return this->fd;
+};
+
+const std::string & Device::get_port() const {
+    return this->port;
+};
+
+void Device::on_readable(uint64_t now_ms) {
+    uint8_t data[512];
+    ssize_t size;
+    while ((size = read(this->fd, data, sizeof(data))) > 0) {
+        size_t used = 0;
+        while (used < (size_t)size && !this->finished) {
+            // Transfers take the raw bytes, everything else is console text
+            if (this->sender) {
+                used += this->sender->feed(data + used, size - used, &this->tx, now_ms);
+            } else if (this->receiver) {
+                used += this->receiver->feed(data + used, size - used, &this->tx, now_ms);
+            } else {
+                this->rx.append((const char *)data + used, size - used);
+                used = size;
+            }
+            this->run(now_ms);
+        }
+    }
+    // Raw ttys return 0 when empty, disconnects show up as errors or a hang up
+    if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK) this->fail("port closed");
+};
+
+void Device::on_hangup() {
+    this->fail("port closed");
+};
+
+void Device::on_writable() {
+    while (!this->tx.empty()) {
+        ssize_t size = write(this->fd, this->tx.data(), this->tx.size());
+        if (size < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) this->fail("write failed");
+            return;
+        }
+        this->tx.erase(0, size);
+    }
+};
+
+bool Device::wants_write() const {
+    return !this->tx.empty();
+};
+
+void Device::poll(uint64_t now_ms) {
+    if (this->finished) return;
+    if (!this->start_ms) {
+        this->start_ms = now_ms;
+        this->begin_step(now_ms);
+    }
+    if (this->sender) this->sender->poll(&this->tx, now_ms);
+    if (this->receiver) this->receiver->poll(&this->tx, now_ms);
+    this->run(now_ms);
+    if (!this->finished && this->deadline && now_ms > this->deadline) this->fail("timed out waiting for device");
+};
+
+void Device::begin_step(uint64_t now_ms) {
+    if (this->step >= this->steps->size()) {
+        this->finished = true;
+        return;
+    }
+    const step_t * step = &(*this->steps)[this->step];
+    this->step_ms = now_ms;
+    this->deadline = now_ms + (step->timeout_ms ? step->timeout_ms : DEVICE_PROMPT_TIMEOUT_MS);
+
+    switch (step->type) {
+        case STEP_SEND:
+            this->tx += step->text[0];
+            break;
+        case STEP_XMODEM_SEND:
+            this->sender.reset(new XmodemSender(this->image));
+            this->deadline = 0;
+            break;
+        case STEP_XMODEM_RECEIVE:
+            this->receiver.reset(new XmodemReceiver(&this->readback));
+            this->deadline = 0;
+            break;
+        case STEP_SYNC:
+            this->sync_ms = 0;
+            break;
+        default:
+            break;
+    }
+};
+
+void Device::end_step(uint64_t now_ms) {
+    this->phase_ms[(*this->steps)[this->step].phase] += now_ms - this->step_ms;
+    this->step++;
+    this->begin_step(now_ms);
+};
+
+// Advances through as many steps as the received data allows
+void Device::run(uint64_t now_ms) {
+    size_t found, i;
+    while (!this->finished) {
+        const step_t * step = &(*this->steps)[this->step];
+        switch (step->type) {
+            case STEP_SYNC:
+                // Quit is invalid at the main menu, which then prints itself again
+                if ((found = this->rx.find(RESUME_PROMPT)) != std::string::npos) {
+                    this->rx.erase(0, found + sizeof(RESUME_PROMPT) - 1);
+                    this->tx += "n";
+                    return;
+                }
+                if ((found = this->rx.rfind(MAIN_MENU)) != std::string::npos && this->rx.find(PROMPT, found) != std::string::npos) {
+                    this->rx.clear();
+                    break;
+                }
+                if (now_ms - this->sync_ms >= DEVICE_SYNC_INTERVAL_MS) {
+                    this->sync_ms = now_ms;
+                    this->tx += "q";
+                }
+                return;
+            case STEP_SEND:
+            case STEP_DIGEST:
+                if (step->type == STEP_DIGEST) {
+                    if (this->readback.size() < this->image->size()) {
+                        this->fail("short readback");
+                        return;
+                    }
+                    this->digest = crc32(this->readback.data(), this->image->size());
+                    if (this->digest != crc32(this->image->data(), this->image->size())) {
+                        this->passed = false;
+                        if (this->error.empty()) this->error = "digest mismatch";
+                    }
+                }
+                break;
+            case STEP_EXPECT:
+                if ((found = this->rx.find(step->text[0])) == std::string::npos) return;
+                this->rx.erase(0, found + step->text[0].size());
+                break;
+            case STEP_RESULT:
+                for (i = 0; i < step->text.size(); i++) {
+                    if ((found = this->rx.find(step->text[i])) != std::string::npos) break;
+                }
+                if (i == step->text.size()) return;
+                this->rx.erase(0, found + step->text[i].size());
+                if (i >= step->passes) {
+                    this->passed = false;
+                    if (this->error.empty()) this->error = step->text[i];
+                }
+                break;
+            case STEP_XMODEM_SEND:
+                if (this->sender->get_status() == XMODEM_BUSY) return;
+                if (this->sender->get_status() == XMODEM_FAILED) {
+                    this->fail(std::string("upload ") + this->sender->get_error());
+                    return;
+                }
+                this->sender.reset();
+                break;
+            case STEP_XMODEM_RECEIVE:
+                if (this->receiver->get_status() == XMODEM_BUSY) return;
+                if (this->receiver->get_status() == XMODEM_FAILED) {
+                    this->fail(std::string("readback ") + this->receiver->get_error());
+                    return;
+                }
+                this->receiver.reset();
+                break;
+        }
+        this->end_step(now_ms);
+    }
+};
+
+void Device::fail(const std::string & error) {
+    if (this->finished) return;
+    this->finished = true;
+    this->passed = false;
+    this->error = error;
+    this->sender.reset();
+    this->receiver.reset();
+};
+
+bool Device::is_finished() const {
+    return this->finished;
+};
+
+bool Device::is_passed() const {
+    return this->passed;
+};
+
+const std::string & Device::get_error() const {
+    return this->error;
+};
+
+uint64_t Device::get_phase_ms(phase_t phase) const {
+    return this->phase_ms[phase];
+};
+
+uint64_t Device::get_total_ms() const {
+    uint64_t total = 0;
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) total += this->phase_ms[i];
+    return total;
+};
+
+uint32_t Device::get_digest() const {
+    return this->digest;
+};
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "device.hpp"
+#include "serial.hpp"
+
+#define POLL_INTERVAL_MS 50
+#define RECEIVE_OPTIONS "(q to return): "
+#define TRANSFER_START "Begin XMODEM transfer... "
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void usage(const char * name) {
+    printf("Usage: %s [-p port]... [-w] [-v] [-d] image.bin\r\n", name);
+    printf("\t-p port\tSerial port of a PicoPROM, may be repeated (default: all attached)\r\n");
+    printf("\t-w\tWrite the image with fused verify (default when no action is given)\r\n");
+    printf("\t-v\tVerify the device against the image\r\n");
+    printf("\t-d\tRead back the device and compare its digest with the image\r\n");
+}
+
+static bool load_image(const char * path, std::vector<uint8_t> * image) {
+    FILE * file = fopen(path, "rb");
+    if (!file) return false;
+    uint8_t data[4096];
+    size_t size;
+    while ((size = fread(data, 1, sizeof(data), file)) > 0) image->insert(image->end(), data, data + size);
+    fclose(file);
+    return !image->empty();
+}
+
+static void add_step(std::vector<step_t> * steps, step_type_t type, phase_t phase, std::vector<std::string> text, uint64_t timeout_ms, size_t passes) {
+    steps->push_back({ type, phase, text, timeout_ms, passes });
+}
+static void add_step(std::vector<step_t> * steps, step_type_t type, phase_t phase, std::vector<std::string> text, uint64_t timeout_ms) {
+    add_step(steps, type, phase, text, timeout_ms, 1);
+}
+static void add_step(std::vector<step_t> * steps, step_type_t type, phase_t phase, std::vector<std::string> text) {
+    add_step(steps, type, phase, text, 0);
+}
+
+// Menu walk through for each action, mirrors the firmware prompts
+static void add_upload(std::vector<step_t> * steps, const char * key, phase_t phase) {
+    add_step(steps, STEP_SEND, phase, { key });
+    add_step(steps, STEP_EXPECT, phase, { RECEIVE_OPTIONS });
+    add_step(steps, STEP_SEND, phase, { "x" });
+    add_step(steps, STEP_EXPECT, phase, { TRANSFER_START });
+    add_step(steps, STEP_XMODEM_SEND, PHASE_UPLOAD, { });
+}
+
+static void build_steps(std::vector<step_t> * steps, bool program, bool verify, bool digest) {
+    add_step(steps, STEP_SYNC, PHASE_NONE, { });
+    if (program) {
+        add_upload(steps, "w", PHASE_PROGRAM);
+        // A device which already holds the image isn't written again
+        add_step(steps, STEP_RESULT, PHASE_PROGRAM, { "ROM verification succeeded", "Device already contains this image", "ROM verification failed", "Failed to write to device" }, DEVICE_JOB_TIMEOUT_MS, 2);
+        add_step(steps, STEP_SYNC, PHASE_NONE, { });
+    }
+    if (verify) {
+        add_upload(steps, "v", PHASE_VERIFY);
+        add_step(steps, STEP_RESULT, PHASE_VERIFY, { "ROM verification succeeded", "ROM verification failed" }, DEVICE_JOB_TIMEOUT_MS);
+        add_step(steps, STEP_SYNC, PHASE_NONE, { });
+    }
+    if (digest) {
+        add_step(steps, STEP_SEND, PHASE_READBACK, { "r" });
+        add_step(steps, STEP_EXPECT, PHASE_READBACK, { RECEIVE_OPTIONS });
+        add_step(steps, STEP_SEND, PHASE_READBACK, { "x" });
+        add_step(steps, STEP_EXPECT, PHASE_READBACK, { "receive the ROM image" }, DEVICE_JOB_TIMEOUT_MS);
+        add_step(steps, STEP_EXPECT, PHASE_READBACK, { RECEIVE_OPTIONS });
+        add_step(steps, STEP_SEND, PHASE_READBACK, { "x" });
+        add_step(steps, STEP_EXPECT, PHASE_READBACK, { TRANSFER_START });
+        add_step(steps, STEP_XMODEM_RECEIVE, PHASE_READBACK, { });
+        add_step(steps, STEP_DIGEST, PHASE_READBACK, { });
+        add_step(steps, STEP_SYNC, PHASE_NONE, { });
+    }
+}
+
+static void print_report(const std::vector<std::unique_ptr<Device>> & devices, uint32_t digest) {
+    printf("\r\n%-24s %-6s", "Port", "Result");
+    for (uint8_t i = PHASE_UPLOAD; i < PHASE_COUNT; i++) printf(" %9s", PhaseNames[i]);
+    printf(" %9s  %-10s %s\r\n", "Total", "Digest", "Error");
+
+    size_t passed = 0;
+    for (const auto & device : devices) {
+        printf("%-24s %-6s", device->get_port().c_str(), device->is_passed() ? "pass" : "FAIL");
+        for (uint8_t i = PHASE_UPLOAD; i < PHASE_COUNT; i++) printf(" %7llums", (unsigned long long)device->get_phase_ms((phase_t)i));
+        printf(" %7llums", (unsigned long long)device->get_total_ms());
+        if (device->get_digest()) {
+            printf("  0x%08X", device->get_digest());
+        } else {
+            printf("  %-10s", "-");
+        }
+        printf(" %s\r\n", device->get_error().c_str());
+        if (device->is_passed()) passed++;
+    }
+    printf("\r\n%zu of %zu devices passed, image digest 0x%08X\r\n", passed, devices.size(), digest);
+}
+
+int main(int argc, char ** argv) {
+    std::vector<std::string> ports;
+    bool program = false, verify = false, digest = false;
+    const char * path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            ports.push_back(argv[++i]);
+        } else if (!strcmp(argv[i], "-w")) {
+            program = true;
+        } else if (!strcmp(argv[i], "-v")) {
+            verify = true;
+        } else if (!strcmp(argv[i], "-d")) {
+            digest = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!program && !verify && !digest) program = true;
+
+    std::vector<uint8_t> image;
+    if (!load_image(path, &image)) {
+        printf("Unable to read image \"%s\"\r\n", path);
+        return 1;
+    }
+
+    if (ports.empty()) ports = serial_discover();
+    if (ports.empty()) {
+        printf("No PicoPROM serial ports found\r\n");
+        return 1;
+    }
+
+    std::vector<step_t> steps;
+    build_steps(&steps, program, verify, digest);
+
+    // One event loop serves every port, each device advances through the steps on its own
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<std::unique_ptr<Device>> devices;
+    for (const auto & port : ports) {
+        devices.emplace_back(new Device(port, &image, &steps));
+        Device * device = devices.back().get();
+        if (!device->open()) continue;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = device;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, device->get_fd(), &event);
+        printf("%s: started\r\n", port.c_str());
+    }
+
+    struct epoll_event events[16];
+    std::vector<bool> reported(devices.size(), false);
+    size_t remaining = devices.size();
+    while (remaining) {
+        uint64_t now = now_ms();
+        remaining = 0;
+        for (size_t i = 0; i < devices.size(); i++) {
+            auto & device = devices[i];
+            if (reported[i]) continue;
+            if (!device->is_finished()) {
+                device->poll(now);
+                device->on_writable();
+            }
+            // Devices also finish while handling events, or when their port didn't open
+            if (device->is_finished()) {
+                printf("%s: %s\r\n", device->get_port().c_str(), device->is_passed() ? "pass" : "FAIL");
+                if (device->get_fd() >= 0) epoll_ctl(epoll, EPOLL_CTL_DEL, device->get_fd(), NULL);
+                reported[i] = true;
+                continue;
+            }
+            remaining++;
+
+            epoll_event event{};
+            event.events = EPOLLIN | (device->wants_write() ? (uint32_t)EPOLLOUT : 0u);
+            event.data.ptr = device.get();
+            epoll_ctl(epoll, EPOLL_CTL_MOD, device->get_fd(), &event);
+        }
+        if (!remaining) break;
+
+        int count = epoll_wait(epoll, events, sizeof(events) / sizeof(*events), POLL_INTERVAL_MS);
+        now = now_ms();
+        for (int i = 0; i < count; i++) {
+            Device * device = (Device *)events[i].data.ptr;
+            if (events[i].events & EPOLLIN) device->on_readable(now);
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) device->on_hangup();
+            device->on_writable();
+        }
+    }
+    close(epoll);
+
+    print_report(devices, crc32(image.data(), image.size()));
+    for (const auto & device : devices) {
+        if (!device->is_passed()) return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "serial.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#define SERIAL_BY_ID "/dev/serial/by-id"
+
+int serial_open(const char * path) {
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, B115200);
+        cfsetospeed(&tio, B115200);
+        tio.c_cflag |= CLOCAL | CREAD | HUPCL;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+        tcflush(fd, TCIOFLUSH);
+    }
+    return fd;
+};
+
+std::vector<std::string> serial_discover() {
+    std::vector<std::string> ports;
+
+    // Stable names include the USB product string
+    DIR * dir = opendir(SERIAL_BY_ID);
+    if (dir) {
+        struct dirent * entry;
+        char target[PATH_MAX];
+        while ((entry = readdir(dir)) != NULL) {
+            if (!strstr(entry->d_name, "Pico")) continue;
+            // The console is the first interface, the second is the data channel
+            const char * itf = strstr(entry->d_name, "-if");
+            if (itf && strcmp(itf, "-if00")) continue;
+            std::string path = std::string(SERIAL_BY_ID "/") + entry->d_name;
+            if (realpath(path.c_str(), target)) ports.push_back(target);
+        }
+        closedir(dir);
+    }
+
+    std::sort(ports.begin(), ports.end());
+    ports.erase(std::unique(ports.begin(), ports.end()), ports.end());
+    return ports;
+};
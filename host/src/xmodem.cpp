@@ -0,0 +1,213 @@
+#include "xmodem.hpp"
+
+uint16_t xmodem_crc16(const uint8_t * data, size_t size) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t j = 0; j < 8; j++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+};
+
+// Sender
+
+XmodemSender::XmodemSender(const std::vector<uint8_t> * data) {
+    this->data = data;
+    this->block = 0;
+    this->blocks = (data->size() + XMODEM_BLOCK_SIZE - 1) / XMODEM_BLOCK_SIZE;
+    this->started = false;
+    this->crc = true;
+    this->eot = false;
+    this->retries = 0;
+    this->deadline = 0;
+    this->status = XMODEM_BUSY;
+    this->error = NULL;
+};
+
+void XmodemSender::send_block(std::string * tx, uint64_t now_ms) {
+    this->deadline = now_ms + XMODEM_TIMEOUT_MS;
+    if (this->block >= this->blocks) {
+        this->eot = true;
+        tx->push_back(XMODEM_EOT);
+        return;
+    }
+
+    uint8_t packet[XMODEM_BLOCK_SIZE + 5];
+    size_t offset = this->block * XMODEM_BLOCK_SIZE, length = this->data->size() - offset;
+    if (length > XMODEM_BLOCK_SIZE) length = XMODEM_BLOCK_SIZE;
+
+    packet[0] = XMODEM_SOH;
+    packet[1] = (uint8_t)(this->block + 1);
+    packet[2] = ~packet[1];
+    for (size_t i = 0; i < XMODEM_BLOCK_SIZE; i++) packet[3 + i] = i < length ? (*this->data)[offset + i] : XMODEM_PAD;
+
+    size_t size = 3 + XMODEM_BLOCK_SIZE;
+    if (this->crc) {
+        uint16_t crc = xmodem_crc16(packet + 3, XMODEM_BLOCK_SIZE);
+        packet[size++] = crc >> 8;
+        packet[size++] = crc & 0xFF;
+    } else {
+        uint8_t sum = 0;
+        for (size_t i = 0; i < XMODEM_BLOCK_SIZE; i++) sum += packet[3 + i];
+        packet[size++] = sum;
+    }
+    tx->append((const char *)packet, size);
+};
+
+size_t XmodemSender::feed(const uint8_t * data, size_t size, std::string * tx, uint64_t now_ms) {
+    size_t i;
+    for (i = 0; i < size && this->status == XMODEM_BUSY; i++) {
+        uint8_t c = data[i];
+        if (!this->started) {
+            if (c != XMODEM_CRC && c != XMODEM_NAK) continue;
+            this->started = true;
+            this->crc = c == XMODEM_CRC;
+            this->send_block(tx, now_ms);
+            continue;
+        }
+
+        switch (c) {
+            case XMODEM_ACK:
+                this->retries = 0;
+                if (this->eot) {
+                    this->status = XMODEM_DONE;
+                    return i + 1;
+                }
+                this->block++;
+                this->send_block(tx, now_ms);
+                break;
+            case XMODEM_NAK:
+                if (++this->retries > XMODEM_RETRIES) {
+                    this->fail("too many retries");
+                } else {
+                    this->send_block(tx, now_ms);
+                }
+                break;
+            case XMODEM_CAN:
+                this->fail("cancelled by device");
+                break;
+            default:
+                // Repeated start requests and line noise
+                break;
+        }
+    }
+    return i;
+};
+
+void XmodemSender::poll(std::string * tx, uint64_t now_ms) {
+    if (this->status != XMODEM_BUSY) return;
+    if (!this->deadline) this->deadline = now_ms + XMODEM_TIMEOUT_MS;
+    if (now_ms < this->deadline) return;
+    if (!this->started || ++this->retries > XMODEM_RETRIES) {
+        this->fail("timed out");
+        return;
+    }
+    this->send_block(tx, now_ms);
+};
+
+xmodem_status_t XmodemSender::get_status() const {
+    return this->status;
+};
+
+const char * XmodemSender::get_error() const {
+    return this->error;
+};
+
+void XmodemSender::fail(const char * error) {
+    this->status = XMODEM_FAILED;
+    this->error = error;
+};
+
+// Receiver
+
+XmodemReceiver::XmodemReceiver(std::vector<uint8_t> * data) {
+    this->data = data;
+    this->data->clear();
+    this->block = 1;
+    this->started = false;
+    this->retries = 0;
+    this->deadline = 0;
+    this->status = XMODEM_BUSY;
+    this->error = NULL;
+};
+
+size_t XmodemReceiver::feed(const uint8_t * data, size_t size, std::string * tx, uint64_t now_ms) {
+    size_t i;
+    for (i = 0; i < size && this->status == XMODEM_BUSY; i++) {
+        uint8_t c = data[i];
+        if (this->packet.empty()) {
+            if (c == XMODEM_EOT) {
+                tx->push_back(XMODEM_ACK);
+                this->status = XMODEM_DONE;
+                return i + 1;
+            }
+            if (c == XMODEM_CAN) {
+                this->fail("cancelled by device");
+                break;
+            }
+            if (c != XMODEM_SOH && c != XMODEM_STX) continue;
+            this->started = true;
+        }
+        this->packet.push_back(c);
+
+        size_t length = this->packet[0] == XMODEM_STX ? 1024 : XMODEM_BLOCK_SIZE;
+        if (this->packet.size() < length + 5) continue;
+
+        // Complete packet
+        this->deadline = now_ms + XMODEM_TIMEOUT_MS;
+        uint16_t crc = ((uint16_t)this->packet[length + 3] << 8) | this->packet[length + 4];
+        bool valid = this->packet[1] == (uint8_t)~this->packet[2] && xmodem_crc16(&this->packet[3], length) == crc;
+        if (!valid) {
+            tx->push_back(++this->retries > XMODEM_RETRIES ? XMODEM_CAN : XMODEM_NAK);
+            if (this->retries > XMODEM_RETRIES) this->fail("too many retries");
+        } else if (this->packet[1] == this->block) {
+            this->data->insert(this->data->end(), this->packet.begin() + 3, this->packet.begin() + 3 + length);
+            this->block++;
+            this->retries = 0;
+            tx->push_back(XMODEM_ACK);
+        } else if (this->packet[1] == (uint8_t)(this->block - 1)) {
+            tx->push_back(XMODEM_ACK); // Repeated block after a lost acknowledge
+        } else {
+            tx->push_back(XMODEM_CAN);
+            this->fail("block sequence error");
+        }
+        this->packet.clear();
+    }
+    return i;
+};
+
+void XmodemReceiver::poll(std::string * tx, uint64_t now_ms) {
+    if (this->status != XMODEM_BUSY) return;
+    if (this->deadline && now_ms < this->deadline) return;
+
+    if (!this->started) {
+        if (this->deadline && ++this->retries > XMODEM_RETRIES) {
+            this->fail("no response");
+            return;
+        }
+        tx->push_back(XMODEM_CRC);
+        this->deadline = now_ms + XMODEM_START_INTERVAL_MS;
+        return;
+    }
+
+    this->packet.clear();
+    if (++this->retries > XMODEM_RETRIES) {
+        this->fail("timed out");
+        return;
+    }
+    tx->push_back(XMODEM_NAK);
+    this->deadline = now_ms + XMODEM_TIMEOUT_MS;
+};
+
+xmodem_status_t XmodemReceiver::get_status() const {
+    return this->status;
+};
+
+const char * XmodemReceiver::get_error() const {
+    return this->error;
+};
+
+void XmodemReceiver::fail(const char * error) {
+    this->status = XMODEM_FAILED;
+    this->error = error;
+};
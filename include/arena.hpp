@@ -0,0 +1,37 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Working memory handed out at runtime, everything else is fixed statics and the stack
+#ifndef ARENA_SIZE
+#define ARENA_SIZE (160 * 1024)
+#endif
+
+#define ARENA_ALIGN 8
+#define ARENA_REGIONS 24
+
+typedef struct {
+    const char * name;
+    size_t offset;
+    size_t size;
+} arena_region_t;
+
+// Fixed size blocks carved from the arena once, for buffers which come and go out of order
+typedef struct {
+    uint8_t * blocks;
+    size_t size;
+    uint8_t count;
+    uint32_t used;
+} pool_t;
+
+// Allocations are released in reverse order back to a mark
+void * arena_alloc(const char * name, size_t size);
+size_t arena_mark();
+void arena_release(size_t mark);
+
+size_t arena_used();
+size_t arena_high_water();
+void arena_print();
+
+bool pool_init(pool_t * pool, const char * name, size_t size, uint8_t count);
+void * pool_alloc(pool_t * pool);
+void pool_free(pool_t * pool, void * block);
@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <lfs.h>
 
+#include "job.hpp"
+
 typedef void (*command_action_t)();
 
 typedef struct Command {
@@ -27,8 +29,7 @@ static Command * command_prompt(Command * items, const char * prompt, bool allow
         if (allow_return) printf(" (q to return)");
         printf(": ");
 
-        c = getchar();
-        if (c == PICO_ERROR_TIMEOUT) continue;
+        c = job_getchar();
         printf("%c\r\n", c);
 
         if (allow_return && c == 'q') {
@@ -62,8 +63,7 @@ static int option_prompt(char options[][LFS_NAME_MAX+1], const char * prompt, bo
         if (allow_return) printf(" (q to return)");
         printf(": ");
 
-        c = getchar();
-        if (c == PICO_ERROR_TIMEOUT) continue;
+        c = job_getchar();
         printf("%c\r\n", c);
 
         i = -1;
@@ -9,6 +9,9 @@ typedef struct {
 
 void next_config_category();
 void next_config();
+bool select_config(const char * name);
+const char * find_config(size_t size, size_t address_mask);
+void set_detected_config(size_t size, size_t address_mask);
 const char * get_config_category_name();
 const rom_config_t get_config();
 void print_config();
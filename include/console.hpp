@@ -0,0 +1,22 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Console output is collected here and handed to USB in whole packets (must be a power of two)
+#ifndef CONSOLE_BUFFER_SIZE
+#define CONSOLE_BUFFER_SIZE 4096
+#endif
+
+// Longest wait for the host to make room in a full buffer before output is dropped
+#ifndef CONSOLE_STALL_US
+#define CONSOLE_STALL_US 500000
+#endif
+
+#define CONSOLE_PACKET_SIZE 64
+#define CONSOLE_HEXDUMP_WIDTH 16
+
+void console_init();
+void console_write(const char * data, size_t size);
+void console_print(const char * text);
+void console_flush();
+
+void console_hexdump(const uint8_t * data, size_t size, size_t address);
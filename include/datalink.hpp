@@ -0,0 +1,33 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Framed image transfers over the second USB CDC interface, the console stays on the first
+#define DATALINK_ITF 1
+
+// "PPX1" little-endian
+#define DATALINK_MAGIC 0x31585050
+
+#define DATALINK_ACK 'K'
+#define DATALINK_NAK 'E'
+
+// How long to wait for the host to start a transfer
+#ifndef DATALINK_CONNECT_TIMEOUT_MS
+#define DATALINK_CONNECT_TIMEOUT_MS 30000
+#endif
+
+// Longest stall once a transfer has started
+#ifndef DATALINK_IDLE_TIMEOUT_MS
+#define DATALINK_IDLE_TIMEOUT_MS 2000
+#endif
+
+#define DATALINK_PROGRESS_SIZE 16384
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t digest; // CRC-32 of the payload
+} datalink_header_t;
+
+size_t datalink_receive(uint8_t * data, size_t max_size);
+bool datalink_send(const uint8_t * data, size_t size);
+bool datalink_connected();
@@ -0,0 +1,28 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Largest delta accepted in one transfer
+#ifndef DELTA_MAX_SIZE
+#define DELTA_MAX_SIZE 16384
+#endif
+
+// Base file read size while checking its digest
+#define DELTA_CHUNK_SIZE 256
+
+#define DELTA_MAGIC 0x31445050 // "PPD1"
+
+// Ops, lengths and offsets are unsigned LEB128
+#define DELTA_END 0x00
+#define DELTA_COPY 0x01   // offset, length: bytes from the base file
+#define DELTA_INSERT 0x02 // length, bytes: literal data
+#define DELTA_FILL 0x03   // length, value: repeated byte
+
+typedef struct {
+    uint32_t magic;
+    uint32_t base_size;
+    uint32_t base_digest;
+    uint32_t size;
+    uint32_t digest;
+} delta_header_t;
+
+size_t delta_apply(const char * base, const uint8_t * delta, size_t delta_size, uint8_t * buffer, size_t buffer_size);
@@ -0,0 +1,247 @@
+#pragma once
+#include "pico/stdlib.h"
+#include <stdio.h>
+
+// Number of bytes read per burst, bursts are aligned to this size (must be at least the largest page size)
+#ifndef BURST_SIZE
+#define BURST_SIZE 256
+#endif
+
+// Maximum time between bytes before the device ends the page load window (tBLC)
+#ifndef PAGE_LOAD_TIMEOUT_US
+#define PAGE_LOAD_TIMEOUT_US 150
+#endif
+
+// Longest write cycle to wait for while data polling
+#ifndef WRITE_POLL_TIMEOUT_US
+#define WRITE_POLL_TIMEOUT_US 20000
+#endif
+
+// Number of times a page is rewritten when its read back doesn't match during fused write and verify
+#ifndef WRITE_RETRIES
+#define WRITE_RETRIES 2
+#endif
+
+// Chip detection, data line pulls settle before each probe read
+#ifndef DETECT_SETTLE_US
+#define DETECT_SETTLE_US 20
+#endif
+
+// Largest erase sector of a sectored device, staged while the sector is erased
+#ifndef SECTOR_MAX_SIZE
+#define SECTOR_MAX_SIZE 4096
+#endif
+
+typedef enum {
+    DEVICE_BUS_PARALLEL,
+    DEVICE_BUS_SPI,
+    DEVICE_BUS_I2C
+} device_bus_t;
+
+typedef struct {
+    // General
+    const char * name;
+    size_t size;
+    bool readonly;
+
+    // Clock
+    bool invertClock;
+    uint pulseDelayUs;
+    uint byteDelayUs;
+
+    // Paging
+    size_t pageSize;
+    uint pageDelayMs;
+
+    // Write Protection
+    bool writeProtect;
+    bool writeProtectDisable;
+
+    // GPIO
+    size_t addressMask;
+
+    // Reading
+    bool strobeRead;
+
+    // Serial bus
+    device_bus_t bus;
+    uint8_t addressBytes;
+    uint clockKhz;
+
+    // Erase sectors, 0 for devices which write without erasing
+    size_t sectorSize;
+
+    void print() {
+        printf("Device: %s\r\n", name);
+        printf("\tCapacity: %dK bytes\r\n", size / 1024);
+        printf("\tRead-only: %s\r\n", readonly ? "yes" : "no");
+
+        if (bus == DEVICE_BUS_PARALLEL) {
+            printf("\tInverted clock: %s\r\n", invertClock ? "on" : "off");
+            printf("\tPulse delay: %dus\r\n", pulseDelayUs);
+            printf("\tByte delay: %dus\r\n", byteDelayUs);
+            printf("\tBurst read: %s\r\n", strobeRead ? "strobe per byte" : "hold enable");
+        } else {
+            printf("\tBus: %s at %dkHz, %d address bytes\r\n", bus == DEVICE_BUS_SPI ? "SPI" : "I2C", clockKhz, addressBytes);
+        }
+
+        if (!readonly) {
+            printf("\tPaging: %s\r\n", pageSize ? "on" : "off");
+            if (pageSize) {
+                printf("\tPage size: %d bytes\r\n", pageSize);
+                printf("\tPage delay: %dms\r\n", pageDelayMs);
+            }
+            printf("\tWrite protect: %s\r\n", writeProtect ? "enable" : (writeProtectDisable ? "disable" : "no action / not supported"));
+            if (sectorSize) printf("\tSector size: %d bytes\r\n", sectorSize);
+        }
+        if (addressMask) printf("\tAddress mask: 0x%04X\r\n", addressMask);
+    };
+} rom_config_t;
+
+typedef struct {
+    size_t pages;
+    size_t split_pages;
+    uint32_t max_gap_us;
+    uint32_t total_gap_us;
+
+    // Fused verification
+    size_t retries;
+    size_t errors;
+    size_t verified; // End of the leading pages which read back correctly
+
+    // Differential writes
+    size_t skipped;
+
+    // Sectored devices
+    size_t erased;
+    size_t unerased;
+
+    void print() const {
+        if (skipped) printf("Unchanged pages skipped: %d\r\n", skipped);
+        if (erased || unerased) printf("Sectors erased: %d, left unerased: %d\r\n", erased, unerased);
+        if (retries) printf("Rewritten pages: %d\r\n", retries);
+        if (!pages) return;
+        printf("Page loads: %d, split: %d\r\n", pages, split_pages);
+        printf("\tByte gap: %dus max, %dus average page max (limit %dus)\r\n", max_gap_us, total_gap_us / pages, PAGE_LOAD_TIMEOUT_US);
+    };
+} rom_write_stats_t;
+
+// Pass/fail checks probe a fixed pseudo-random sample of addresses before scanning the whole range
+#ifndef CHECK_SAMPLES
+#define CHECK_SAMPLES 256
+#endif
+#define CHECK_SEED 0x2545F491
+
+typedef struct {
+    size_t reads;
+    size_t mismatch; // First differing address found, -1 if none
+    bool sampled; // Decided by the sample without a full scan
+
+    void print() const {
+        if (mismatch == (size_t)-1) {
+            printf("Matched after %d reads\r\n", reads);
+        } else {
+            printf("Differs at 0x%04X, found %s after %d reads\r\n", mismatch, sampled ? "by the sample" : "by the full scan", reads);
+        }
+    };
+} rom_check_stats_t;
+
+// Deterministic sample addresses for checks and probes
+static inline uint32_t xorshift32(uint32_t * state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+};
+
+typedef uint8_t (*data_func_t)(size_t address);
+typedef bool (*progress_func_t)(size_t address);
+
+// Common engine behind every device type, subclasses provide the bus level reads and writes
+class Device {
+
+public:
+    Device(rom_config_t config);
+    virtual ~Device();
+
+    const rom_config_t * get_config() const;
+    const rom_write_stats_t * get_write_stats() const;
+    const rom_check_stats_t * get_check_stats() const;
+    void set_progress(progress_func_t cb);
+    progress_func_t get_progress() const;
+    void set_differential(bool enable);
+    virtual bool detect() = 0;
+    size_t get_size() const;
+    size_t get_page_size() const;
+
+    bool read(uint8_t * data, size_t size, size_t offset, bool print_status);
+    bool read(uint8_t * data, size_t size, size_t offset);
+    bool read(uint8_t * data, size_t size);
+    bool read(uint8_t * data);
+
+    bool write_image(const uint8_t * data, size_t size, size_t offset, bool print_status);
+    bool write_image(const uint8_t * data, size_t size, size_t offset);
+    bool write_image(const uint8_t * data, size_t size);
+    bool write_value(uint8_t value, bool print_status);
+    bool write_value(uint8_t value);
+    bool write_index(bool print_status);
+    bool write_index();
+    bool write_data(data_func_t cb, size_t size, size_t offset, bool print_status);
+
+    size_t write_verify_image(const uint8_t * data, size_t size, size_t offset, bool print_status);
+    size_t write_verify_image(const uint8_t * data, size_t size, size_t offset);
+    size_t write_verify_image(const uint8_t * data, size_t size);
+    size_t write_verify_value(uint8_t value, bool print_status);
+    size_t write_verify_value(uint8_t value);
+    size_t write_verify_index(bool print_status);
+    size_t write_verify_index();
+    size_t write_verify_data(data_func_t cb, size_t size, size_t offset, bool print_status);
+
+    size_t verify_image(uint8_t * data, size_t size, size_t offset, bool print_status);
+    size_t verify_image(uint8_t * data, size_t size, size_t offset);
+    size_t verify_image(uint8_t * data, size_t size);
+    size_t verify_value(uint8_t value, bool print_status);
+    size_t verify_value(uint8_t value);
+    size_t verify_index(bool print_status);
+    size_t verify_index();
+    size_t verify_data(data_func_t cb, size_t size, size_t offset, bool print_status);
+
+    bool check_image(const uint8_t * data, size_t size, size_t offset, bool print_status);
+    bool check_image(const uint8_t * data, size_t size);
+    bool check_value(uint8_t value, bool print_status);
+    bool check_value(uint8_t value);
+    bool check_data(data_func_t cb, size_t size, size_t offset, bool print_status);
+
+    bool erase();
+
+    void print();
+
+protected:
+    rom_config_t config;
+    rom_write_stats_t write_stats;
+    rom_check_stats_t check_stats;
+    progress_func_t progress;
+    bool differential;
+
+    virtual bool write(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status) = 0;
+    bool write_pages(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status);
+
+    size_t verify(data_func_t cb, size_t size, size_t offset, bool print_status, bool early_exit);
+    size_t verify(data_func_t cb, size_t size, size_t offset, bool print_status);
+
+    bool check(data_func_t cb, size_t size, size_t offset, bool print_status);
+
+    void status(size_t address, bool output);
+
+    virtual uint8_t read_byte(size_t address) = 0;
+    virtual void read_burst(uint8_t * data, size_t size, size_t offset) = 0;
+
+    // Used by write_pages, program a page within one page boundary and erase the sector holding an address
+    virtual bool program_page(const uint8_t * data, size_t size, size_t offset);
+    virtual bool erase_sector(size_t offset);
+
+private:
+    bool write_range(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status, uint8_t * sector);
+    bool prepare_sector(data_func_t cb, size_t offset, size_t end, size_t sector, uint8_t * staged);
+
+};
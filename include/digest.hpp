@@ -0,0 +1,5 @@
+#pragma once
+#include "pico/stdlib.h"
+
+uint32_t crc32(const uint8_t * data, size_t size, uint32_t crc);
+uint32_t crc32(const uint8_t * data, size_t size);
@@ -0,0 +1,9 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#include "fatview.hpp"
+
+// Flash storage is only exposed while the drive is started, the host sees no medium otherwise
+bool drive_start();
+void drive_stop();
+bool drive_active();
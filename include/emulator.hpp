@@ -0,0 +1,19 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#include "rom.hpp"
+
+// Size of each image bank served on the bus, covers every address line
+#define EMULATOR_SIZE (1 << 15)
+
+// Time spent counting responder loops when benchmarking
+#ifndef EMULATOR_BENCHMARK_MS
+#define EMULATOR_BENCHMARK_MS 100
+#endif
+
+bool emulator_start(rom_config_t config, const uint8_t * image, size_t size);
+void emulator_reload(const uint8_t * image, size_t size);
+void emulator_stop();
+bool emulator_running();
+uint32_t emulator_cycles();
+void emulator_benchmark();
@@ -0,0 +1,37 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#include "rom.hpp"
+
+#define ENDURANCE_FILE "endurance.csv"
+
+#ifndef ENDURANCE_MAX_PAGES
+#define ENDURANCE_MAX_PAGES 1024
+#endif
+
+// Write cycle time histogram, 250us buckets up to 16ms
+#define ENDURANCE_BUCKET_US 250
+#define ENDURANCE_BUCKETS 64
+
+typedef struct {
+    uint32_t cycles;
+    size_t pages;
+    size_t failed_pages;
+    size_t timeouts;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint64_t samples;
+    uint32_t histogram[ENDURANCE_BUCKETS];
+
+    void print() const {
+        printf("Cycles: %d, pages: %d, failed pages: %d, polling timeouts: %d\r\n", cycles, pages, failed_pages, timeouts);
+        if (!samples) return;
+        printf("\tWrite cycle: %dus average, %dus max\r\n", (uint32_t)(total_us / samples), max_us);
+        printf("\tSuggested page delay: %dms\r\n", max_us / 1000 + 1);
+    };
+} endurance_stats_t;
+
+bool endurance_run(ROM * rom, size_t page_offset, size_t page_count, uint32_t cycles);
+const endurance_stats_t * get_endurance_stats();
+void print_endurance_histogram();
+size_t endurance_csv(char * out, size_t size);
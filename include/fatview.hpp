@@ -0,0 +1,56 @@
+#pragma once
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <lfs.h>
+
+#include "storage.hpp"
+
+// FAT12 volume synthesized from the flash storage file list, one sector per cluster
+#define FATVIEW_SECTOR_SIZE 512
+#define FATVIEW_CLUSTERS (ROOT_SIZE / FATVIEW_SECTOR_SIZE)
+#define FATVIEW_ROOT_ENTRIES 512
+
+#define FATVIEW_FAT_SECTORS (((FATVIEW_CLUSTERS + 2) * 3 / 2 + FATVIEW_SECTOR_SIZE) / FATVIEW_SECTOR_SIZE)
+#define FATVIEW_ROOT_SECTORS (FATVIEW_ROOT_ENTRIES * 32 / FATVIEW_SECTOR_SIZE)
+#define FATVIEW_FAT_LBA 1
+#define FATVIEW_ROOT_LBA (FATVIEW_FAT_LBA + 2 * FATVIEW_FAT_SECTORS)
+#define FATVIEW_DATA_LBA (FATVIEW_ROOT_LBA + FATVIEW_ROOT_SECTORS)
+#define FATVIEW_SECTORS (FATVIEW_DATA_LBA + FATVIEW_CLUSTERS)
+
+// Files being copied onto the volume at once
+#ifndef FATVIEW_UPLOADS
+#define FATVIEW_UPLOADS 8
+#endif
+
+// Quiet time after the last write before complete uploads are moved into place
+#ifndef FATVIEW_SETTLE_MS
+#define FATVIEW_SETTLE_MS 1000
+#endif
+
+// Held back from the free space shown to the host for littlefs metadata
+#define FATVIEW_RESERVE (16 * 1024)
+
+typedef struct {
+    size_t sectors_read;
+    size_t sectors_written;
+    size_t files_added;
+    size_t uploads_failed;
+    size_t writes_rejected;
+
+    void print() const {
+        printf("USB drive: %dK read, %dK written, %d files added", sectors_read / 2, sectors_written / 2, files_added);
+        if (uploads_failed) printf(", %d incomplete uploads discarded", uploads_failed);
+        if (writes_rejected) printf(", %d writes to existing files rejected", writes_rejected);
+        printf("\r\n");
+    };
+} fatview_stats_t;
+
+bool fatview_mount();
+void fatview_unmount();
+bool fatview_mounted();
+
+bool fatview_read(uint32_t lba, uint8_t * sector);
+bool fatview_write(uint32_t lba, const uint8_t * sector);
+void fatview_settle(bool force);
+
+const fatview_stats_t * get_fatview_stats();
@@ -0,0 +1,29 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Input polling interval while waiting for a key
+#ifndef JOB_POLL_US
+#define JOB_POLL_US 10000
+#endif
+
+#ifndef JOB_IDLE_TASKS
+#define JOB_IDLE_TASKS 4
+#endif
+
+#define JOB_KEY_PAUSE 'p'
+#define JOB_KEY_CANCEL 'c'
+
+typedef bool (*job_progress_t)(size_t address);
+typedef void (*idle_task_t)();
+
+void job_begin(const char * name, job_progress_t progress);
+void job_begin(const char * name);
+bool job_yield(size_t address);
+void job_end();
+bool job_active();
+bool job_cancelled();
+
+bool add_idle_task(idle_task_t task);
+void suspend_idle_tasks(bool suspend);
+void job_idle();
+int job_getchar();
@@ -0,0 +1,32 @@
+#pragma once
+#include "pico/stdlib.h"
+#include <lfs.h>
+
+#ifndef LAYOUT_SEGMENTS
+#define LAYOUT_SEGMENTS 16
+#endif
+
+// Source file read-ahead
+#ifndef LAYOUT_CACHE_SIZE
+#define LAYOUT_CACHE_SIZE 256
+#endif
+
+#define LAYOUT_MAX_LINE 128
+
+typedef struct {
+    char name[LFS_NAME_MAX+1];
+    size_t offset;      // Image address of the segment
+    size_t length;      // Image bytes covered by the segment
+    size_t skip;        // Source file offset
+    uint8_t lane;       // Byte lane taken from the source
+    uint8_t lanes;      // Number of interleaved lanes in the source
+    size_t mask;        // Segment address mask, mirrors the source within the segment
+    size_t file_size;
+} layout_segment_t;
+
+size_t layout_load(const char * path, size_t max_size);
+void layout_print();
+uint8_t layout_data(size_t address);
+bool layout_progress(size_t address);
+const char * layout_error();
+void layout_close();
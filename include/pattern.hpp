@@ -0,0 +1,30 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Patterns are generated a block at a time, random blocks are seeded by their position
+#ifndef PATTERN_BLOCK
+#define PATTERN_BLOCK 64
+#endif
+
+typedef enum {
+    PATTERN_ZEROES,
+    PATTERN_ONES,
+    PATTERN_RANDOM,
+    PATTERN_INDEX,
+    PATTERN_CHECKERBOARD,
+    PATTERN_INVERSE_CHECKERBOARD,
+    PATTERN_WALKING_ONES,
+    PATTERN_WALKING_ZEROES,
+    PATTERN_ADDRESS_XOR,
+    PATTERN_ADDRESS_HIGH,
+    PATTERN_COUNT
+} pattern_t;
+
+extern const char * PatternNames[PATTERN_COUNT];
+
+void pattern_select(pattern_t pattern, uint32_t seed);
+pattern_t get_pattern();
+uint32_t get_pattern_seed();
+
+void pattern_fill(uint8_t * data, size_t size, size_t offset);
+uint8_t pattern_data(size_t address);
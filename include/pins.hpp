@@ -0,0 +1,27 @@
+#pragma once
+#include "pico/stdlib.h"
+
+static const uint LED_PIN = 25;
+
+static const uint ADDR_MAP[] = { // A0-14
+    12, 11, 10, 9, 8, 7, 6, 5, 28, 27, 22, 26, 4, 2 ,3
+};
+
+static const uint DATA_MAP[] = { // D0-7
+    13, 14, 15, 16, 17, 18, 19, 20
+};
+
+#define ADDR_BITS (sizeof(ADDR_MAP) / sizeof(*ADDR_MAP))
+#define DATA_BITS (sizeof(DATA_MAP) / sizeof(*DATA_MAP))
+
+static const uint CE_PIN = 21;
+static const uint OE_PIN = 0;
+static const uint WE_PIN = 1;
+
+// Serial adapter, SPI0 and I2C0 share the upper data lines
+static const uint SPI_RX_PIN = 16;
+static const uint SPI_CS_PIN = 17;
+static const uint SPI_SCK_PIN = 18;
+static const uint SPI_TX_PIN = 19;
+static const uint I2C_SDA_PIN = 20;
+static const uint I2C_SCL_PIN = 21;
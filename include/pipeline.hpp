@@ -0,0 +1,28 @@
+#pragma once
+#include "pico/stdlib.h"
+#include <stdio.h>
+
+#include "device.hpp"
+
+// Ring buffer slots passed from the bus reader to the file writer
+#define PIPELINE_CHUNK_SIZE BURST_SIZE
+#ifndef PIPELINE_CHUNKS
+#define PIPELINE_CHUNKS 16
+#endif
+
+typedef struct {
+    size_t bytes;
+    uint32_t total_us;
+    uint32_t read_us;       // Bus reading on core1
+    uint32_t write_us;      // File writing on core0
+    size_t reader_stalls;   // Chunks the reader waited for a free slot
+    size_t writer_stalls;   // Polls the writer found no chunk ready
+
+    void print() const {
+        printf("Read %d bytes in %dms (bus %dms, storage %dms)\r\n", bytes, total_us / 1000, read_us / 1000, write_us / 1000);
+        printf("\tReader stalls: %d, writer stalls: %d\r\n", reader_stalls, writer_stalls);
+    };
+} pipeline_stats_t;
+
+bool pipeline_read_file(Device * rom, const char * path);
+const pipeline_stats_t * get_pipeline_stats();
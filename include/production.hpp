@@ -0,0 +1,68 @@
+#pragma once
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <lfs.h>
+
+#include "device.hpp"
+
+// Job script run automatically when no USB host connects after power up
+#define PRODUCTION_FILE "production.job"
+#define PRODUCTION_LOG_FILE "production.csv"
+
+#ifndef PRODUCTION_AUTOSTART_MS
+#define PRODUCTION_AUTOSTART_MS 5000
+#endif
+
+// Chip detection polling, a chip must be seen (or missing) on consecutive polls
+#define PRODUCTION_POLL_MS 100
+#define PRODUCTION_DEBOUNCE 3
+
+#define PRODUCTION_MAX_LINE 64
+
+typedef struct {
+    char profile[32];
+    char image[LFS_NAME_MAX+1];
+    bool differential;
+    bool verify;
+    bool digest;
+    bool digest_expected;
+    uint32_t expected;
+    size_t count;
+
+    void print() const {
+        printf("Production job:\r\n");
+        printf("\tProfile: %s\r\n", profile);
+        printf("\tImage: %s\r\n", image);
+        printf("\tDifferential write: %s\r\n", differential ? "on" : "off");
+        printf("\tFused verify: %s\r\n", verify ? "on" : "off");
+        printf("\tDigest check: %s\r\n", digest ? "on" : "off");
+        if (count) printf("\tChips: %d\r\n", count);
+    };
+} production_job_t;
+
+typedef struct {
+    size_t chips;
+    size_t passed;
+    size_t failed;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    size_t pages;
+    size_t skipped;
+    size_t retries;
+    size_t unchanged;
+
+    void print() const {
+        printf("Production: %d chips, %d passed, %d failed", chips, passed, failed);
+        if (chips) printf(" (%d%% yield)", passed * 100 / chips);
+        printf("\r\n");
+        if (!chips) return;
+        printf("\tTime per chip: %dms min, %dms average, %dms max\r\n", min_us / 1000, (uint32_t)(total_us / chips / 1000), max_us / 1000);
+        printf("\tPages written: %d, unchanged pages skipped: %d, rewritten pages: %d\r\n", pages, skipped, retries);
+        if (unchanged) printf("\tChips already programmed: %d\r\n", unchanged);
+    };
+} production_stats_t;
+
+bool production_load(const char * path, production_job_t * job);
+bool production_run(Device * rom, const production_job_t * job, const uint8_t * image, size_t size);
+const production_stats_t * get_production_stats();
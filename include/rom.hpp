@@ -2,100 +2,152 @@
 #include "pico/stdlib.h"
 #include <stdio.h>
 
+#include "device.hpp"
+
+// Step through aligned bursts in Gray-code order so only one address line changes per byte
+#ifndef BURST_GRAY
+#define BURST_GRAY 1
+#endif
+
+// Address lines above A14 come from a latch loaded from A0-A7 while OE and WE are both low
+#define LATCH_BITS 8
+
+// Longest sector erase to wait for while toggle bit polling
+#ifndef SECTOR_ERASE_TIMEOUT_US
+#define SECTOR_ERASE_TIMEOUT_US 100000
+#endif
+
+// Bus drive tests compare reads with the data line pulls up and down, for at most this many addresses
+#define DETECT_MAX_ADDRESSES 8
+
+// Stable dump timing
+#ifndef STABLE_PASSES
+#define STABLE_PASSES 2
+#endif
+// Minimum pulse delay for the first pass, covers tACC of slow mask ROMs
+#ifndef STABLE_ACCESS_US
+#define STABLE_ACCESS_US 1
+#endif
+#ifndef STABLE_VOTES
+#define STABLE_VOTES 5
+#endif
+#ifndef STABLE_MAX_SIZE
+#define STABLE_MAX_SIZE 65536
+#endif
+
+typedef struct {
+    size_t unstable;
+    size_t unresolved;
+    uint slowest_delay_us;
+
+    void print() const {
+        printf("Unstable addresses: %d", unstable);
+        if (unstable) printf(", resolved at up to %dus pulse delay, %d without a majority", slowest_delay_us, unresolved);
+        printf("\r\n");
+    };
+} rom_read_stats_t;
+
+// Address line probing, a line is only called mirrored after this many pairs which differ from the fill value
+#ifndef PROBE_SAMPLES
+#define PROBE_SAMPLES 16
+#endif
+#ifndef PROBE_MAX_SAMPLES
+#define PROBE_MAX_SAMPLES 256
+#endif
+#define PROBE_SEED 0x9E3779B9
+
 typedef struct {
-    // General
-    const char * name;
     size_t size;
-    bool readonly;
-
-    // Clock
-    bool invertClock;
-    uint pulseDelayUs;
-    uint byteDelayUs;
-
-    // Paging
-    size_t pageSize;
-    uint pageDelayMs;
-
-    // Write Protection
-    bool writeProtect;
-    bool writeProtectDisable;
-
-    // GPIO
-    size_t addressMask;
-
-    void print() {
-        printf("Device: %s\r\n", name);
-        printf("\tCapacity: %dK bytes\r\n", size / 1024);
-        printf("\tRead-only: %s\r\n", readonly ? "yes" : "no");
-
-        printf("\tInverted clock: %s\r\n", invertClock ? "on" : "off");
-        printf("\tPulse delay: %dus\r\n", pulseDelayUs);
-        printf("\tByte delay: %dus\r\n", byteDelayUs);
-
-        if (!readonly) {
-            printf("\tPaging: %s\r\n", pageSize ? "on" : "off");
-            if (pageSize) {
-                printf("\tPage size: %d bytes\r\n", pageSize);
-                printf("\tPage delay: %dms\r\n", pageDelayMs);
-            }
-            printf("\tWrite protect: %s\r\n", writeProtect ? "enable" : (writeProtectDisable ? "disable" : "no action / not supported"));
+    uint32_t used;
+    uint32_t mirrored; // Toggling the line never changes the data
+    uint32_t uncertain; // Too little content to tell, counted as used
+    uint32_t enable_high; // The chip only drives the bus with the line high
+    uint32_t enable_low; // The chip releases the bus with the line high
+    uint8_t fill;
+    size_t reads;
+
+    static void print_lines(const char * label, uint32_t lines) {
+        if (!lines) return;
+        printf("\t%s:", label);
+        for (uint8_t i = 0; i < 32; i++) {
+            if (lines & (1 << i)) printf(" A%d", i);
         }
+        printf("\r\n");
     };
-} rom_config_t;
 
-typedef uint8_t (*data_func_t)(size_t address);
+    void print() const {
+        if (!size) {
+            printf("Unable to size the device, content is uniform (0x%02X) after %d reads\r\n", fill, reads);
+        } else {
+            printf("Detected size: %d bytes after %d reads\r\n", size, reads);
+        }
+        print_lines("Used lines", used);
+        print_lines("Mirrored or unconnected lines", mirrored);
+        print_lines("Uncertain lines (too few bytes other than the fill)", uncertain);
+        print_lines("Enable lines, active high", enable_high);
+        print_lines("Enable lines, active low", enable_low);
+    };
+} rom_probe_stats_t;
 
-class ROM {
+// Bit-banged parallel bus engine
+class ROM : public Device {
 
 public:
     ROM(rom_config_t config);
     ~ROM();
 
-    const rom_config_t * get_config() const;
-    size_t get_size() const;
-    size_t get_page_size() const;
-
-    bool read(uint8_t * data, size_t size, size_t offset, bool print_status);
-    bool read(uint8_t * data, size_t size, size_t offset);
-    bool read(uint8_t * data, size_t size);
-    bool read(uint8_t * data);
-
-    bool write_image(const uint8_t * data, size_t size, size_t offset, bool print_status);
-    bool write_image(const uint8_t * data, size_t size, size_t offset);
-    bool write_image(const uint8_t * data, size_t size);
-    bool write_value(uint8_t value, bool print_status);
-    bool write_value(uint8_t value);
-    bool write_random(bool print_status);
-    bool write_random();
-    bool write_index(bool print_status);
-    bool write_index();
-
-    size_t verify_image(uint8_t * data, size_t size, size_t offset, bool print_status);
-    size_t verify_image(uint8_t * data, size_t size, size_t offset);
-    size_t verify_image(uint8_t * data, size_t size);
-    size_t verify_value(uint8_t value, bool print_status);
-    size_t verify_value(uint8_t value);
-    size_t verify_index(bool print_status);
-    size_t verify_index();
-
-    void print();
+    const rom_read_stats_t * get_read_stats() const;
+    const rom_probe_stats_t * get_probe_stats() const;
+    bool detect();
+    bool probe();
+
+    bool read_stable(uint8_t * data, size_t size, size_t offset, bool print_status);
+    bool read_stable(uint8_t * data);
+
+    uint32_t write_page_timed(const uint8_t * data, size_t size, size_t offset);
+
+protected:
+    bool write(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status);
+
+    uint8_t read_byte(size_t address);
+    void read_burst(uint8_t * data, size_t size, size_t offset);
+
+    bool program_page(const uint8_t * data, size_t size, size_t offset);
+    bool erase_sector(size_t offset);
 
 private:
-    rom_config_t config;
+    rom_read_stats_t read_stats;
+    rom_probe_stats_t probe_stats;
+
+    bool driven(const size_t * addresses, uint8_t count);
 
-    bool write(data_func_t cb, size_t size, size_t offset, bool print_status);
+    size_t bus_address;
+    bool bus_address_valid;
+    uint8_t bus_upper;
+    bool bus_upper_valid;
+    bool data_output;
 
-    size_t verify(data_func_t cb, size_t size, size_t offset, bool print_status);
+    // OE and WE are wired for writable devices and for the upper address latch
+    bool control;
+    bool latched;
 
-    void status(size_t address, bool output);
     void set_address(size_t address);
+    void latch_upper(uint8_t upper);
+
+    void trace();
 
     void set_data_direction(bool direction);
     void set_data(uint8_t value);
     uint8_t get_data();
 
     bool write_byte(size_t address, uint8_t value);
-    uint8_t read_byte(size_t address);
+    void write_page(const uint8_t * data, size_t size, size_t offset);
+    void command(size_t address, uint8_t code);
+    bool wait_toggle(size_t address, uint32_t timeout_us);
+
+    void begin_read();
+    uint8_t read_next(size_t address);
+    void end_read();
+    uint8_t read_vote(size_t address, bool * majority);
 
 };
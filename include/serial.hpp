@@ -0,0 +1,61 @@
+#pragma once
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "hardware/i2c.h"
+
+#include "device.hpp"
+
+#define SERIAL_SPI spi0
+#define SERIAL_I2C i2c0
+
+// 24Cxx with A0-A2 tied low, parts with one address byte take the upper address bits in the device address
+#define SERIAL_I2C_ADDRESS 0x50
+
+// Commands shared by 25xx EEPROMs and SPI NOR flash
+#define SPI_WRITE_STATUS 0x01
+#define SPI_PAGE_PROGRAM 0x02
+#define SPI_READ 0x03
+#define SPI_READ_STATUS 0x05
+#define SPI_WRITE_ENABLE 0x06
+#define SPI_FAST_READ 0x0B
+#define SPI_SECTOR_ERASE 0x20
+#define SPI_STATUS_BUSY 0x01
+
+// Sector erases take far longer than a page program
+#ifndef SERIAL_ERASE_TIMEOUT_US
+#define SERIAL_ERASE_TIMEOUT_US 500000
+#endif
+
+// SPI and I2C EEPROMs and flash on the hardware controllers, SPI payloads move by DMA
+class SerialDevice : public Device {
+
+public:
+    SerialDevice(rom_config_t config);
+    ~SerialDevice();
+
+    bool detect();
+
+protected:
+    bool write(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status);
+
+    uint8_t read_byte(size_t address);
+    void read_burst(uint8_t * data, size_t size, size_t offset);
+
+    bool program_page(const uint8_t * data, size_t size, size_t offset);
+    bool erase_sector(size_t offset);
+
+private:
+    uint dma_tx;
+    uint dma_rx;
+
+    size_t put_address(uint8_t * buffer, size_t address);
+    uint8_t device_address(size_t address);
+
+    void command(uint8_t code, size_t address, bool with_address);
+    void transfer(const uint8_t * tx, uint8_t * rx, size_t size);
+    uint8_t read_status();
+    void write_enable();
+    bool wait_ready(uint32_t timeout_us);
+    bool wait_ack(size_t address, uint32_t timeout_us);
+
+};
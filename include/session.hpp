@@ -0,0 +1,38 @@
+#pragma once
+#include "pico/stdlib.h"
+#include <lfs.h>
+
+#include "device.hpp"
+
+// Hidden files (leading period) so they aren't listed with the image library
+#define SESSION_FILE ".session"
+#define SESSION_IMAGE_FILE ".session.bin"
+
+// Number of bytes programmed between checkpoints
+#ifndef SESSION_INTERVAL
+#define SESSION_INTERVAL 4096
+#endif
+
+#define SESSION_MAGIC 0x50505353 // "PPSS"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t digest;
+    uint32_t size;
+    uint32_t checkpoint; // End of the last verified page
+
+    // Device profile
+    char device[32];
+    uint32_t device_size;
+    uint32_t address_mask;
+
+    // Source file of the image, empty when a copy is kept in SESSION_IMAGE_FILE
+    char image[LFS_NAME_MAX+1];
+} session_t;
+
+bool session_begin(const uint8_t * data, size_t size, const rom_config_t * config, const char * source);
+bool session_checkpoint(size_t address);
+void session_end();
+
+bool session_pending(session_t * session);
+size_t session_load(const session_t * session, uint8_t * buffer, size_t buffer_size);
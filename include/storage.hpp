@@ -3,11 +3,58 @@
 #include <lfs.h>
 
 #include "command.hpp"
+#include "layout.hpp"
 
 // Use upper half of 2MB of flash on standard Pico (1MB total)
 #define ROOT_SIZE 0x100000
 #define ROOT_OFFSET 0x100000
 
+// Largest run of coalesced programs written with interrupts disabled
+#ifndef FLASH_BATCH_SIZE
+#define FLASH_BATCH_SIZE 1024
+#endif
+
+#define FLASH_LOCKOUT_TIMEOUT_MS 100
+
+// Files open at once, the general file handle, the streamed write handle, the positioned read handle
+// and a positioned read handle for each image layout segment
+#define STORAGE_OPEN_FILES (3 + LAYOUT_SEGMENTS)
+
+typedef struct {
+    size_t count;
+    size_t bytes;
+    uint32_t total_us;
+    uint32_t max_us;
+
+    void print(const char * name) const {
+        printf("\t%s: %d operations, %dK, interrupts disabled %dms total, %dus max\r\n", name, count, bytes / 1024, total_us / 1000, max_us);
+    };
+} flash_op_stats_t;
+
+typedef struct {
+    flash_op_stats_t program;
+    flash_op_stats_t erase;
+    size_t pre_erased;
+    size_t erases_skipped;
+
+    void print() const {
+        printf("Flash storage:\r\n");
+        program.print("Program");
+        erase.print("Erase");
+        printf("\tBackground erase: %d blocks erased while idle, %d erases skipped\r\n", pre_erased, erases_skipped);
+    };
+} storage_stats_t;
+
+typedef struct {
+    lfs_file_t file;
+    struct lfs_file_config cfg;
+    bool valid;
+    size_t offset;
+} file_reader_t;
+
+const storage_stats_t * get_storage_stats();
+void reset_storage_stats();
+
 bool file_exists(const char * path);
 size_t get_file_size(const char * path);
 bool valid_filename(const char * fn, bool output);
@@ -17,8 +64,29 @@ void init_filesystem();
 bool reformat_filesystem();
 
 bool write_file(const char * path, const uint8_t * buffer, size_t size);
+bool update_file(const char * path, const uint8_t * buffer, size_t size);
+bool append_file(const char * path, const uint8_t * buffer, size_t size);
 size_t read_file(const char * path, uint8_t * buffer, size_t buffer_size);
+size_t read_file(const char * path, uint8_t * buffer, size_t buffer_size, size_t offset);
 bool delete_file(const char * path);
+bool rename_file(const char * path, const char * new_path);
+bool truncate_file(const char * path, size_t size);
+size_t get_storage_free();
+
+bool stream_open(const char * path);
+bool stream_write(const uint8_t * buffer, size_t size);
+bool stream_close();
+
+bool reader_open(file_reader_t * reader, const char * path);
+bool reader_open(const char * path);
+size_t reader_read(file_reader_t * reader, uint8_t * buffer, size_t size, size_t offset);
+size_t reader_read(uint8_t * buffer, size_t size, size_t offset);
+void reader_close(file_reader_t * reader);
+void reader_close();
+
+bool list_open(const char * path);
+bool list_next(char * name, size_t * size);
+void list_close();
 
 size_t dir_count(const char * path, bool include_dir);
 size_t dir_count(const char * path);
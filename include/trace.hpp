@@ -0,0 +1,29 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Number of bus events held in the ring buffer
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 2048
+#endif
+
+// Packed bus state layout, the address is held separately at its full width
+#define TRACE_DATA_SHIFT 0
+#define TRACE_CE (1 << 8)
+#define TRACE_OE (1 << 9)
+#define TRACE_WE (1 << 10)
+#define TRACE_DATA_OUT (1 << 11)
+
+typedef struct {
+    uint64_t cycle;
+    uint32_t address;
+    uint16_t state;
+} trace_event_t;
+
+extern volatile bool trace_enabled;
+
+void trace_enable(bool enable);
+void trace_clear();
+size_t trace_count();
+void trace_record(uint32_t address, uint16_t state);
+size_t trace_vcd(char * out, size_t size);
+void trace_print();
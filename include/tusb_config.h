@@ -0,0 +1,27 @@
+#pragma once
+
+// TinyUSB device configuration for the composite console, data channel and drive interfaces
+
+#ifndef CFG_TUSB_RHPORT0_MODE
+#define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
+#endif
+
+#ifndef CFG_TUSB_OS
+#define CFG_TUSB_OS OPT_OS_PICO
+#endif
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+// Console on the first interface, framed transfers on the second
+#define CFG_TUD_CDC 2
+#define CFG_TUD_MSC 1
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 0
+
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+#define CFG_TUD_CDC_EP_BUFSIZE 64
+
+// One sector per transfer callback
+#define CFG_TUD_MSC_EP_BUFSIZE 512
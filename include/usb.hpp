@@ -0,0 +1,19 @@
+#pragma once
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+
+// TinyUSB is serviced by the stdio_usb background task on this user IRQ. Calls into TinyUSB from thread
+// context mask it so that the task can't run halfway through a FIFO update, a pending task runs on unlock.
+#ifndef PICO_STDIO_USB_LOW_PRIORITY_IRQ
+#define PICO_STDIO_USB_LOW_PRIORITY_IRQ 31
+#endif
+
+static inline bool usb_lock() {
+    bool enabled = irq_is_enabled(PICO_STDIO_USB_LOW_PRIORITY_IRQ);
+    irq_set_enabled(PICO_STDIO_USB_LOW_PRIORITY_IRQ, false);
+    return enabled;
+}
+
+static inline void usb_unlock(bool enabled) {
+    if (enabled) irq_set_enabled(PICO_STDIO_USB_LOW_PRIORITY_IRQ, true);
+}
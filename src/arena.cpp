@@ -0,0 +1,71 @@
+#include "arena.hpp"
+
+#include <stdio.h>
+
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+static size_t top = 0;
+static size_t high_water = 0;
+
+static arena_region_t regions[ARENA_REGIONS];
+static uint8_t region_count = 0;
+
+void * arena_alloc(const char * name, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size > ARENA_SIZE - top || region_count >= ARENA_REGIONS) {
+        printf("Out of memory allocating %d bytes for %s (%d bytes free)\r\n", size, name, ARENA_SIZE - top);
+        return NULL;
+    }
+
+    regions[region_count++] = { name, top, size };
+    void * data = &arena[top];
+    top += size;
+    if (top > high_water) high_water = top;
+    return data;
+};
+
+size_t arena_mark() {
+    return region_count;
+};
+
+void arena_release(size_t mark) {
+    if (mark >= region_count) return;
+    region_count = mark;
+    top = mark ? regions[mark - 1].offset + regions[mark - 1].size : 0;
+};
+
+size_t arena_used() {
+    return top;
+};
+
+size_t arena_high_water() {
+    return high_water;
+};
+
+void arena_print() {
+    printf("Memory: %d of %d bytes used, %d bytes high water\r\n", top, ARENA_SIZE, high_water);
+    for (uint8_t i = 0; i < region_count; i++) {
+        printf("\t0x%05X %6d bytes  %s\r\n", regions[i].offset, regions[i].size, regions[i].name);
+    }
+};
+
+bool pool_init(pool_t * pool, const char * name, size_t size, uint8_t count) {
+    pool->size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    pool->count = count > 32 ? 32 : count;
+    pool->used = 0;
+    pool->blocks = (uint8_t *)arena_alloc(name, pool->size * pool->count);
+    return pool->blocks != NULL;
+};
+
+void * pool_alloc(pool_t * pool) {
+    for (uint8_t i = 0; i < pool->count; i++) {
+        if (pool->used & (1 << i)) continue;
+        pool->used |= 1 << i;
+        return pool->blocks + i * pool->size;
+    }
+    return NULL;
+};
+
+void pool_free(pool_t * pool, void * block) {
+    if (!block) return;
+    pool->used &= ~(1 << (((uint8_t *)block - pool->blocks) / pool->size));
+};
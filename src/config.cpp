@@ -1,5 +1,7 @@
 #include "config.hpp"
 
+#include <string.h>
+
 static rom_config_t configs_eeprom[] = {
     {
         "AT28C256",
@@ -154,6 +156,210 @@ static rom_config_t configs_atari[] = {
     }
 };
 
+// Devices above 32K take A15 and up from the upper address latch
+static rom_config_t configs_flash[] = {
+    {
+        "SST39SF010A",
+        131072,
+        false,
+        false,
+        1,
+        0,
+        0,
+        0,
+        false,
+        false,
+        0,
+        false,
+        DEVICE_BUS_PARALLEL,
+        0,
+        0,
+        4096
+    },
+    {
+        "SST39SF020A",
+        262144,
+        false,
+        false,
+        1,
+        0,
+        0,
+        0,
+        false,
+        false,
+        0,
+        false,
+        DEVICE_BUS_PARALLEL,
+        0,
+        0,
+        4096
+    },
+    {
+        "SST39SF040",
+        524288,
+        false,
+        false,
+        1,
+        0,
+        0,
+        0,
+        false,
+        false,
+        0,
+        false,
+        DEVICE_BUS_PARALLEL,
+        0,
+        0,
+        4096
+    },
+    {
+        "27C512",
+        65536,
+        true,
+        false,
+        1,
+        0,
+        0,
+        0,
+        false,
+        false,
+        0,
+        false,
+        DEVICE_BUS_PARALLEL,
+        0,
+        0,
+        0
+    },
+    {
+        NULL
+    }
+};
+
+// Serial parts are wired to the serial adapter pins, see pins.hpp
+static rom_config_t configs_serial[] = {
+    {
+        "24C256",
+        32768,
+        false,
+        false,
+        0,
+        0,
+        64,
+        0,
+        false,
+        false,
+        0,
+        false,
+        DEVICE_BUS_I2C,
+        2,
+        400,
+        0
+    },
+    {
+        "24C64",
+        8192,
+        false,
+        false,
+        0,
+        0,
+        32,
+        0,
+        false,
+        false,
+        0,
+        false,
+        DEVICE_BUS_I2C,
+        2,
+        400,
+        0
+    },
+    {
+        "24C16",
+        2048,
+        false,
+        false,
+        0,
+        0,
+        16,
+        0,
+        false,
+        false,
+        0,
+        false,
+        DEVICE_BUS_I2C,
+        1,
+        400,
+        0
+    },
+    {
+        "25LC256",
+        32768,
+        false,
+        false,
+        0,
+        0,
+        64,
+        0,
+        false,
+        true,
+        0,
+        false,
+        DEVICE_BUS_SPI,
+        2,
+        5000,
+        0
+    },
+    {
+        "W25Q80",
+        1048576,
+        false,
+        false,
+        0,
+        0,
+        256,
+        0,
+        false,
+        true,
+        0,
+        false,
+        DEVICE_BUS_SPI,
+        3,
+        20000,
+        4096
+    },
+    {
+        "W25Q32",
+        4194304,
+        false,
+        false,
+        0,
+        0,
+        256,
+        0,
+        false,
+        true,
+        0,
+        false,
+        DEVICE_BUS_SPI,
+        3,
+        20000,
+        4096
+    },
+    {
+        NULL
+    }
+};
+
+// Filled in from an address line probe
+static rom_config_t configs_detected[] = {
+    {
+        NULL
+    },
+    {
+        NULL
+    }
+};
+
 static config_category_t configs[] = {
     {
         "EEPROM",
@@ -167,6 +373,18 @@ static config_category_t configs[] = {
         "Atari 2600/VCS",
         &configs_atari[0]
     },
+    {
+        "Parallel Flash/EPROM",
+        &configs_flash[0]
+    },
+    {
+        "Serial EEPROM/Flash",
+        &configs_serial[0]
+    },
+    {
+        "Detected",
+        &configs_detected[0]
+    },
     {
         NULL
     }
@@ -176,8 +394,11 @@ static int config_category_index = 0;
 static int config_index = 0;
 
 void next_config_category() {
-    config_category_index++;
-    if (!configs[config_category_index].name) config_category_index = 0;
+    // Categories without profiles are skipped until something is detected
+    do {
+        config_category_index++;
+        if (!configs[config_category_index].name) config_category_index = 0;
+    } while (!configs[config_category_index].items[0].name);
     config_index = 0;
 };
 
@@ -186,6 +407,38 @@ void next_config() {
     if (!configs[config_category_index].items[config_index].name) config_index = 0;
 };
 
+bool select_config(const char * name) {
+    for (int i = 0; configs[i].name; i++) {
+        for (int j = 0; configs[i].items[j].name; j++) {
+            if (strcmp(configs[i].items[j].name, name)) continue;
+            config_category_index = i;
+            config_index = j;
+            return true;
+        }
+    }
+    return false;
+};
+
+// First profile which reads the same span of the bus, detected profiles aren't considered
+const char * find_config(size_t size, size_t address_mask) {
+    for (int i = 0; configs[i].name; i++) {
+        if (configs[i].items == configs_detected) continue;
+        for (int j = 0; configs[i].items[j].name; j++) {
+            if (configs[i].items[j].size == size && configs[i].items[j].addressMask == address_mask) return configs[i].items[j].name;
+        }
+    }
+    return NULL;
+};
+
+// The detected profile keeps the timing of the selected profile
+void set_detected_config(size_t size, size_t address_mask) {
+    configs_detected[0] = get_config();
+    configs_detected[0].name = "Detected";
+    configs_detected[0].size = size;
+    configs_detected[0].addressMask = address_mask;
+    select_config(configs_detected[0].name);
+};
+
 const char * get_config_category_name() {
     return configs[config_category_index].name;
 };
@@ -0,0 +1,147 @@
+#include "console.hpp"
+
+#include <string.h>
+#include <tusb.h>
+
+#include "pico/stdio.h"
+#include "pico/stdio/driver.h"
+#include "pico/stdio_usb.h"
+
+#include "usb.hpp"
+
+static char ring[CONSOLE_BUFFER_SIZE];
+static size_t head = 0, tail = 0;
+
+static stdio_driver_t console_driver;
+
+static bool stalled = false;
+
+// Submits as much buffered output as the USB transmit buffer takes without waiting, the rest stays in the
+// ring for the next call. Partial packets are held back unless everything is requested.
+static void drain(bool all) {
+    if (!tud_cdc_connected()) {
+        // Nobody is listening, don't hold up headless operation
+        tail = head;
+        return;
+    }
+
+    size_t pending, length, available;
+    bool usb = usb_lock();
+    while ((pending = head - tail)) {
+        length = CONSOLE_BUFFER_SIZE - (tail & (CONSOLE_BUFFER_SIZE - 1));
+        if (length > pending) length = pending;
+
+        available = tud_cdc_write_available();
+        if (length > available) length = available;
+        if (!all) length -= length % CONSOLE_PACKET_SIZE;
+        if (!length) break;
+
+        length = tud_cdc_write(&ring[tail & (CONSOLE_BUFFER_SIZE - 1)], length);
+        if (!length) break;
+        tail += length;
+        stalled = false;
+    }
+    if (all) tud_cdc_write_flush();
+    usb_unlock(usb);
+};
+
+static void console_out_chars(const char * data, int size) {
+    console_write(data, size);
+};
+
+static void console_out_flush() {
+    drain(true);
+};
+
+// Waiting for input is when the rest of the output has to be seen, each poll moves along what fits
+static int console_in_chars(char * data, int size) {
+    drain(true);
+    return stdio_usb.in_chars(data, size);
+};
+
+void console_init() {
+    memset(&console_driver, 0, sizeof(stdio_driver_t));
+    console_driver.out_chars = console_out_chars;
+    console_driver.out_flush = console_out_flush;
+    console_driver.in_chars = console_in_chars;
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    console_driver.crlf_enabled = PICO_STDIO_DEFAULT_CRLF;
+#endif
+
+    stdio_set_driver_enabled(&stdio_usb, false);
+    stdio_set_driver_enabled(&console_driver, true);
+};
+
+void console_write(const char * data, size_t size) {
+    size_t length;
+    while (size) {
+        if (head - tail == CONSOLE_BUFFER_SIZE) {
+            // Only a full ring waits for the host, and a host which stopped reading only holds it up once
+            uint32_t start = time_us_32();
+            do {
+                drain(true);
+            } while (!stalled && head - tail == CONSOLE_BUFFER_SIZE && time_us_32() - start < CONSOLE_STALL_US);
+            if (head - tail == CONSOLE_BUFFER_SIZE) {
+                stalled = true;
+                return;
+            }
+        }
+
+        length = CONSOLE_BUFFER_SIZE - (head & (CONSOLE_BUFFER_SIZE - 1));
+        if (length > CONSOLE_BUFFER_SIZE - (head - tail)) length = CONSOLE_BUFFER_SIZE - (head - tail);
+        if (length > size) length = size;
+
+        memcpy(&ring[head & (CONSOLE_BUFFER_SIZE - 1)], data, length);
+        head += length;
+        data += length;
+        size -= length;
+    }
+    drain(false);
+};
+
+void console_print(const char * text) {
+    console_write(text, strlen(text));
+};
+
+void console_flush() {
+    drain(true);
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// "00000: 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F  ................"
+void console_hexdump(const uint8_t * data, size_t size, size_t address) {
+    char line[9 + CONSOLE_HEXDUMP_WIDTH * 4 + 4];
+    char * out;
+    size_t i, count;
+    while (size) {
+        count = size < CONSOLE_HEXDUMP_WIDTH ? size : CONSOLE_HEXDUMP_WIDTH;
+        out = line;
+        *out++ = hex_digits[(address >> 16) & 0xF];
+        *out++ = hex_digits[(address >> 12) & 0xF];
+        *out++ = hex_digits[(address >> 8) & 0xF];
+        *out++ = hex_digits[(address >> 4) & 0xF];
+        *out++ = hex_digits[address & 0xF];
+        *out++ = ':';
+        for (i = 0; i < CONSOLE_HEXDUMP_WIDTH; i++) {
+            *out++ = ' ';
+            if (i < count) {
+                *out++ = hex_digits[data[i] >> 4];
+                *out++ = hex_digits[data[i] & 0xF];
+            } else {
+                *out++ = ' ';
+                *out++ = ' ';
+            }
+        }
+        *out++ = ' ';
+        *out++ = ' ';
+        for (i = 0; i < count; i++) *out++ = data[i] >= 0x20 && data[i] < 0x7F ? data[i] : '.';
+        *out++ = '\r';
+        *out++ = '\n';
+        console_write(line, out - line);
+
+        data += count;
+        address += count;
+        size -= count;
+    }
+};
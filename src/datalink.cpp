@@ -0,0 +1,158 @@
+#include "datalink.hpp"
+
+#include <stdio.h>
+#include <tusb.h>
+
+#include "digest.hpp"
+#include "job.hpp"
+#include "usb.hpp"
+
+static size_t progress;
+
+static void print_progress(size_t count) {
+    while (count >= progress + DATALINK_PROGRESS_SIZE) {
+        progress += DATALINK_PROGRESS_SIZE;
+        printf("%dK ", progress / 1024);
+    }
+};
+
+// Fills data from the host, timeout applies until the first byte then between bytes
+static bool read_exact(uint8_t * data, size_t size, uint32_t timeout_ms, bool show_progress) {
+    size_t count = 0, length;
+    uint32_t last = time_us_32();
+    bool usb;
+    while (count < size) {
+        usb = usb_lock();
+        length = tud_cdc_n_available(DATALINK_ITF) ? tud_cdc_n_read(DATALINK_ITF, data + count, size - count) : 0;
+        usb_unlock(usb);
+        if (length) {
+            count += length;
+            last = time_us_32();
+            timeout_ms = DATALINK_IDLE_TIMEOUT_MS;
+            if (show_progress) print_progress(count);
+            continue;
+        }
+        if (!job_yield(count)) return false;
+        if (time_us_32() - last > timeout_ms * 1000) {
+            printf("\r\nTimed out waiting for data");
+            return false;
+        }
+    }
+    return true;
+};
+
+// Hands data to the host as fast as the endpoint drains
+static bool write_exact(const uint8_t * data, size_t size, bool show_progress) {
+    size_t count = 0;
+    uint32_t length, last = time_us_32();
+    bool usb;
+    while (count < size) {
+        usb = usb_lock();
+        if ((length = tud_cdc_n_write_available(DATALINK_ITF))) {
+            if (length > size - count) length = size - count;
+            length = tud_cdc_n_write(DATALINK_ITF, data + count, length);
+            tud_cdc_n_write_flush(DATALINK_ITF);
+        }
+        usb_unlock(usb);
+        if (length) {
+            count += length;
+            last = time_us_32();
+            if (show_progress) print_progress(count);
+            continue;
+        }
+        if (!job_yield(count)) return false;
+        if (!tud_cdc_n_connected(DATALINK_ITF) || time_us_32() - last > DATALINK_IDLE_TIMEOUT_MS * 1000) {
+            printf("\r\nHost stopped reading");
+            return false;
+        }
+    }
+    usb = usb_lock();
+    tud_cdc_n_write_flush(DATALINK_ITF);
+    usb_unlock(usb);
+    return true;
+};
+
+static void reply(uint8_t status) {
+    bool usb = usb_lock();
+    tud_cdc_n_write(DATALINK_ITF, &status, 1);
+    tud_cdc_n_write_flush(DATALINK_ITF);
+    usb_unlock(usb);
+};
+
+// Anything left over from an abandoned transfer would be taken as a header
+static void discard_input() {
+    bool usb = usb_lock();
+    tud_cdc_n_read_flush(DATALINK_ITF);
+    usb_unlock(usb);
+};
+
+bool datalink_connected() {
+    return tud_cdc_n_connected(DATALINK_ITF);
+};
+
+size_t datalink_receive(uint8_t * data, size_t max_size) {
+    datalink_header_t header;
+    size_t size = 0;
+
+    discard_input();
+    progress = 0;
+
+    job_begin("Data channel transfer");
+    if (!read_exact((uint8_t *)&header, sizeof(datalink_header_t), DATALINK_CONNECT_TIMEOUT_MS, false)) {
+        // Nothing to answer
+    } else if (header.magic != DATALINK_MAGIC) {
+        printf("\r\nInvalid frame header");
+        reply(DATALINK_NAK);
+    } else if (header.size > max_size) {
+        printf("\r\nFrame of %d bytes exceeds %d byte buffer", header.size, max_size);
+        reply(DATALINK_NAK);
+    } else if (read_exact(data, header.size, DATALINK_IDLE_TIMEOUT_MS, true)) {
+        if (crc32(data, header.size) != header.digest) {
+            printf("\r\nCRC-32 mismatch");
+            reply(DATALINK_NAK);
+        } else {
+            reply(DATALINK_ACK);
+            size = header.size;
+        }
+    }
+    job_end();
+    return size;
+};
+
+bool datalink_send(const uint8_t * data, size_t size) {
+    datalink_header_t header = {
+        .magic = DATALINK_MAGIC,
+        .size = (uint32_t)size,
+        .digest = crc32(data, size)
+    };
+    uint8_t status = 0;
+    bool result = false;
+
+    discard_input();
+    progress = 0;
+
+    job_begin("Data channel transfer");
+
+    // The host signals it is listening by opening the port
+    uint32_t start = time_us_32();
+    while (!tud_cdc_n_connected(DATALINK_ITF)) {
+        if (!job_yield(0)) break;
+        if (time_us_32() - start > DATALINK_CONNECT_TIMEOUT_MS * 1000) {
+            printf("\r\nTimed out waiting for host");
+            break;
+        }
+    }
+
+    if (tud_cdc_n_connected(DATALINK_ITF)
+        && write_exact((const uint8_t *)&header, sizeof(datalink_header_t), false)
+        && write_exact(data, size, true)
+        && read_exact(&status, 1, DATALINK_IDLE_TIMEOUT_MS, false)) {
+        if (status == DATALINK_ACK) {
+            result = true;
+        } else {
+            printf("\r\nHost rejected frame");
+        }
+    }
+    job_end();
+    return result;
+};
@@ -0,0 +1,140 @@
+#include "delta.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "digest.hpp"
+#include "storage.hpp"
+
+static const uint8_t * delta_pos;
+static const uint8_t * delta_end;
+
+// The base stays open for the digest check and every copy op
+static file_reader_t base_reader;
+
+static bool read_number(uint32_t * value) {
+    *value = 0;
+    for (uint shift = 0; shift < 32; shift += 7) {
+        if (delta_pos >= delta_end) return false;
+        uint8_t byte = *delta_pos++;
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+};
+
+static bool check_base(const char * base, const delta_header_t * header) {
+    if (get_file_size(base) != header->base_size) {
+        printf("Base file is %d bytes, delta expects %d bytes.\r\n", get_file_size(base), header->base_size);
+        return false;
+    }
+
+    uint8_t chunk[DELTA_CHUNK_SIZE];
+    uint32_t digest = 0;
+    for (size_t offset = 0; offset < header->base_size; offset += DELTA_CHUNK_SIZE) {
+        size_t length = header->base_size - offset < DELTA_CHUNK_SIZE ? header->base_size - offset : DELTA_CHUNK_SIZE;
+        if (reader_read(&base_reader, chunk, length, offset) != length) {
+            printf("Failed to read base file.\r\n");
+            return false;
+        }
+        digest = crc32(chunk, length, digest);
+    }
+    if (digest != header->base_digest) {
+        printf("Base file digest 0x%08X doesn't match delta base 0x%08X.\r\n", digest, header->base_digest);
+        return false;
+    }
+    return true;
+};
+
+// Applies the ops following the header, false on a malformed delta
+static bool apply_ops(const delta_header_t * header, const uint8_t * delta, size_t delta_size, uint8_t * buffer, size_t * result) {
+    delta_pos = delta + sizeof(delta_header_t);
+    delta_end = delta + delta_size;
+
+    size_t size = 0;
+    uint32_t op, offset, length;
+    while (true) {
+        if (delta_pos >= delta_end) {
+            printf("Delta ended without an end op.\r\n");
+            return false;
+        }
+        op = *delta_pos++;
+        if (op == DELTA_END) break;
+
+        if (op != DELTA_COPY && op != DELTA_INSERT && op != DELTA_FILL) {
+            printf("Invalid delta op at 0x%04X.\r\n", size);
+            return false;
+        }
+        if ((op == DELTA_COPY && !read_number(&offset)) || !read_number(&length)) {
+            printf("Delta op at 0x%04X is truncated.\r\n", size);
+            return false;
+        }
+        if (length > header->size - size) {
+            printf("Delta op at 0x%04X overruns the result.\r\n", size);
+            return false;
+        }
+
+        switch (op) {
+            case DELTA_COPY:
+                // Copy ops read the base straight into place, the base is never held in memory
+                if (offset > header->base_size || length > header->base_size - offset || reader_read(&base_reader, buffer + size, length, offset) != length) {
+                    printf("Invalid copy from base at 0x%04X.\r\n", offset);
+                    return false;
+                }
+                break;
+            case DELTA_INSERT:
+                if (length > (size_t)(delta_end - delta_pos)) {
+                    printf("Delta insert at 0x%04X is truncated.\r\n", size);
+                    return false;
+                }
+                memcpy(buffer + size, delta_pos, length);
+                delta_pos += length;
+                break;
+            case DELTA_FILL:
+                if (delta_pos >= delta_end) {
+                    printf("Delta fill at 0x%04X is truncated.\r\n", size);
+                    return false;
+                }
+                memset(buffer + size, *delta_pos++, length);
+                break;
+        }
+        size += length;
+    }
+    *result = size;
+    return true;
+};
+
+size_t delta_apply(const char * base, const uint8_t * delta, size_t delta_size, uint8_t * buffer, size_t buffer_size) {
+    delta_header_t header;
+    if (delta_size < sizeof(delta_header_t)) {
+        printf("Delta is too short.\r\n");
+        return 0;
+    }
+    memcpy(&header, delta, sizeof(delta_header_t));
+    if (header.magic != DELTA_MAGIC) {
+        printf("Not a delta file.\r\n");
+        return 0;
+    }
+    if (header.size > buffer_size) {
+        printf("Delta result of %d bytes is too large.\r\n", header.size);
+        return 0;
+    }
+    if (!reader_open(&base_reader, base)) {
+        printf("Failed to open base file.\r\n");
+        return 0;
+    }
+    size_t size = 0;
+    bool applied = check_base(base, &header) && apply_ops(&header, delta, delta_size, buffer, &size);
+    reader_close(&base_reader);
+    if (!applied) return 0;
+
+    if (size != header.size) {
+        printf("Delta produced %d bytes, expected %d bytes.\r\n", size, header.size);
+        return 0;
+    }
+    if (crc32(buffer, size) != header.digest) {
+        printf("Result digest doesn't match, delta was not applied.\r\n");
+        return 0;
+    }
+    return size;
+};
@@ -0,0 +1,409 @@
+#include "device.hpp"
+
+#include <string.h>
+
+#include "arena.hpp"
+#include "pins.hpp"
+
+Device::Device(rom_config_t config) {
+    this->config = config;
+    this->write_stats = { 0 };
+    this->check_stats = { 0 };
+    this->progress = NULL;
+    this->differential = false;
+
+    gpio_init(LED_PIN);
+    gpio_set_dir(LED_PIN, true);
+    gpio_put(LED_PIN, true);
+};
+
+Device::~Device() {
+    gpio_put(LED_PIN, false);
+    gpio_deinit(LED_PIN);
+};
+
+const rom_config_t * Device::get_config() const {
+    return &this->config;
+};
+
+const rom_write_stats_t * Device::get_write_stats() const {
+    return &this->write_stats;
+};
+
+const rom_check_stats_t * Device::get_check_stats() const {
+    return &this->check_stats;
+};
+
+void Device::set_progress(progress_func_t cb) {
+    this->progress = cb;
+};
+
+progress_func_t Device::get_progress() const {
+    return this->progress;
+};
+
+// Only write pages (or bytes without paging) which differ from the device
+void Device::set_differential(bool enable) {
+    this->differential = enable;
+};
+
+size_t Device::get_size() const {
+    return this->config.size;
+};
+
+size_t Device::get_page_size() const {
+    return this->config.pageSize;
+};
+
+bool Device::read(uint8_t * data, size_t size, size_t offset, bool print_status) {
+    if (offset > this->config.size) return false;
+    if (!size) size = this->config.size;
+    if (size > this->config.size - offset) size = this->config.size - offset;
+
+    size_t address = offset, end = offset + size, next;
+    while (address < end) {
+        // Keep bursts aligned so that the status output lands on the same boundaries
+        next = (address / BURST_SIZE + 1) * BURST_SIZE;
+        if (next > end) next = end;
+        this->read_burst(&data[address - offset], next - address, address);
+        address = next;
+        this->status(address - 1, print_status);
+        if (this->progress && !this->progress(address)) return false;
+    }
+    return true;
+};
+bool Device::read(uint8_t * data, size_t size, size_t offset) {
+    return this->read(data, size, offset, true);
+};
+bool Device::read(uint8_t * data, size_t size) {
+    return this->read(data, size, 0, true);
+};
+bool Device::read(uint8_t * data) {
+    return this->read(data, this->config.size, 0, true);
+};
+
+const static uint8_t * _data_image;
+uint8_t data_image(size_t address) {
+    return _data_image[address];
+};
+
+static uint8_t _data_value = 0;
+uint8_t data_value(size_t address) {
+    return _data_value;
+};
+
+uint8_t data_index(size_t address) {
+    return (uint8_t)(address & 0xff);
+};
+
+bool Device::write_image(const uint8_t * data, size_t size, size_t offset, bool print_status) {
+    _data_image = data;
+    return this->write(data_image, size, offset, false, print_status);
+};
+bool Device::write_image(const uint8_t * data, size_t size, size_t offset) {
+    return this->write_image(data, size, offset, true);
+};
+bool Device::write_image(const uint8_t * data, size_t size) {
+    return this->write_image(data, size, 0, true);
+};
+
+bool Device::write_value(uint8_t value, bool print_status) {
+    _data_value = value;
+    return this->write(data_value, this->config.size, 0, false, print_status);
+};
+bool Device::write_value(uint8_t value) {
+    return this->write_value(value, true);
+};
+
+
+bool Device::write_index(bool print_status) {
+    return this->write(data_index, this->config.size, 0, false, print_status);
+};
+bool Device::write_index() {
+    return this->write_index(true);
+};
+
+bool Device::write_data(data_func_t cb, size_t size, size_t offset, bool print_status) {
+    return this->write(cb, size, offset, false, print_status);
+};
+
+size_t Device::write_verify_image(const uint8_t * data, size_t size, size_t offset, bool print_status) {
+    _data_image = data;
+    if (!this->write(data_image, size, offset, true, print_status)) return -1;
+    return this->write_stats.errors;
+};
+size_t Device::write_verify_image(const uint8_t * data, size_t size, size_t offset) {
+    return this->write_verify_image(data, size, offset, true);
+};
+size_t Device::write_verify_image(const uint8_t * data, size_t size) {
+    return this->write_verify_image(data, size, 0, true);
+};
+
+size_t Device::write_verify_value(uint8_t value, bool print_status) {
+    _data_value = value;
+    if (!this->write(data_value, this->config.size, 0, true, print_status)) return -1;
+    return this->write_stats.errors;
+};
+size_t Device::write_verify_value(uint8_t value) {
+    return this->write_verify_value(value, true);
+};
+
+size_t Device::write_verify_index(bool print_status) {
+    if (!this->write(data_index, this->config.size, 0, true, print_status)) return -1;
+    return this->write_stats.errors;
+};
+size_t Device::write_verify_index() {
+    return this->write_verify_index(true);
+};
+
+size_t Device::write_verify_data(data_func_t cb, size_t size, size_t offset, bool print_status) {
+    if (!this->write(cb, size, offset, true, print_status)) return -1;
+    return this->write_stats.errors;
+};
+
+size_t Device::verify_image(uint8_t * data, size_t size, size_t offset, bool print_status) {
+    _data_image = data;
+    return this->verify(data_image, size, offset, print_status);
+};
+size_t Device::verify_image(uint8_t * data, size_t size, size_t offset) {
+    return this->verify_image(data, size, offset, true);
+};
+size_t Device::verify_image(uint8_t * data, size_t size) {
+    return this->verify_image(data, size, 0, true);
+};
+
+size_t Device::verify_value(uint8_t value, bool print_status) {
+    _data_value = value;
+    return this->verify(data_value, this->config.size, 0, print_status);
+};
+size_t Device::verify_value(uint8_t value) {
+    return this->verify_value(value, true);
+};
+
+size_t Device::verify_index(bool print_status) {
+    return this->verify(data_index, this->config.size, 0, print_status);
+};
+size_t Device::verify_index() {
+    return this->verify_index(true);
+};
+
+size_t Device::verify_data(data_func_t cb, size_t size, size_t offset, bool print_status) {
+    return this->verify(cb, size, offset, print_status);
+};
+
+// Early exit stops at the first differing burst, the first differing address goes to the check stats
+size_t Device::verify(data_func_t cb, size_t size, size_t offset, bool print_status, bool early_exit) {
+    if (size + offset > this->config.size) return -1;
+    size_t error = 0, address = offset, end = offset + size, next, i;
+    uint8_t data[BURST_SIZE];
+    while (address < end) {
+        next = (address / BURST_SIZE + 1) * BURST_SIZE;
+        if (next > end) next = end;
+        this->read_burst(data, next - address, address);
+        for (i = 0; i < next - address; i++) {
+            if (data[i] == cb(address + i - offset)) continue;
+            if (early_exit && !error) this->check_stats.mismatch = address + i;
+            error += 1;
+        }
+        this->check_stats.reads += next - address;
+        address = next;
+        this->status(address - 1, print_status);
+        if (early_exit && error) break;
+        if (this->progress && !this->progress(address)) return -1;
+    }
+    return error;
+};
+size_t Device::verify(data_func_t cb, size_t size, size_t offset, bool print_status) {
+    return this->verify(cb, size, offset, print_status, false);
+};
+
+bool Device::check_image(const uint8_t * data, size_t size, size_t offset, bool print_status) {
+    _data_image = data;
+    return this->check(data_image, size, offset, print_status);
+};
+bool Device::check_image(const uint8_t * data, size_t size) {
+    return this->check_image(data, size, 0, true);
+};
+
+// Blank checks are a check against the erased value
+bool Device::check_value(uint8_t value, bool print_status) {
+    _data_value = value;
+    return this->check(data_value, this->config.size, 0, print_status);
+};
+bool Device::check_value(uint8_t value) {
+    return this->check_value(value, true);
+};
+
+bool Device::check_data(data_func_t cb, size_t size, size_t offset, bool print_status) {
+    return this->check(cb, size, offset, print_status);
+};
+
+// Chips which differ usually do so almost everywhere, so a sample settles most checks in a few hundred reads
+bool Device::check(data_func_t cb, size_t size, size_t offset, bool print_status) {
+    this->check_stats = { 0 };
+    this->check_stats.mismatch = -1;
+    if (!size || size + offset > this->config.size) return false;
+
+    uint32_t state = CHECK_SEED;
+    size_t address, i;
+    for (i = 0; i < CHECK_SAMPLES && i < size; i++) {
+        address = offset + xorshift32(&state) % size;
+        this->check_stats.reads++;
+        if (this->read_byte(address) != cb(address - offset)) {
+            this->check_stats.mismatch = address;
+            this->check_stats.sampled = true;
+            return false;
+        }
+    }
+
+    // The sample can't prove a match, only a full scan can
+    return !this->verify(cb, size, offset, print_status, true);
+};
+
+void Device::print() {
+    this->config.print();
+};
+
+void Device::status(size_t address, bool output) {
+    gpio_put(LED_PIN, (address & 0x100) != 0);
+    if (output && ((address + 1) & 0x7FF) == 0) printf("%dK ", (address + 1) >> 10);
+};
+
+// Paged writes for devices which load a page with one command and report when it is done. Sectored devices
+// are erased a sector at a time as the write reaches it, the sector is staged in the arena meanwhile.
+bool Device::write_pages(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status) {
+    if (this->config.readonly || size + offset > this->config.size) return false;
+    if (this->config.pageSize > BURST_SIZE || this->config.sectorSize > SECTOR_MAX_SIZE) return false;
+
+    size_t mark = arena_mark();
+    uint8_t * sector = NULL;
+    if (this->config.sectorSize && !(sector = (uint8_t *)arena_alloc("sector buffer", this->config.sectorSize))) return false;
+    bool result = this->write_range(cb, size, offset, verify, print_status, sector);
+    arena_release(mark);
+    return result;
+};
+
+bool Device::write_range(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status, uint8_t * sector) {
+    this->write_stats = { 0 };
+    this->write_stats.verified = offset;
+
+    size_t address = offset, end = offset + size, next, i;
+    size_t chunk = this->config.pageSize ? this->config.pageSize : BURST_SIZE;
+    size_t error, attempt;
+    uint8_t data[BURST_SIZE], check[BURST_SIZE];
+    while (address < end) {
+        if (sector && (address == offset || !(address % this->config.sectorSize))) {
+            if (!this->prepare_sector(cb, offset, end, address - address % this->config.sectorSize, sector)) return false;
+        }
+
+        next = (address / chunk + 1) * chunk;
+        if (next > end) next = end;
+        for (i = 0; i < next - address; i++) data[i] = cb(address + i - offset);
+
+        attempt = 0;
+        if (this->differential) {
+            this->read_burst(check, next - address, address);
+            if (!memcmp(check, data, next - address)) {
+                this->write_stats.skipped++;
+                attempt = WRITE_RETRIES + 1;
+            }
+        }
+
+        for (; attempt <= WRITE_RETRIES; attempt++) {
+            if (!this->program_page(data, next - address, address)) return false;
+            this->write_stats.pages++;
+            if (!verify) break;
+
+            this->read_burst(check, next - address, address);
+            error = 0;
+            for (i = 0; i < next - address; i++) {
+                if (check[i] != data[i]) error++;
+            }
+            if (!error) break;
+            if (attempt == WRITE_RETRIES) {
+                this->write_stats.errors += error;
+                break;
+            }
+            this->write_stats.retries++;
+        }
+        if (this->write_stats.verified == address && (attempt > WRITE_RETRIES || (verify && !error))) this->write_stats.verified = next;
+
+        address = next;
+        this->status(address - 1, print_status);
+        if (this->progress && !this->progress(address)) return false;
+    }
+    return true;
+};
+
+// Programming only clears bits, a sector is erased when some byte needs a bit set again. Bytes of the
+// sector outside the write are put back after the erase.
+bool Device::prepare_sector(data_func_t cb, size_t offset, size_t end, size_t sector, uint8_t * staged) {
+    size_t size = this->config.sectorSize, chunk = this->config.pageSize ? this->config.pageSize : BURST_SIZE;
+    size_t first = sector > offset ? sector : offset, last = sector + size < end ? sector + size : end;
+    size_t address, next, i;
+    uint8_t value, page[BURST_SIZE];
+    bool erase = false;
+
+    for (address = sector; address < sector + size; address = next) {
+        next = address + BURST_SIZE < sector + size ? address + BURST_SIZE : sector + size;
+        this->read_burst(staged + address - sector, next - address, address);
+    }
+    for (address = first; address < last && !erase; address++) {
+        value = cb(address - offset);
+        erase = (staged[address - sector] & value) != value;
+    }
+    if (!erase) {
+        this->write_stats.unerased++;
+        return true;
+    }
+
+    if (!this->erase_sector(sector)) return false;
+    this->write_stats.erased++;
+
+    for (address = sector; address < sector + size; address = next) {
+        next = address + chunk;
+        memcpy(page, staged + address - sector, chunk);
+        for (i = address; i < next; i++) {
+            if (i >= first && i < last) page[i - address] = 0xFF;
+        }
+        for (i = 0; i < chunk && page[i] == 0xFF; i++);
+        if (i < chunk && !this->program_page(page, chunk, address)) return false;
+    }
+    return true;
+};
+
+// Erases every sector which isn't already blank
+bool Device::erase() {
+    if (!this->config.sectorSize || this->config.readonly) return false;
+    this->write_stats = { 0 };
+
+    uint8_t data[BURST_SIZE];
+    size_t sector, address, i;
+    bool blank;
+    for (sector = 0; sector < this->config.size; sector += this->config.sectorSize) {
+        blank = true;
+        for (address = sector; address < sector + this->config.sectorSize && blank; address += BURST_SIZE) {
+            this->read_burst(data, BURST_SIZE, address);
+            for (i = 0; i < BURST_SIZE && data[i] == 0xFF; i++);
+            blank = i == BURST_SIZE;
+        }
+        if (blank) {
+            this->write_stats.unerased++;
+        } else if (this->erase_sector(sector)) {
+            this->write_stats.erased++;
+        } else {
+            return false;
+        }
+        this->status(sector + this->config.sectorSize - 1, true);
+        if (this->progress && !this->progress(sector + this->config.sectorSize)) return false;
+    }
+    return true;
+};
+
+bool Device::program_page(const uint8_t * data, size_t size, size_t offset) {
+    return false;
+};
+
+bool Device::erase_sector(size_t offset) {
+    return false;
+};
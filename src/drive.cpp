@@ -0,0 +1,115 @@
+#include "drive.hpp"
+
+#include <string.h>
+#include <tusb.h>
+
+#define SCSI_CMD_SYNCHRONIZE_CACHE 0x35
+
+// The MSC callbacks run from the USB task, the main loop stays out of littlefs while the drive is active
+static volatile bool active = false;
+static volatile bool changed = false;
+static uint8_t sector[FATVIEW_SECTOR_SIZE];
+
+bool drive_start() {
+    if (active || !fatview_mount()) return false;
+    changed = true;
+    active = true;
+    return true;
+};
+
+void drive_stop() {
+    // Callbacks can't be in progress once the flag is clear, they preempt the main loop
+    active = false;
+    fatview_unmount();
+};
+
+bool drive_active() {
+    return active;
+};
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4]) {
+    (void)lun;
+    memcpy(vendor_id, "PicoPROM", 8);
+    memcpy(product_id, "Flash Storage   ", 16);
+    memcpy(product_rev, "1.0 ", 4);
+};
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+    if (!active) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00); // Medium not present
+        return false;
+    }
+    if (changed) {
+        // Anything the host cached from an earlier session is stale
+        changed = false;
+        tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0x00);
+        return false;
+    }
+
+    // Hosts poll regularly, a good time to move finished uploads into place
+    fatview_settle(false);
+    return true;
+};
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t * block_count, uint16_t * block_size) {
+    (void)lun;
+    *block_count = FATVIEW_SECTORS;
+    *block_size = FATVIEW_SECTOR_SIZE;
+};
+
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject) {
+    (void)lun;
+    (void)power_condition;
+    if (load_eject && !start && active) {
+        active = false;
+        fatview_unmount();
+    }
+    return true;
+};
+
+bool tud_msc_is_writable_cb(uint8_t lun) {
+    (void)lun;
+    return active;
+};
+
+// Endpoint buffers are one sector, requests always cover whole sectors
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void * buffer, uint32_t bufsize) {
+    if (!active) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+        return -1;
+    }
+    if (offset >= FATVIEW_SECTOR_SIZE || !fatview_read(lba, sector)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00); // Unrecovered read error
+        return -1;
+    }
+    if (bufsize > FATVIEW_SECTOR_SIZE - offset) bufsize = FATVIEW_SECTOR_SIZE - offset;
+    memcpy(buffer, sector + offset, bufsize);
+    return bufsize;
+};
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t * buffer, uint32_t bufsize) {
+    if (!active) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+        return -1;
+    }
+    if (offset || bufsize < FATVIEW_SECTOR_SIZE || !fatview_write(lba, buffer)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00); // Write protected
+        return -1;
+    }
+    return FATVIEW_SECTOR_SIZE;
+};
+
+int32_t tud_msc_scsi_cb(uint8_t lun, const uint8_t scsi_cmd[16], void * buffer, uint16_t bufsize) {
+    (void)buffer;
+    (void)bufsize;
+    switch (scsi_cmd[0]) {
+        case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+            return 0;
+        case SCSI_CMD_SYNCHRONIZE_CACHE:
+            if (active) fatview_settle(true);
+            return 0;
+        default:
+            tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // Invalid command
+            return -1;
+    }
+};
@@ -0,0 +1,161 @@
+#include "emulator.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/multicore.h"
+
+#include "arena.hpp"
+#include "pins.hpp"
+
+// Two banks so a new image can be loaded while the other is being served
+static uint8_t (*banks)[EMULATOR_SIZE];
+static size_t arena_mark_start;
+static volatile const uint8_t * active_bank = NULL;
+static uint8_t next_bank = 0;
+
+// Translate each byte of the gpio state into its share of the bus address, and data values back into gpio levels
+static uint16_t address_lut[4][256];
+static uint32_t data_lut[256];
+static uint32_t addr_mask, data_mask, select_mask, select_value;
+
+static volatile uint32_t cycles = 0;
+static volatile uint32_t loops = 0;
+static bool running = false;
+
+static void __not_in_flash_func(emulator_loop)() {
+    // A lockout victim, so core0 can write flash storage safely. The responder stops answering for the length
+    // of each storage program or erase, the target sees an undriven bus meanwhile.
+    multicore_lockout_victim_init();
+
+    bool driving = false;
+    while (true) {
+        uint32_t pins = gpio_get_all();
+        loops++;
+
+        if ((pins & select_mask) != select_value) {
+            if (driving) {
+                gpio_set_dir_in_masked(data_mask);
+                driving = false;
+            }
+            continue;
+        }
+
+        uint32_t address = address_lut[0][pins & 0xFF]
+            | address_lut[1][(pins >> 8) & 0xFF]
+            | address_lut[2][(pins >> 16) & 0xFF]
+            | address_lut[3][(pins >> 24) & 0xFF];
+        gpio_put_masked(data_mask, data_lut[active_bank[address]]);
+        if (!driving) {
+            gpio_set_dir_out_masked(data_mask);
+            driving = true;
+            cycles++;
+        }
+    }
+}
+
+static void fill_bank(uint8_t * bank, const uint8_t * image, size_t size) {
+    // Images smaller than the address space repeat, as a smaller chip with unused upper address lines would
+    for (size_t i = 0; i < EMULATOR_SIZE; i += size) {
+        memcpy(bank + i, image, i + size > EMULATOR_SIZE ? EMULATOR_SIZE - i : size);
+    }
+}
+
+bool emulator_start(rom_config_t config, const uint8_t * image, size_t size) {
+    if (running || !size) return false;
+    if (size > EMULATOR_SIZE) size = EMULATOR_SIZE;
+
+    arena_mark_start = arena_mark();
+    if (!(banks = (uint8_t (*)[EMULATOR_SIZE])arena_alloc("emulator banks", 2 * EMULATOR_SIZE))) return false;
+
+    // Only the lines the device decodes select a byte, lines above its size and lines held high by the
+    // address mask don't, so the image mirrors like the device would
+    size_t decoded = (config.size - 1) & ~config.addressMask;
+    addr_mask = data_mask = 0;
+    memset(address_lut, 0, sizeof(address_lut));
+    for (uint8_t i = 0; i < ADDR_BITS; i++) {
+        addr_mask |= 1 << ADDR_MAP[i];
+        if (!(decoded & (1 << i))) continue;
+        for (uint j = 0; j < 256; j++) {
+            if (j & (1 << (ADDR_MAP[i] & 7))) address_lut[ADDR_MAP[i] >> 3][j] |= 1 << i;
+        }
+    }
+    for (uint8_t i = 0; i < DATA_BITS; i++) data_mask |= 1 << DATA_MAP[i];
+    for (uint j = 0; j < 256; j++) {
+        data_lut[j] = 0;
+        for (uint8_t i = 0; i < DATA_BITS; i++) {
+            if (j & (1 << i)) data_lut[j] |= 1 << DATA_MAP[i];
+        }
+    }
+
+    // Chip enable polarity follows the device, output enable is only decoded when the device has one
+    select_mask = 1 << CE_PIN;
+    select_value = config.invertClock ? select_mask : 0;
+    if (!config.readonly) select_mask |= 1 << OE_PIN;
+
+    gpio_init_mask(addr_mask | data_mask | (1 << CE_PIN) | (1 << OE_PIN) | (1 << WE_PIN));
+    gpio_set_dir_in_masked(addr_mask | data_mask | (1 << CE_PIN) | (1 << OE_PIN) | (1 << WE_PIN));
+
+    gpio_init(LED_PIN);
+    gpio_set_dir(LED_PIN, true);
+    gpio_put(LED_PIN, true);
+
+    fill_bank(banks[0], image, size);
+    active_bank = banks[0];
+    next_bank = 1;
+    cycles = loops = 0;
+
+    multicore_reset_core1();
+    multicore_launch_core1(emulator_loop);
+    running = true;
+    return true;
+};
+
+void emulator_reload(const uint8_t * image, size_t size) {
+    if (!running || !size) return;
+    if (size > EMULATOR_SIZE) size = EMULATOR_SIZE;
+    fill_bank(banks[next_bank], image, size);
+    active_bank = banks[next_bank];
+    next_bank ^= 1;
+};
+
+void emulator_stop() {
+    if (!running) return;
+    multicore_reset_core1();
+    running = false;
+    arena_release(arena_mark_start);
+
+    gpio_set_dir_in_masked(data_mask);
+    for (uint8_t i = 0; i < ADDR_BITS; i++) gpio_deinit(ADDR_MAP[i]);
+    for (uint8_t i = 0; i < DATA_BITS; i++) gpio_deinit(DATA_MAP[i]);
+    gpio_deinit(CE_PIN);
+    gpio_deinit(OE_PIN);
+    gpio_deinit(WE_PIN);
+    gpio_put(LED_PIN, false);
+    gpio_deinit(LED_PIN);
+};
+
+bool emulator_running() {
+    return running;
+};
+
+uint32_t emulator_cycles() {
+    return cycles;
+};
+
+void emulator_benchmark() {
+    if (!running) return;
+    uint32_t start = loops;
+    sleep_ms(EMULATOR_BENCHMARK_MS);
+    uint32_t count = loops - start;
+    if (!count) {
+        printf("Responder is not running.\r\n\r\n");
+        return;
+    }
+
+    // A bus change is seen at worst one loop late and answered within the following loop
+    uint32_t period = (uint32_t)((uint64_t)EMULATOR_BENCHMARK_MS * 1000000 / count);
+    printf("Responder loop: %d ns (%d loops/s)\r\n", period, count * (1000 / EMULATOR_BENCHMARK_MS));
+    printf("Worst-case access time: %d ns\r\n", period * 2);
+    printf("Chip select cycles: %d\r\n\r\n", cycles);
+};
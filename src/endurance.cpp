@@ -0,0 +1,99 @@
+#include "endurance.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pattern.hpp"
+#include "job.hpp"
+
+static endurance_stats_t stats;
+static size_t first_page;
+static size_t page_size;
+
+// Per page results
+static uint16_t page_max_us[ENDURANCE_MAX_PAGES];
+static uint32_t page_first_failure[ENDURANCE_MAX_PAGES];
+
+bool endurance_run(ROM * rom, size_t page_offset, size_t page_count, uint32_t cycles) {
+    page_size = rom->get_page_size();
+    if (!page_size || page_size > BURST_SIZE || rom->get_config()->readonly) return false;
+    if (page_count > ENDURANCE_MAX_PAGES) page_count = ENDURANCE_MAX_PAGES;
+    if ((page_offset + page_count) * page_size > rom->get_size()) return false;
+
+    memset(&stats, 0, sizeof(endurance_stats_t));
+    memset(page_max_us, 0, sizeof(page_max_us));
+    memset(page_first_failure, 0, sizeof(page_first_failure));
+    first_page = page_offset;
+    stats.pages = page_count;
+
+    uint8_t data[BURST_SIZE], check[BURST_SIZE];
+    size_t page, address;
+    uint32_t elapsed, cycle_max;
+    for (uint32_t cycle = 1; cycle <= cycles; cycle++) {
+        // Alternate so every cell flips on every cycle
+        pattern_select(cycle & 1 ? PATTERN_CHECKERBOARD : PATTERN_INVERSE_CHECKERBOARD, 0);
+        cycle_max = 0;
+        for (page = 0; page < page_count; page++) {
+            address = (page_offset + page) * page_size;
+            pattern_fill(data, page_size, address);
+
+            elapsed = rom->write_page_timed(data, page_size, address);
+            if (elapsed) {
+                if (elapsed > 0xFFFF) elapsed = 0xFFFF;
+                if (elapsed > page_max_us[page]) page_max_us[page] = elapsed;
+                if (elapsed > stats.max_us) stats.max_us = elapsed;
+                if (elapsed > cycle_max) cycle_max = elapsed;
+                stats.total_us += elapsed;
+                stats.samples++;
+                stats.histogram[elapsed / ENDURANCE_BUCKET_US < ENDURANCE_BUCKETS ? elapsed / ENDURANCE_BUCKET_US : ENDURANCE_BUCKETS - 1]++;
+            } else {
+                stats.timeouts++;
+            }
+
+            rom->read(check, page_size, address, false);
+            if ((!elapsed || memcmp(data, check, page_size)) && !page_first_failure[page]) {
+                page_first_failure[page] = cycle;
+                stats.failed_pages++;
+            }
+            if (!job_yield(address + page_size)) return true; // Keep partial results
+        }
+        stats.cycles = cycle;
+        printf("\r\nCycle %d: %d failed pages, %dus slowest write", cycle, stats.failed_pages, cycle_max);
+    }
+    return true;
+};
+
+const endurance_stats_t * get_endurance_stats() {
+    return &stats;
+};
+
+void print_endurance_histogram() {
+    for (uint8_t i = 0; i < ENDURANCE_BUCKETS; i++) {
+        if (!stats.histogram[i]) continue;
+        printf("\t%5d-%5dus: %d\r\n", i * ENDURANCE_BUCKET_US, (i + 1) * ENDURANCE_BUCKET_US - 1, stats.histogram[i]);
+    }
+};
+
+size_t endurance_csv(char * out, size_t size) {
+    size_t len = 0, i;
+    int n;
+
+    n = snprintf(out, size, "cycles,%lu\npage_size,%u\n\npage,address,max_us,first_failure\n", (unsigned long)stats.cycles, (uint)page_size);
+    if (n < 0 || (size_t)n >= size) return 0;
+    len += n;
+    for (i = 0; i < stats.pages; i++) {
+        n = snprintf(out + len, size - len, "%u,%u,%u,%lu\n", (uint)(first_page + i), (uint)((first_page + i) * page_size), page_max_us[i], (unsigned long)page_first_failure[i]);
+        if (n < 0 || len + n >= size) return len;
+        len += n;
+    }
+
+    n = snprintf(out + len, size - len, "\nbucket_us,count\n");
+    if (n < 0 || len + n >= size) return len;
+    len += n;
+    for (i = 0; i < ENDURANCE_BUCKETS; i++) {
+        n = snprintf(out + len, size - len, "%u,%lu\n", (uint)(i * ENDURANCE_BUCKET_US), (unsigned long)stats.histogram[i]);
+        if (n < 0 || len + n >= size) return len;
+        len += n;
+    }
+    return len;
+};
@@ -0,0 +1,686 @@
+#include "fatview.hpp"
+
+#include <string.h>
+
+#include "picoprom.hpp"
+#include "arena.hpp"
+
+#define ENTRY_SIZE 32
+#define ENTRIES_PER_SECTOR (FATVIEW_SECTOR_SIZE / ENTRY_SIZE)
+#define LFN_CHARS 13
+
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_DIRECTORY 0x10
+#define ATTR_ARCHIVE 0x20
+#define ATTR_LFN 0x0F
+
+#define CASE_LOWER_BASE 0x08
+#define CASE_LOWER_EXT 0x10
+
+#define FAT_FREE 0x000
+#define FAT_BAD 0xFF7
+#define FAT_END 0xFFF
+
+// 2024-06-14 00:00
+#define FAT_DATE (((2024 - 1980) << 9) | (6 << 5) | 14)
+
+#define VOLUME_LABEL "PICOPROM   "
+
+// Files shown on the volume, in directory slot and cluster order
+typedef struct {
+    char name[LFS_NAME_MAX+1];
+    uint8_t short_name[11];
+    uint8_t case_flags;
+    uint8_t lfn_count;
+    uint16_t slot; // Short entry, long name entries come right before it
+    uint16_t cluster;
+    uint32_t size;
+} fatview_file_t;
+
+// Contiguous clusters written by the host, kept in a hidden file until directory entries claim them
+typedef struct {
+    bool used;
+    uint16_t cluster;
+    uint32_t written;
+} run_t;
+
+// Directory entries the host wrote for new files
+typedef struct {
+    bool used;
+    fatview_file_t file;
+} pending_t;
+
+#define FATVIEW_FILES (MAXFILES + FATVIEW_UPLOADS)
+
+static fatview_file_t * files = NULL;
+static size_t file_count;
+static run_t runs[FATVIEW_UPLOADS];
+static pending_t pending[FATVIEW_UPLOADS];
+static run_t * streaming;
+static fatview_file_t * reading;
+static uint8_t copy_buffer[FATVIEW_SECTOR_SIZE];
+
+static size_t arena_start;
+static uint16_t bad_cluster;
+static uint32_t last_write;
+
+static fatview_stats_t stats;
+
+// Names
+
+static const char short_chars[] = "!#$%&'()-@^_`{}~";
+
+static bool short_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c && strchr(short_chars, c));
+};
+
+static char upper(char c) {
+    return c >= 'a' && c <= 'z' ? c - 0x20 : c;
+};
+
+static char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+};
+
+// False if mixed case, otherwise sets the case flag if the letters are lowercase
+static bool single_case(const char * str, size_t len, uint8_t flag, uint8_t * flags) {
+    bool has_upper = false, has_lower = false;
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] >= 'A' && str[i] <= 'Z') has_upper = true;
+        if (str[i] >= 'a' && str[i] <= 'z') has_lower = true;
+    }
+    if (has_upper && has_lower) return false;
+    if (has_lower) *flags |= flag;
+    return true;
+};
+
+static void copy_short(uint8_t * dest, const char * src, size_t len, size_t max) {
+    size_t i, j = 0;
+    for (i = 0; i < len && j < max; i++) {
+        if (short_char(src[i])) dest[j++] = upper(src[i]);
+    }
+};
+
+// Names which fit 8.3 keep their case through the case flags, anything else gets long name entries
+static void make_short_name(fatview_file_t * file, size_t index) {
+    const char * name = file->name;
+    const char * dot = strrchr(name, '.');
+    size_t len = strlen(name);
+    size_t base_len = dot ? dot - name : len;
+    size_t ext_len = dot ? len - base_len - 1 : 0;
+    size_t i;
+
+    memset(file->short_name, ' ', 11);
+    file->case_flags = 0;
+    file->lfn_count = 0;
+
+    bool fits = base_len && base_len <= 8 && ext_len <= 3 && (!dot || ext_len);
+    for (i = 0; fits && i < len; i++) {
+        if (name + i != dot && !short_char(name[i])) fits = false;
+    }
+    if (fits) fits = single_case(name, base_len, CASE_LOWER_BASE, &file->case_flags);
+    if (fits && dot) fits = single_case(dot + 1, ext_len, CASE_LOWER_EXT, &file->case_flags);
+
+    if (fits) {
+        copy_short(file->short_name, name, base_len, 8);
+        if (dot) copy_short(file->short_name + 8, dot + 1, ext_len, 3);
+        return;
+    }
+
+    file->case_flags = 0;
+    file->lfn_count = (len + LFN_CHARS - 1) / LFN_CHARS;
+
+    // Numbered tail keeps the short names unique
+    char tail[5];
+    snprintf(tail, sizeof(tail), "~%d", (int)(index + 1));
+    size_t tail_len = strlen(tail);
+    copy_short(file->short_name, name, base_len, 8 - tail_len);
+    for (i = 0; i < 8 - tail_len && file->short_name[i] != ' '; i++) { }
+    memcpy(file->short_name + i, tail, tail_len);
+    if (dot) copy_short(file->short_name + 8, dot + 1, ext_len, 3);
+};
+
+static uint8_t short_checksum(const uint8_t * short_name) {
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < 11; i++) sum = ((sum & 1) << 7) + (sum >> 1) + short_name[i];
+    return sum;
+};
+
+// Flash storage names can't contain some characters FAT allows
+static void storage_name(char * name) {
+    if (name[0] == '.') name[0] = '_';
+    for (size_t i = 0; name[i]; i++) {
+        char c[3] = { 'a', name[i], 0 };
+        if (!valid_filename(c, false)) name[i] = '_';
+    }
+};
+
+static void unpack_short_name(const uint8_t * entry, char * name) {
+    size_t i, j = 0;
+    for (i = 0; i < 8 && entry[i] != ' '; i++) name[j++] = entry[12] & CASE_LOWER_BASE ? lower(entry[i]) : entry[i];
+    if (entry[8] != ' ') {
+        name[j++] = '.';
+        for (i = 8; i < 11 && entry[i] != ' '; i++) name[j++] = entry[12] & CASE_LOWER_EXT ? lower(entry[i]) : entry[i];
+    }
+    name[j] = 0;
+    if (name[0] == 0x05) name[0] = (char)0xE5;
+};
+
+// Layout
+
+static uint16_t clusters(uint32_t size) {
+    return (size + FATVIEW_SECTOR_SIZE - 1) / FATVIEW_SECTOR_SIZE;
+};
+
+static uint16_t end_cluster(const fatview_file_t * file) {
+    return file->cluster + clusters(file->size);
+};
+
+// Finds what owns a cluster, stored files first, then named uploads and unclaimed runs
+static fatview_file_t * find_file(uint16_t cluster) {
+    for (size_t i = 0; i < file_count; i++) {
+        if (files[i].cluster && cluster >= files[i].cluster && cluster < end_cluster(&files[i])) return &files[i];
+    }
+    return NULL;
+};
+
+static pending_t * find_pending(uint16_t cluster) {
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS; i++) {
+        if (pending[i].used && cluster >= pending[i].file.cluster && cluster < end_cluster(&pending[i].file)) return &pending[i];
+    }
+    return NULL;
+};
+
+// With next set, the cluster following the run also matches
+static run_t * find_run(uint16_t cluster, bool next) {
+    uint16_t end;
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS; i++) {
+        if (!runs[i].used || cluster < runs[i].cluster) continue;
+        end = runs[i].cluster + clusters(runs[i].written);
+        if (cluster < end || (next && cluster == end)) return &runs[i];
+    }
+    return NULL;
+};
+
+static const fatview_file_t * find_slot(uint16_t slot) {
+    for (size_t i = 0; i < file_count; i++) {
+        if (slot <= files[i].slot && slot >= files[i].slot - files[i].lfn_count) return &files[i];
+    }
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS; i++) {
+        if (!pending[i].used) continue;
+        if (slot <= pending[i].file.slot && slot >= pending[i].file.slot - pending[i].file.lfn_count) return &pending[i].file;
+    }
+    return NULL;
+};
+
+static uint16_t last_slot() {
+    uint16_t slot = 0;
+    for (size_t i = 0; i < file_count; i++) if (files[i].slot > slot) slot = files[i].slot;
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS; i++) if (pending[i].used && pending[i].file.slot > slot) slot = pending[i].file.slot;
+    return slot;
+};
+
+static uint16_t fat_entry(uint16_t cluster) {
+    if (cluster == 0) return 0xFF8; // Media descriptor
+    if (cluster == 1) return FAT_END;
+    if (cluster >= FATVIEW_CLUSTERS + 2) return FAT_BAD;
+
+    const fatview_file_t * file = find_file(cluster);
+    const pending_t * entry;
+    const run_t * run;
+    uint16_t end;
+    if (file) {
+        end = end_cluster(file);
+    } else if ((entry = find_pending(cluster))) {
+        end = end_cluster(&entry->file);
+    } else if ((run = find_run(cluster, false))) {
+        end = run->cluster + clusters(run->written);
+    } else {
+        return cluster >= bad_cluster ? FAT_BAD : FAT_FREE;
+    }
+    return cluster + 1 < end ? cluster + 1 : FAT_END;
+};
+
+bool fatview_mount() {
+    if (files) return false;
+
+    arena_start = arena_mark();
+    if (!(files = (fatview_file_t *)arena_alloc("drive directory", FATVIEW_FILES * sizeof(fatview_file_t)))) return false;
+    file_count = 0;
+    memset(runs, 0, sizeof(runs));
+    memset(pending, 0, sizeof(pending));
+    memset(&stats, 0, sizeof(fatview_stats_t));
+    streaming = NULL;
+    reading = NULL;
+    last_write = time_us_32();
+
+    // Directory metadata is generated when sectors are read, only the placement is decided here
+    uint16_t slot = 1, cluster = 2; // Slot 0 is the volume label
+    size_t size;
+    fatview_file_t * file;
+    if (list_open("/")) {
+        while (file_count < MAXFILES) {
+            file = &files[file_count];
+            if (!list_next(file->name, &size)) break;
+
+            make_short_name(file, file_count);
+            if (slot + file->lfn_count >= FATVIEW_ROOT_ENTRIES) break;
+            if (cluster + clusters(size) > FATVIEW_CLUSTERS + 2) continue;
+
+            file->slot = slot + file->lfn_count;
+            file->cluster = size ? cluster : 0;
+            file->size = size;
+            slot += file->lfn_count + 1;
+            cluster += clusters(size);
+            file_count++;
+        }
+        list_close();
+    }
+
+    // Clusters past what littlefs could hold are marked bad so the host sees the real free space
+    size = get_storage_free();
+    size = size > FATVIEW_RESERVE ? size - FATVIEW_RESERVE : 0;
+    size = cluster + size / FATVIEW_SECTOR_SIZE;
+    bad_cluster = size < FATVIEW_CLUSTERS + 2 ? size : FATVIEW_CLUSTERS + 2;
+
+    return true;
+};
+
+bool fatview_mounted() {
+    return !!files;
+};
+
+static void run_path(const run_t * run, char * path) {
+    snprintf(path, LFS_NAME_MAX, ".drive-%03X", run->cluster);
+};
+
+static void close_run(run_t * run) {
+    if (streaming != run) return;
+    stream_close();
+    streaming = NULL;
+};
+
+static void free_run(run_t * run) {
+    char path[LFS_NAME_MAX+1];
+    close_run(run);
+    run_path(run, path);
+    delete_file(path);
+    run->used = false;
+};
+
+static void add_file(const fatview_file_t * file) {
+    // A file with the same name was replaced
+    if (reading) {
+        reader_close();
+        reading = NULL;
+    }
+    for (size_t i = 0; i < file_count; i++) {
+        if (strcmp(files[i].name, file->name)) continue;
+        memmove(&files[i], &files[i + 1], (--file_count - i) * sizeof(fatview_file_t));
+        break;
+    }
+    if (file_count < FATVIEW_FILES) files[file_count++] = *file;
+    stats.files_added++;
+};
+
+// Copies a file out of a run holding several, the stream handle is taken for the copy
+static bool copy_file(const run_t * run, const fatview_file_t * file) {
+    char path[LFS_NAME_MAX+1];
+    run_path(run, path);
+    if (!reader_open(path)) return false;
+    reading = NULL;
+
+    bool result = stream_open(file->name);
+    uint32_t offset = (file->cluster - run->cluster) * FATVIEW_SECTOR_SIZE, size;
+    for (uint32_t i = 0; result && i < file->size; i += size) {
+        size = file->size - i < FATVIEW_SECTOR_SIZE ? file->size - i : FATVIEW_SECTOR_SIZE;
+        result = reader_read(copy_buffer, size, offset + i) == size && stream_write(copy_buffer, size);
+    }
+    reader_close();
+    return stream_close() && result;
+};
+
+// Moves a named upload whose data has all arrived into place as a regular file
+static bool finish_file(pending_t * entry, run_t * run) {
+    char path[LFS_NAME_MAX+1];
+    bool whole = entry->file.cluster == run->cluster;
+    for (uint8_t i = 0; whole && i < FATVIEW_UPLOADS; i++) {
+        if (pending[i].used && &pending[i] != entry && pending[i].file.cluster >= run->cluster && pending[i].file.cluster < run->cluster + clusters(run->written)) whole = false;
+    }
+
+    bool result;
+    if (whole) {
+        // Only file in the run, the hidden file becomes it
+        close_run(run);
+        run_path(run, path);
+        result = truncate_file(path, entry->file.size) && rename_file(path, entry->file.name);
+        if (result) run->used = false;
+    } else {
+        if (streaming) close_run(streaming);
+        result = copy_file(run, &entry->file);
+    }
+
+    if (result) add_file(&entry->file);
+    entry->used = false;
+    return result;
+};
+
+void fatview_settle(bool force) {
+    if (!files) return;
+    if (!force && time_us_32() - last_write < FATVIEW_SETTLE_MS * 1000) return;
+
+    run_t * run;
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS; i++) {
+        if (!pending[i].used) continue;
+        run = find_run(pending[i].file.cluster, false);
+        if (!run || end_cluster(&pending[i].file) > run->cluster + clusters(run->written)) continue;
+        if (!finish_file(&pending[i], run)) stats.uploads_failed++;
+    }
+
+    // Runs are done with once every cluster belongs to a file
+    uint16_t cluster, end;
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS; i++) {
+        if (!runs[i].used) continue;
+        end = runs[i].cluster + clusters(runs[i].written);
+        for (cluster = runs[i].cluster; cluster < end && find_file(cluster); cluster++) { }
+        if (cluster == end) free_run(&runs[i]);
+    }
+};
+
+void fatview_unmount() {
+    if (!files) return;
+    fatview_settle(true);
+
+    // Whatever is left never got a directory entry or all of its data
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS; i++) {
+        if (pending[i].used) stats.uploads_failed++;
+        pending[i].used = false;
+        if (runs[i].used) free_run(&runs[i]);
+    }
+
+    reader_close();
+    reading = NULL;
+    files = NULL;
+    arena_release(arena_start);
+};
+
+// Reads
+
+static void read_boot(uint8_t * sector) {
+    static const uint8_t boot[] = {
+        0xEB, 0x3C, 0x90, // Jump
+        'M', 'S', 'W', 'I', 'N', '4', '.', '1',
+        FATVIEW_SECTOR_SIZE & 0xFF, FATVIEW_SECTOR_SIZE >> 8,
+        1, // Sectors per cluster
+        FATVIEW_FAT_LBA, 0, // Reserved sectors
+        2, // FATs
+        FATVIEW_ROOT_ENTRIES & 0xFF, FATVIEW_ROOT_ENTRIES >> 8,
+        FATVIEW_SECTORS & 0xFF, FATVIEW_SECTORS >> 8,
+        0xF8, // Fixed media
+        FATVIEW_FAT_SECTORS & 0xFF, FATVIEW_FAT_SECTORS >> 8,
+        1, 0, // Sectors per track
+        1, 0, // Heads
+        0, 0, 0, 0, // Hidden sectors
+        0, 0, 0, 0, // Large sector count
+        0x80, 0, 0x29, // Drive number, extended boot signature
+        0x50, 0x50, 0x52, 0x4F, // Serial number
+    };
+    memcpy(sector, boot, sizeof(boot));
+    memcpy(sector + 43, VOLUME_LABEL, 11);
+    memcpy(sector + 54, "FAT12   ", 8);
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+};
+
+static void read_fat(uint32_t index, uint8_t * sector) {
+    uint32_t offset = index * FATVIEW_SECTOR_SIZE;
+    uint16_t cluster;
+    for (uint16_t i = 0; i < FATVIEW_SECTOR_SIZE; i++, offset++) {
+        // Two 12-bit entries share three bytes
+        cluster = offset / 3 * 2;
+        switch (offset % 3) {
+            case 0:
+                sector[i] = fat_entry(cluster) & 0xFF;
+                break;
+            case 1:
+                sector[i] = (fat_entry(cluster) >> 8) | ((fat_entry(cluster + 1) & 0x0F) << 4);
+                break;
+            case 2:
+                sector[i] = fat_entry(cluster + 1) >> 4;
+                break;
+        }
+    }
+};
+
+static void write_word(uint8_t * data, uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+};
+
+static void write_long(uint8_t * data, uint32_t value) {
+    write_word(data, value & 0xFFFF);
+    write_word(data + 2, value >> 16);
+};
+
+// Long name characters are spread over three runs of the entry
+static const uint8_t lfn_offsets[LFN_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+static void read_entry(uint16_t slot, uint8_t * entry) {
+    if (slot == 0) {
+        memcpy(entry, VOLUME_LABEL, 11);
+        entry[11] = ATTR_VOLUME_ID;
+        write_word(entry + 24, FAT_DATE);
+        return;
+    }
+
+    const fatview_file_t * file = find_slot(slot);
+    if (!file) {
+        // Gaps left by long names the host wrote are shown as deleted, the directory ends after the last file
+        if (slot < last_slot()) entry[0] = 0xE5;
+        return;
+    }
+
+    if (slot == file->slot) {
+        memcpy(entry, file->short_name, 11);
+        entry[11] = ATTR_ARCHIVE;
+        entry[12] = file->case_flags;
+        write_word(entry + 16, FAT_DATE);
+        write_word(entry + 18, FAT_DATE);
+        write_word(entry + 24, FAT_DATE);
+        write_word(entry + 26, file->cluster);
+        write_long(entry + 28, file->size);
+        return;
+    }
+
+    // Long name entries count down to the short entry
+    uint8_t order = file->slot - slot;
+    size_t len = strlen(file->name), index = (order - 1) * LFN_CHARS;
+    entry[0] = order | (order == file->lfn_count ? 0x40 : 0);
+    entry[11] = ATTR_LFN;
+    entry[13] = short_checksum(file->short_name);
+    for (uint8_t i = 0; i < LFN_CHARS; i++, index++) {
+        if (index < len) {
+            write_word(entry + lfn_offsets[i], (uint8_t)file->name[index]);
+        } else if (index > len) {
+            write_word(entry + lfn_offsets[i], 0xFFFF);
+        }
+    }
+};
+
+static bool read_data(uint16_t cluster, uint8_t * sector) {
+    fatview_file_t * file = find_file(cluster);
+    if (!file) return true; // Free space and uploads in progress read as zeros
+
+    if (reading != file) {
+        if (!reader_open(file->name)) {
+            reading = NULL;
+            return false;
+        }
+        reading = file;
+    }
+
+    uint32_t offset = (cluster - file->cluster) * FATVIEW_SECTOR_SIZE;
+    uint32_t size = file->size - offset < FATVIEW_SECTOR_SIZE ? file->size - offset : FATVIEW_SECTOR_SIZE;
+    return reader_read(sector, size, offset) == size;
+};
+
+bool fatview_read(uint32_t lba, uint8_t * sector) {
+    if (!files || lba >= FATVIEW_SECTORS) return false;
+    memset(sector, 0, FATVIEW_SECTOR_SIZE);
+    stats.sectors_read++;
+
+    if (lba == 0) {
+        read_boot(sector);
+    } else if (lba < FATVIEW_ROOT_LBA) {
+        read_fat((lba - FATVIEW_FAT_LBA) % FATVIEW_FAT_SECTORS, sector);
+    } else if (lba < FATVIEW_DATA_LBA) {
+        uint16_t slot = (lba - FATVIEW_ROOT_LBA) * ENTRIES_PER_SECTOR;
+        for (uint8_t i = 0; i < ENTRIES_PER_SECTOR; i++) read_entry(slot + i, sector + i * ENTRY_SIZE);
+    } else {
+        return read_data(lba - FATVIEW_DATA_LBA + 2, sector);
+    }
+    return true;
+};
+
+// Writes
+
+static struct {
+    char name[LFS_NAME_MAX+1];
+    uint8_t count;
+    uint8_t checksum;
+    uint16_t slot; // Where the short entry is expected
+} lfn;
+
+static void parse_lfn(uint16_t slot, const uint8_t * entry) {
+    uint8_t order = entry[0] & 0x3F;
+    if (entry[0] & 0x40) {
+        memset(&lfn, 0, sizeof(lfn));
+        lfn.count = order;
+        lfn.checksum = entry[13];
+        lfn.slot = slot + order;
+    }
+    if (!lfn.count || !order || order > lfn.count || slot + order != lfn.slot || entry[13] != lfn.checksum) {
+        lfn.count = 0;
+        return;
+    }
+
+    size_t index = (order - 1) * LFN_CHARS;
+    uint16_t c;
+    for (uint8_t i = 0; i < LFN_CHARS && index < LFS_NAME_MAX; i++, index++) {
+        c = entry[lfn_offsets[i]] | (entry[lfn_offsets[i] + 1] << 8);
+        if (!c || c == 0xFFFF) break;
+        lfn.name[index] = c < 0x80 ? c : '_';
+    }
+};
+
+// New directory entries name uploads, entries for existing files are left alone
+static void parse_entry(uint16_t slot, const uint8_t * entry) {
+    if (!entry[0] || entry[0] == 0xE5) {
+        lfn.count = 0;
+        return;
+    }
+    if (entry[11] == ATTR_LFN) {
+        parse_lfn(slot, entry);
+        return;
+    }
+
+    bool long_name = lfn.count && lfn.slot == slot && lfn.checksum == short_checksum(entry);
+    uint8_t lfn_count = long_name ? lfn.count : 0;
+    lfn.count = 0;
+
+    if (entry[11] & (ATTR_VOLUME_ID | ATTR_DIRECTORY)) return;
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    uint32_t size = entry[28] | (entry[29] << 8) | (entry[30] << 16) | (entry[31] << 24);
+    if (cluster < 2 || !size || find_file(cluster)) return; // Empty files aren't kept
+
+    // Entries are rewritten as the host updates the size
+    pending_t * upload = NULL;
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS && !upload; i++) {
+        if (pending[i].used && pending[i].file.cluster == cluster) upload = &pending[i];
+    }
+    for (uint8_t i = 0; i < FATVIEW_UPLOADS && !upload; i++) {
+        if (!pending[i].used) upload = &pending[i];
+    }
+    if (!upload) return;
+    upload->used = true;
+
+    fatview_file_t * file = &upload->file;
+    file->cluster = cluster;
+    if (long_name) {
+        strcpy(file->name, lfn.name);
+    } else {
+        unpack_short_name(entry, file->name);
+    }
+    storage_name(file->name);
+    memcpy(file->short_name, entry, 11);
+    file->case_flags = entry[12];
+    file->lfn_count = lfn_count;
+    file->slot = slot;
+    file->size = size;
+};
+
+// Data has to arrive in order, each run is appended to as its next cluster is written
+static bool write_data(uint16_t cluster, const uint8_t * sector) {
+    if (find_file(cluster)) {
+        stats.writes_rejected++;
+        return false;
+    }
+
+    run_t * run = find_run(cluster, true);
+    if (run && cluster < run->cluster + clusters(run->written)) return true; // Rewrites of data already stored
+    if (!run) {
+        // Out of order within a file the host already described
+        const pending_t * entry = find_pending(cluster);
+        if (entry && cluster != entry->file.cluster) return false;
+
+        for (uint8_t i = 0; i < FATVIEW_UPLOADS && !run; i++) {
+            if (!runs[i].used) run = &runs[i];
+        }
+        if (!run) return false;
+        run->used = true;
+        run->cluster = cluster;
+        run->written = 0;
+    }
+
+    char path[LFS_NAME_MAX+1];
+    run_path(run, path);
+    bool result;
+    if (streaming == run) {
+        result = stream_write(sector, FATVIEW_SECTOR_SIZE);
+    } else if (!run->written) {
+        if (streaming) close_run(streaming);
+        if ((result = stream_open(path))) {
+            streaming = run;
+            result = stream_write(sector, FATVIEW_SECTOR_SIZE);
+        }
+    } else {
+        result = append_file(path, sector, FATVIEW_SECTOR_SIZE);
+    }
+
+    if (result) {
+        run->written += FATVIEW_SECTOR_SIZE;
+    } else if (!run->written) {
+        run->used = false;
+    }
+    return result;
+};
+
+bool fatview_write(uint32_t lba, const uint8_t * sector) {
+    if (!files || lba >= FATVIEW_SECTORS) return false;
+    stats.sectors_written++;
+    last_write = time_us_32();
+
+    if (lba < FATVIEW_ROOT_LBA) {
+        // The boot sector and FATs follow from the directory, they are regenerated on every read
+        return true;
+    } else if (lba < FATVIEW_DATA_LBA) {
+        uint16_t slot = (lba - FATVIEW_ROOT_LBA) * ENTRIES_PER_SECTOR;
+        for (uint8_t i = 0; i < ENTRIES_PER_SECTOR; i++) parse_entry(slot + i, sector + i * ENTRY_SIZE);
+        return true;
+    }
+    return write_data(lba - FATVIEW_DATA_LBA + 2, sector);
+};
+
+const fatview_stats_t * get_fatview_stats() {
+    return &stats;
+};
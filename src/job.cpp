@@ -0,0 +1,89 @@
+#include "job.hpp"
+
+#include <stdio.h>
+
+static struct {
+    const char * name;
+    job_progress_t progress;
+    bool active;
+    bool cancelled;
+} job = { 0 };
+
+static idle_task_t idle_tasks[JOB_IDLE_TASKS];
+static bool idle_suspended = false;
+
+void job_begin(const char * name, job_progress_t progress) {
+    job.name = name;
+    job.progress = progress;
+    job.active = true;
+    job.cancelled = false;
+    printf("%s (%c to pause, %c to cancel)... ", name, JOB_KEY_PAUSE, JOB_KEY_CANCEL);
+};
+void job_begin(const char * name) {
+    job_begin(name, NULL);
+};
+
+// Called by long running operations at page boundaries, returns false if the job should stop
+bool job_yield(size_t address) {
+    if (!job.active) return true;
+    if (job.cancelled) return false;
+
+    int c = getchar_timeout_us(0);
+    if (c == JOB_KEY_PAUSE) {
+        printf("\r\n%s paused at 0x%04X, press %c to continue or %c to cancel... ", job.name, address, JOB_KEY_PAUSE, JOB_KEY_CANCEL);
+        do {
+            c = getchar_timeout_us(JOB_POLL_US);
+        } while (c != JOB_KEY_PAUSE && c != JOB_KEY_CANCEL);
+        if (c == JOB_KEY_PAUSE) printf("continuing\r\n");
+    }
+    if (c == JOB_KEY_CANCEL) {
+        printf("\r\n%s cancelled at 0x%04X", job.name, address);
+        job.cancelled = true;
+        return false;
+    }
+
+    if (job.progress && !job.progress(address)) return false;
+    return true;
+};
+
+void job_end() {
+    job.active = false;
+    job.progress = NULL;
+};
+
+bool job_active() {
+    return job.active;
+};
+
+bool job_cancelled() {
+    return job.cancelled;
+};
+
+// Idle tasks
+
+bool add_idle_task(idle_task_t task) {
+    for (uint8_t i = 0; i < JOB_IDLE_TASKS; i++) {
+        if (idle_tasks[i]) continue;
+        idle_tasks[i] = task;
+        return true;
+    }
+    return false;
+};
+
+void suspend_idle_tasks(bool suspend) {
+    idle_suspended = suspend;
+};
+
+void job_idle() {
+    if (job.active || idle_suspended) return;
+    for (uint8_t i = 0; i < JOB_IDLE_TASKS; i++) {
+        if (idle_tasks[i]) idle_tasks[i]();
+    }
+};
+
+// Waits for a key without blocking idle tasks
+int job_getchar() {
+    int c;
+    while ((c = getchar_timeout_us(JOB_POLL_US)) == PICO_ERROR_TIMEOUT) job_idle();
+    return c;
+};
@@ -0,0 +1,192 @@
+#include "layout.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "storage.hpp"
+
+// Manifest format, one directive per line (# starts a comment):
+//   size <bytes>
+//   fill <value>
+//   file <name> <offset> [length] [skip=<bytes>] [lane=<lane>/<lanes>] [mask=<address mask>]
+// Later segments take priority where they overlap and numbers may be decimal or 0x prefixed.
+
+static layout_segment_t segments[LAYOUT_SEGMENTS];
+static size_t segment_count = 0;
+static size_t image_size = 0;
+static uint8_t fill = 0xFF;
+
+// Each segment streams through its own open file and cache, so interleaved lanes don't evict each other
+typedef struct {
+    file_reader_t reader;
+    size_t offset;
+    size_t size;
+    uint8_t data[LAYOUT_CACHE_SIZE];
+} layout_cache_t;
+
+static layout_cache_t caches[LAYOUT_SEGMENTS];
+
+// First source which couldn't be read, sticky until the layout is closed
+static const char * error = NULL;
+
+static bool parse_number(const char * text, size_t * value) {
+    char * end;
+    unsigned long result = strtoul(text, &end, 0);
+    if (end == text || *end) return false;
+    *value = (size_t)result;
+    return true;
+};
+
+static bool parse_segment(layout_segment_t * segment, char * tokens[], uint8_t count, size_t max_size) {
+    size_t value;
+    char * slash;
+    if (count < 3 || !valid_filename(tokens[1], false)) return false;
+
+    memset(segment, 0, sizeof(layout_segment_t));
+    strncpy(segment->name, tokens[1], LFS_NAME_MAX);
+    if (!file_exists(segment->name)) {
+        printf("File \"%s\" not found.\r\n", segment->name);
+        return false;
+    }
+    segment->file_size = get_file_size(segment->name);
+    if (!parse_number(tokens[2], &segment->offset) || segment->offset >= max_size) return false;
+    segment->lanes = 1;
+    segment->mask = ~(size_t)0;
+
+    for (uint8_t i = 3; i < count; i++) {
+        if (!strncmp(tokens[i], "skip=", 5)) {
+            if (!parse_number(tokens[i] + 5, &segment->skip)) return false;
+        } else if (!strncmp(tokens[i], "mask=", 5)) {
+            if (!parse_number(tokens[i] + 5, &segment->mask)) return false;
+        } else if (!strncmp(tokens[i], "lane=", 5)) {
+            if (!(slash = strchr(tokens[i], '/'))) return false;
+            *slash = 0;
+            if (!parse_number(tokens[i] + 5, &value)) return false;
+            segment->lane = value;
+            if (!parse_number(slash + 1, &value) || !value || value > 8 || segment->lane >= value) return false;
+            segment->lanes = value;
+        } else if (i == 3 && parse_number(tokens[i], &value)) {
+            segment->length = value;
+        } else {
+            return false;
+        }
+    }
+
+    // Default to the data available in the source file
+    if (!segment->length) {
+        segment->length = segment->file_size > segment->skip + segment->lane ? (segment->file_size - segment->skip - segment->lane + segment->lanes - 1) / segment->lanes : 0;
+    }
+    if (segment->length > max_size - segment->offset) segment->length = max_size - segment->offset;
+    return true;
+};
+
+size_t layout_load(const char * path, size_t max_size) {
+    static char text[LAYOUT_SEGMENTS * LAYOUT_MAX_LINE];
+    layout_close();
+    segment_count = 0;
+    image_size = 0;
+    fill = 0xFF;
+
+    if (get_file_size(path) > sizeof(text) - 1) {
+        printf("Layout manifest is larger than %d bytes.\r\n", sizeof(text) - 1);
+        return 0;
+    }
+    size_t size = read_file(path, (uint8_t *)text, sizeof(text) - 1);
+    if (!size) return 0;
+    text[size] = 0;
+
+    char * line = text, * next, * tokens[8], * comment;
+    uint8_t count;
+    size_t value, number = 0, end;
+    while (line && *line) {
+        number++;
+        if ((next = strpbrk(line, "\r\n"))) *next++ = 0;
+        if ((comment = strchr(line, '#'))) *comment = 0;
+
+        count = 0;
+        for (char * token = strtok(line, " \t"); token && count < 8; token = strtok(NULL, " \t")) tokens[count++] = token;
+
+        if (!count) {
+            // Empty line
+        } else if (!strcmp(tokens[0], "size") && count == 2 && parse_number(tokens[1], &value) && value && value <= max_size) {
+            image_size = value;
+        } else if (!strcmp(tokens[0], "fill") && count == 2 && parse_number(tokens[1], &value) && value <= 0xFF) {
+            fill = value;
+        } else if (!strcmp(tokens[0], "file") && segment_count < LAYOUT_SEGMENTS && parse_segment(&segments[segment_count], tokens, count, max_size)) {
+            segment_count++;
+        } else {
+            printf("Invalid layout directive on line %d.\r\n", number);
+            return 0;
+        }
+        line = next;
+    }
+
+    // Without an explicit size, cover all of the segments
+    if (!image_size) {
+        for (uint8_t i = 0; i < segment_count; i++) {
+            end = segments[i].offset + segments[i].length;
+            if (end > image_size) image_size = end;
+        }
+    }
+    return segment_count ? image_size : 0;
+};
+
+void layout_print() {
+    printf("Image layout: %d bytes, fill 0x%02X\r\n", image_size, fill);
+    for (uint8_t i = 0; i < segment_count; i++) {
+        printf("\t0x%04X-0x%04X: %s", segments[i].offset, segments[i].offset + segments[i].length - 1, segments[i].name);
+        if (segments[i].skip) printf(" from 0x%04X", segments[i].skip);
+        if (segments[i].lanes > 1) printf(" lane %d/%d", segments[i].lane, segments[i].lanes);
+        if (segments[i].mask != ~(size_t)0) printf(" mask 0x%04X", segments[i].mask);
+        printf("\r\n");
+    }
+};
+
+// Streamed data source, reads source files through a small cache instead of assembling the image
+uint8_t layout_data(size_t address) {
+    int i;
+    size_t position;
+    for (i = segment_count - 1; i >= 0; i--) {
+        if (address >= segments[i].offset && address < segments[i].offset + segments[i].length) break;
+    }
+    if (i < 0) return fill;
+
+    position = segments[i].skip + ((address - segments[i].offset) & segments[i].mask) * segments[i].lanes + segments[i].lane;
+    if (position >= segments[i].file_size || error) return fill;
+
+    layout_cache_t * cache = &caches[i];
+    if (!cache->reader.valid) {
+        cache->size = 0;
+        if (!reader_open(&cache->reader, segments[i].name)) {
+            error = segments[i].name;
+            return fill;
+        }
+    }
+    if (position < cache->offset || position >= cache->offset + cache->size) {
+        cache->offset = position - (position % LAYOUT_CACHE_SIZE);
+        cache->size = reader_read(&cache->reader, cache->data, LAYOUT_CACHE_SIZE, cache->offset);
+        if (position >= cache->offset + cache->size) {
+            // The file was shorter than its size when the layout was loaded
+            cache->size = 0;
+            error = segments[i].name;
+            return fill;
+        }
+    }
+    return cache->data[position - cache->offset];
+};
+
+// Job progress callback, stops the write or verify at the next page once a source has failed
+bool layout_progress(size_t address) {
+    return !error;
+};
+
+const char * layout_error() {
+    return error;
+};
+
+// Source files are opened as they are first streamed and stay open until the layout is closed
+void layout_close() {
+    for (uint8_t i = 0; i < LAYOUT_SEGMENTS; i++) reader_close(&caches[i].reader);
+    error = NULL;
+};
@@ -0,0 +1,116 @@
+#include "pattern.hpp"
+
+#include <string.h>
+
+const char * PatternNames[PATTERN_COUNT] = {
+    "all 0 values",
+    "all 1 values",
+    "random values",
+    "address index",
+    "checkerboard",
+    "inverse checkerboard",
+    "walking ones",
+    "walking zeroes",
+    "address low XOR high",
+    "address high byte"
+};
+
+static pattern_t selected = PATTERN_ZEROES;
+static uint32_t selected_seed = 0;
+
+static uint8_t cache[PATTERN_BLOCK];
+static size_t cache_offset;
+static bool cache_valid = false;
+
+void pattern_select(pattern_t pattern, uint32_t seed) {
+    selected = pattern;
+    selected_seed = seed;
+    cache_valid = false;
+};
+
+pattern_t get_pattern() {
+    return selected;
+};
+
+uint32_t get_pattern_seed() {
+    return selected_seed;
+};
+
+// Derive an independent xorshift state for each block so any block can be regenerated on its own
+static uint32_t block_state(size_t block) {
+    uint32_t x = selected_seed ^ ((uint32_t)block * 0x9E3779B9);
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x ? x : 0x6D2B79F5;
+};
+
+static void fill_block(uint8_t * data, size_t block) {
+    size_t i, address = block * PATTERN_BLOCK;
+    uint32_t x;
+    switch (selected) {
+        case PATTERN_ZEROES:
+            memset(data, 0x00, PATTERN_BLOCK);
+            break;
+        case PATTERN_ONES:
+            memset(data, 0xFF, PATTERN_BLOCK);
+            break;
+        case PATTERN_RANDOM:
+            x = block_state(block);
+            for (i = 0; i < PATTERN_BLOCK; i += 4) {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                data[i] = x;
+                data[i + 1] = x >> 8;
+                data[i + 2] = x >> 16;
+                data[i + 3] = x >> 24;
+            }
+            break;
+        case PATTERN_INDEX:
+            for (i = 0; i < PATTERN_BLOCK; i++) data[i] = (address + i) & 0xFF;
+            break;
+        case PATTERN_CHECKERBOARD:
+        case PATTERN_INVERSE_CHECKERBOARD:
+            for (i = 0; i < PATTERN_BLOCK; i++) data[i] = (((address + i) & 1) ^ (selected == PATTERN_INVERSE_CHECKERBOARD)) ? 0xAA : 0x55;
+            break;
+        case PATTERN_WALKING_ONES:
+            for (i = 0; i < PATTERN_BLOCK; i++) data[i] = 1 << ((address + i) & 7);
+            break;
+        case PATTERN_WALKING_ZEROES:
+            for (i = 0; i < PATTERN_BLOCK; i++) data[i] = ~(1 << ((address + i) & 7));
+            break;
+        case PATTERN_ADDRESS_XOR:
+            for (i = 0; i < PATTERN_BLOCK; i++) data[i] = ((address + i) & 0xFF) ^ ((address + i) >> 8);
+            break;
+        case PATTERN_ADDRESS_HIGH:
+            for (i = 0; i < PATTERN_BLOCK; i++) data[i] = (address + i) >> 8;
+            break;
+        default:
+            break;
+    }
+};
+
+void pattern_fill(uint8_t * data, size_t size, size_t offset) {
+    size_t address = offset, end = offset + size, start, len;
+    while (address < end) {
+        if (!cache_valid || address < cache_offset || address >= cache_offset + PATTERN_BLOCK) {
+            cache_offset = address - (address % PATTERN_BLOCK);
+            fill_block(cache, cache_offset / PATTERN_BLOCK);
+            cache_valid = true;
+        }
+        start = address - cache_offset;
+        len = PATTERN_BLOCK - start;
+        if (len > end - address) len = end - address;
+        memcpy(&data[address - offset], &cache[start], len);
+        address += len;
+    }
+};
+
+uint8_t pattern_data(size_t address) {
+    uint8_t value;
+    pattern_fill(&value, 1, address);
+    return value;
+};
@@ -4,39 +4,95 @@
 #include <tusb.h>
 #include <typeinfo>
 #include <cstdlib>
+#include <new>
 
 #include "pico/binary_info.h"
 #include "pico/stdlib.h"
+#include "pico/rand.h"
 
 #include "xmodem.hpp"
 #include <lfs.h>
 
+#include "arena.hpp"
 #include "config.hpp"
 #include "rom.hpp"
+#include "serial.hpp"
 #include "storage.hpp"
 #include "command.hpp"
+#include "trace.hpp"
+#include "pattern.hpp"
+#include "session.hpp"
+#include "endurance.hpp"
+#include "job.hpp"
+#include "layout.hpp"
+#include "emulator.hpp"
+#include "delta.hpp"
+#include "pipeline.hpp"
+#include "production.hpp"
+#include "console.hpp"
+#include "datalink.hpp"
+#include "drive.hpp"
 
-static uint8_t buffer[MAXSIZE];
+static uint8_t * buffer;
 static char input_buffer[LFS_NAME_MAX+1];
 static size_t image_size;
+static bool image_layout = false;
 static XMODEM xmodem;
-static ROM * rom = NULL;
+static Device * rom = NULL;
+static void * rom_slot;
 static Command * command;
 static char * selected_file;
+static const char * image_source; // Flash storage file the image was read from
 
 // Image Actions
 
 static Command transfer_options[] = {
 	{ 'x', "XMODEM" },
+	{ 'u', "USB data channel" },
 	{ 's', "Flash Storage" },
 	{ 0 }
 };
 
+static Command receive_options[] = {
+	{ 'x', "XMODEM" },
+	{ 'u', "USB data channel" },
+	{ 's', "Flash Storage" },
+	{ 'l', "Layout manifest from Flash Storage" },
+	{ 'd', "XMODEM delta against Flash Storage file" },
+	{ 0 }
+};
+
+static size_t receive_delta() {
+	if ((selected_file = get_file_selection("Select the base file")) == NULL) return 0;
+
+	// The delta is only needed until it has been applied
+	size_t mark = arena_mark();
+	uint8_t * delta_buffer = (uint8_t *)arena_alloc("delta", DELTA_MAX_SIZE);
+	if (!delta_buffer) return 0;
+
+	size_t size = 0;
+	printf("Ready to receive delta against \"%s\". Begin XMODEM transfer... ", selected_file);
+	size_t delta_size = xmodem.receive(delta_buffer, DELTA_MAX_SIZE);
+	sleep_ms(TRANSFER_DELAY);
+	if (delta_size) {
+		printf("\r\nTransfer complete!\r\n");
+		printf("Applying %d byte delta...\r\n", delta_size);
+		size = delta_apply(selected_file, delta_buffer, delta_size, buffer, MAXSIZE);
+		if (size) printf("Reconstructed %d byte image.\r\n", size);
+	} else {
+		printf("\r\nXMODEM transfer failed\r\n");
+	}
+	arena_release(mark);
+	return size;
+}
+
 static bool receive_image() {
-	command = command_prompt(transfer_options, "Select how you would like to transfer the image", true);
+	command = command_prompt(receive_options, "Select how you would like to transfer the image", true);
 	if (!command) return false;
 
 	image_size = 0;
+	image_layout = false;
+	image_source = NULL;
 	switch (command->key) {
 		case 'x':
 			// TODO: quit during timeout?
@@ -49,14 +105,38 @@ static bool receive_image() {
 				printf("\r\nXMODEM transfer failed\r\n");
 			}
 			break;
+		case 'u':
+			printf("Ready to receive image on the USB data channel.\r\n");
+			if ((image_size = datalink_receive(buffer, MAXSIZE))) {
+				printf("\r\nTransfer complete - received %d bytes\r\n", image_size);
+			} else {
+				printf("\r\nData channel transfer failed\r\n");
+			}
+			break;
 		case 's':
 			if ((selected_file = get_file_selection()) != NULL) {
 				printf("Reading \"%s\"...\r\n", selected_file);
 				if (!(image_size = read_file(selected_file, buffer, MAXSIZE))) {
 					printf("Failed to read data from \"%s\".\r\n", selected_file);
+				} else {
+					image_source = selected_file;
 				}
 			}
 			break;
+		case 'l':
+			if ((selected_file = get_file_selection("Select the layout manifest")) != NULL) {
+				printf("Reading layout \"%s\"...\r\n", selected_file);
+				if ((image_size = layout_load(selected_file, get_config().size))) {
+					image_layout = true;
+					layout_print();
+				} else {
+					printf("Failed to load layout from \"%s\".\r\n", selected_file);
+				}
+			}
+			break;
+		case 'd':
+			image_size = receive_delta();
+			break;
 	}
 	printf("\r\n");
 	return !!image_size;
@@ -79,6 +159,15 @@ static bool send_image() {
 				printf("\r\nXMODEM send transfer failed\r\n");
 			}
 			break;
+		case 'u':
+			printf("Ready to send ROM image on the USB data channel.\r\n");
+			if (datalink_send(buffer, image_size)) {
+				result = true;
+				printf("\r\nSend transfer complete - delivered %d bytes\r\n", image_size);
+			} else {
+				printf("\r\nData channel send transfer failed\r\n");
+			}
+			break;
 		case 's':
 			if (get_filename(input_buffer)) {
 				printf("\r\nWriting data to \"%s\"...\r\n", input_buffer);
@@ -95,20 +184,73 @@ static bool send_image() {
 	return result;
 }
 
-static bool verify_buffer() {
-	if (!image_size) return false;
-	printf("Verifying ROM contents... ");
-	size_t error = rom->verify_image(buffer, image_size);
-	printf("\r\n");
+static bool verify_result(size_t error, size_t size, uint32_t start) {
 	if (error > 0) {
-		printf("ROM verification failed: %d incorrect bytes out of %d\r\n", error, image_size);
+		printf("ROM verification failed: %d incorrect bytes out of %d\r\n", error, size);
 	} else {
-		printf("ROM verification succeeded\r\n");
+		printf("ROM verification succeeded in %dms\r\n", (time_us_32() - start) / 1000);
 	}
 	printf("\r\n");
 	return !error;
 }
 
+// A layout source which couldn't be read fails the job instead of passing as fill bytes
+static bool layout_result() {
+	const char * name = layout_error();
+	layout_close();
+	if (!name) return true;
+	printf("\r\nFailed to read \"%s\" from flash storage.\r\n\r\n", name);
+	return false;
+}
+
+static bool verify_buffer() {
+	if (!image_size) return false;
+	job_begin("Verifying ROM contents", image_layout ? layout_progress : NULL);
+	uint32_t start = time_us_32();
+	size_t error = image_layout ? rom->verify_data(layout_data, image_size, 0, true) : rom->verify_image(buffer, image_size);
+	job_end();
+	if (!layout_result()) return false;
+	printf("\r\n");
+	if (error == (size_t)-1) {
+		printf("\r\n");
+		return false;
+	}
+	return verify_result(error, image_size, start);
+}
+
+// Checkpoints follow the verified pages rather than the write position
+static bool session_progress(size_t address) {
+	return session_checkpoint(rom->get_write_stats()->verified);
+}
+
+static Command keep_options[] = {
+	{ 'y', "Keep session to resume later" },
+	{ 'n', "Discard session" },
+	{ 0 }
+};
+
+static void program_buffer(size_t offset, job_progress_t progress) {
+	job_begin("Writing and verifying device", progress);
+	uint32_t start = time_us_32();
+	size_t error = image_layout ? rom->write_verify_data(layout_data, image_size, 0, true) : rom->write_verify_image(buffer + offset, image_size - offset, offset);
+	job_end();
+	if (!layout_result()) return;
+	if (error == (size_t)-1) {
+		// The journal is left in place so that the write can be resumed
+		if (!job_cancelled()) {
+			printf("\r\nFailed to write to device.\r\n\r\n");
+			return;
+		}
+		printf("\r\n\r\n");
+		if (progress == session_progress && command_prompt(keep_options, "Would you like to keep the session")->key != 'y') session_end();
+		return;
+	}
+	if (progress == session_progress) session_end();
+	printf("\r\n");
+	rom->get_write_stats()->print();
+	verify_result(error, image_size - offset, start);
+}
+
 static void write_image() {
 	if (!receive_image()) return;
 
@@ -119,39 +261,125 @@ static void write_image() {
 	}
 	printf("\r\n");
 
-	printf("Writing to device... ");
-	if (!rom->write_image(buffer, image_size)) {
-		printf("\r\nFailed to write to device.\r\n\r\n");
+	// Skip programming when the device already holds the image, most differing devices are rejected by the sample
+	job_begin("Checking device contents", image_layout ? layout_progress : NULL);
+	bool match = image_layout ? rom->check_data(layout_data, image_size, 0, true) : rom->check_image(buffer, image_size);
+	job_end();
+	if (!layout_result()) return;
+	printf("\r\n");
+	if (job_cancelled()) {
+		printf("\r\n");
+		return;
+	}
+	if (match) {
+		rom->get_check_stats()->print();
+		printf("Device already contains this image, nothing to write.\r\n\r\n");
 		return;
 	}
+
+	// Layouts are streamed from flash storage and aren't journaled
+	job_progress_t progress = session_progress;
+	if (image_layout) {
+		progress = layout_progress;
+	} else if (!session_begin(buffer, image_size, rom->get_config(), image_source)) {
+		printf("Unable to save session checkpoint, programming will not be resumable.\r\n\r\n");
+		progress = NULL;
+	}
+
+	program_buffer(0, progress);
+}
+
+// Bus level tools only exist for the parallel engine
+static ROM * parallel_device() {
+	if (get_config().bus == DEVICE_BUS_PARALLEL) return static_cast<ROM *>(rom);
+	printf("Not available for serial devices.\r\n\r\n");
+	return NULL;
+}
+
+// Serial flash can be larger than the image buffer, reads to memory stop at the buffer
+static size_t buffer_size() {
+	return rom->get_size() < MAXSIZE ? rom->get_size() : MAXSIZE;
+}
+
+static Command read_options[] = {
+	{ 'x', "Read to memory, then transfer" },
+	{ 's', "Stream to Flash Storage while reading" },
+	{ 'h', "Read to memory, then hex dump" },
+	{ 0 }
+};
+
+static void read_image_file() {
+	if (!get_filename(input_buffer, true)) return;
 	printf("\r\n");
 
-	verify_buffer();
+	job_begin("Streaming device contents to flash storage");
+	bool result = pipeline_read_file(rom, input_buffer);
+	job_end();
+	printf("\r\n");
+	if (result) {
+		get_pipeline_stats()->print();
+		printf("Saved to \"%s\".\r\n", input_buffer);
+	} else {
+		if (!job_cancelled()) printf("Failed to stream image to flash storage.\r\n");
+		delete_file(input_buffer);
+	}
+	printf("\r\n");
 }
 
 static void read_image() {
-	printf("Reading device contents... ");
-	if (rom->read(buffer)) {
-		image_size = rom->get_size();
-	} else {
+	command = command_prompt(read_options, "Select how you would like to read the device", true);
+	if (!command) return;
+	if (command->key == 's') {
+		read_image_file();
+		return;
+	}
+
+	job_begin("Reading device contents");
+	uint32_t start = time_us_32();
+	bool result = rom->read(buffer, buffer_size());
+	job_end();
+	if (result) {
+		image_size = buffer_size();
+		printf("\r\nRead %d bytes in %dms", image_size, (time_us_32() - start) / 1000);
+	} else if (!job_cancelled()) {
 		printf("\r\nFailed to read image.");
 	}
 	printf("\r\n\r\n");
-	send_image();
+	if (!result) return;
+	if (command->key == 'h') {
+		console_hexdump(buffer, image_size, 0);
+		printf("\r\n");
+	} else {
+		send_image();
+	}
 }
 
-static void read_page() {
-	// TODO: optimize data types
-	int i, j, k, mul, page = 0, len = 0;
+static void read_stable_image() {
+	ROM * parallel = parallel_device();
+	if (!parallel) return;
 
-	image_size = rom->get_page_size();
-	if (image_size <= 0) image_size = 64;
+	job_begin("Reading device contents in fast passes");
+	uint32_t start = time_us_32();
+	bool result = parallel->read_stable(buffer, buffer_size(), 0, true);
+	job_end();
+	if (result) {
+		image_size = buffer_size();
+		printf("\r\nRead %d bytes in %dms\r\n", image_size, (time_us_32() - start) / 1000);
+		parallel->get_read_stats()->print();
+	} else if (!job_cancelled()) {
+		printf("\r\nFailed to read image.");
+	}
+	printf("\r\n");
+	if (result) send_image();
+}
 
-	printf("Provide the number of the page (%d bytes) you would like to view then hit enter (0-%d): ", image_size, rom->get_size() / image_size - 1);
+static int get_number() {
+	// TODO: optimize data types
+	int i, j, k, mul, value = 0, len = 0;
 
 	// Get number value
 	do {
-		input_buffer[len] = getchar();
+		input_buffer[len] = job_getchar();
 		putchar(input_buffer[len]);
 		if (input_buffer[len] == 13) break; // Carriage return
 	} while (len++ < 5);
@@ -164,16 +392,24 @@ static void read_page() {
 		for (k = 0; k < len-i-1; k++) {
 			mul *= 10;
 		}
-		page += j * mul;
+		value += j * mul;
 	}
+	return value;
+}
+
+static void read_page() {
+	int page;
+
+	image_size = rom->get_page_size();
+	if (image_size <= 0) image_size = 64;
+
+	printf("Provide the number of the page (%d bytes) you would like to view then hit enter (0-%d): ", image_size, rom->get_size() / image_size - 1);
+	page = get_number();
 
 	printf("\r\nReading page %d contents... ", page);
 	if (rom->read(buffer, image_size, page * image_size)) {
-		printf("\r\nSuccessfully read %d bytes.\r\n", image_size);
-		for (int i = 0; i < image_size; i++) {
-			if (i % 16 == 0) printf("\r\n");
-			printf("%02X ", buffer[i]);
-		}
+		printf("\r\nSuccessfully read %d bytes.\r\n\r\n", image_size);
+		console_hexdump(buffer, image_size, page * image_size);
 	} else {
 		printf("\r\nFailed to read page.");
 	}
@@ -188,78 +424,264 @@ static void verify_image() {
 // Tools
 
 static void erase() {
-	printf("Not yet implemented.\r\n\r\n");
+	if (!rom->get_config()->sectorSize || rom->get_config()->readonly) {
+		printf("Only sector flash needs erasing.\r\n\r\n");
+		return;
+	}
+	job_begin("Erasing sectors");
+	uint32_t start = time_us_32();
+	bool result = rom->erase();
+	job_end();
+	printf("\r\n");
+	if (!result) {
+		printf(job_cancelled() ? "\r\n" : "Failed to erase device.\r\n\r\n");
+		return;
+	}
+	rom->get_write_stats()->print();
+	printf("Erased in %dms\r\n\r\n", (time_us_32() - start) / 1000);
+}
+
+static void blank_check() {
+	job_begin("Checking for an erased device");
+	uint32_t start = time_us_32();
+	bool blank = rom->check_value(0xFF);
+	job_end();
+	printf("\r\n");
+	if (job_cancelled()) {
+		printf("\r\n");
+		return;
+	}
+	rom->get_check_stats()->print();
+	printf("Device is %s (%dms)\r\n\r\n", blank ? "blank" : "not blank", (time_us_32() - start) / 1000);
+}
+
+static char job_name[64];
+
+static const char * pattern_job_name(const char * action) {
+	int len = snprintf(job_name, sizeof(job_name), "%s %s", action, PatternNames[get_pattern()]);
+	if (get_pattern() == PATTERN_RANDOM && len > 0) snprintf(job_name + len, sizeof(job_name) - len, " (seed 0x%08X)", get_pattern_seed());
+	return job_name;
+}
+
+static uint32_t pattern_seed(pattern_t pattern) {
+	return pattern == PATTERN_RANDOM ? get_rand_32() : 0;
+}
+
+static size_t write_pattern(pattern_t pattern, uint32_t seed, bool print_status) {
+	pattern_select(pattern, seed);
+	return rom->write_verify_data(pattern_data, rom->get_size(), 0, print_status);
 }
 
-static void write_zeroes() {
-	printf("Writing zeroes to device... ");
-	if (!rom->write_value(0x00)) {
-		printf("\r\nFailed to write to device.\r\n\r\n");
+static void run_pattern(pattern_t pattern) {
+	// The seed is drawn once so that the reported seed is the one written
+	uint32_t seed = pattern_seed(pattern);
+	pattern_select(pattern, seed);
+	job_begin(pattern_job_name("Writing"));
+	uint32_t start = time_us_32();
+	size_t error = write_pattern(pattern, seed, true);
+	job_end();
+	if (error == (size_t)-1) {
+		printf(job_cancelled() ? "\r\n\r\n" : "\r\nFailed to write to device.\r\n\r\n");
 		return;
 	}
 	printf("\r\n");
+	verify_result(error, rom->get_size(), start);
+}
+
+static void write_zeroes() { run_pattern(PATTERN_ZEROES); }
+static void write_ones() { run_pattern(PATTERN_ONES); }
+static void write_random() { run_pattern(PATTERN_RANDOM); }
+static void write_index() { run_pattern(PATTERN_INDEX); }
+static void write_checkerboard() { run_pattern(PATTERN_CHECKERBOARD); }
+static void write_inverse_checkerboard() { run_pattern(PATTERN_INVERSE_CHECKERBOARD); }
+static void write_walking_ones() { run_pattern(PATTERN_WALKING_ONES); }
+static void write_walking_zeroes() { run_pattern(PATTERN_WALKING_ZEROES); }
+static void write_address_xor() { run_pattern(PATTERN_ADDRESS_XOR); }
+static void write_address_high() { run_pattern(PATTERN_ADDRESS_HIGH); }
 
-	printf("Verifying ROM contents... ");
-	size_t error = rom->verify_value(0x00);
+static void verify_pattern() {
+	job_begin(pattern_job_name("Verifying"));
+	uint32_t start = time_us_32();
+	size_t error = rom->verify_data(pattern_data, rom->get_size(), 0, true);
+	job_end();
 	printf("\r\n");
-	if (error > 0) {
-		printf("ROM verification failed: %d incorrect bytes out of %d\r\n", error, rom->get_size());
-	} else {
-		printf("ROM verification succeeded\r\n");
+	if (error == (size_t)-1) {
+		printf("\r\n");
+		return;
 	}
+	verify_result(error, rom->get_size(), start);
+}
+
+static void full_chip_test() {
+	size_t error, failed = 0;
+	uint32_t seed, start, elapsed, total = time_us_32();
+	job_begin("Running full chip test");
 	printf("\r\n");
+	for (uint8_t i = 0; i < PATTERN_COUNT; i++) {
+		printf("\t%-24s ", PatternNames[i]);
+		seed = pattern_seed(static_cast<pattern_t>(i));
+		start = time_us_32();
+		error = write_pattern(static_cast<pattern_t>(i), seed, false);
+		elapsed = (time_us_32() - start) / 1000;
+		if (error == (size_t)-1) {
+			job_end();
+			printf(job_cancelled() ? "\r\n\r\n" : "write failed\r\n\r\n");
+			return;
+		}
+		if (error) failed++;
+		printf("%6dms  %s", elapsed, error ? "FAIL" : "pass");
+		if (error) printf(" (%d incorrect bytes)", error);
+		if (i == PATTERN_RANDOM) printf(" (seed 0x%08X)", seed);
+		printf("\r\n");
+	}
+	job_end();
+	printf("\r\nFull chip test %s: %d of %d patterns failed in %dms\r\n\r\n", failed ? "failed" : "passed", failed, PATTERN_COUNT, (time_us_32() - total) / 1000);
 }
 
-static void write_ones() {
-	printf("Writing zeroes to device... ");
-	if (!rom->write_value(0xFF)) {
-		printf("\r\nFailed to write to device.\r\n\r\n");
+static void endurance_test() {
+	ROM * parallel = parallel_device();
+	if (!parallel) return;
+	if (!rom->get_page_size() || rom->get_config()->readonly) {
+		printf("Characterization requires a writable device with paging.\r\n\r\n");
 		return;
 	}
-	printf("\r\n");
+	size_t pages = rom->get_size() / rom->get_page_size();
 
-	printf("Verifying ROM contents... ");
-	size_t error = rom->verify_value(0xFF);
+	printf("Number of program cycles: ");
+	uint32_t cycles = get_number();
+	printf("\r\nFirst page (0-%d): ", pages - 1);
+	size_t first = get_number();
+	printf("\r\nNumber of pages (0 for all remaining): ");
+	size_t count = get_number();
+	printf("\r\n\r\n");
+	if (first >= pages || !cycles) {
+		printf("Invalid range.\r\n\r\n");
+		return;
+	}
+	if (!count || count > pages - first) count = pages - first;
+
+	printf("Characterizing %d pages over %d cycles\r\n", count, cycles);
+	job_begin("Characterizing");
+	bool result = endurance_run(parallel, first, count, cycles);
+	job_end();
+	if (!result) {
+		printf("\r\nUnable to run characterization.\r\n\r\n");
+		return;
+	}
+	printf("\r\n\r\n");
+	get_endurance_stats()->print();
+	print_endurance_histogram();
 	printf("\r\n");
-	if (error > 0) {
-		printf("ROM verification failed: %d incorrect bytes out of %d\r\n", error, rom->get_size());
+
+	image_size = endurance_csv((char *)buffer, MAXSIZE);
+	if (write_file(ENDURANCE_FILE, buffer, image_size)) {
+		printf("Results saved to \"%s\".\r\n\r\n", ENDURANCE_FILE);
 	} else {
-		printf("ROM verification succeeded\r\n");
+		printf("Failed to save results to flash storage.\r\n\r\n");
 	}
-	printf("\r\n");
 }
 
-static void write_random() {
-	printf("Writing random values to device... ");
-	if (!rom->write_random()) printf("\r\nFailed to write to device.");
-	printf("\r\n\r\n");
+static void trace_toggle() {
+	trace_enable(!trace_enabled);
 }
 
-static void write_index() {
-	printf("Writing address index values to device... ");
-	if (!rom->write_index()) {
-		printf("\r\nFailed to write to device.\r\n\r\n");
+static void trace_save() {
+	if (!trace_count()) {
+		printf("No bus activity has been recorded.\r\n\r\n");
 		return;
 	}
-	printf("\r\n");
+	image_size = trace_vcd((char *)buffer, MAXSIZE);
+	printf("Generated VCD file of %d bytes\r\n\r\n", image_size);
+	send_image();
+}
 
-	printf("Verifying ROM contents... ");
-	size_t error = rom->verify_index();
+static Command trace_commands[] = {
+	{ 'e', "Enable/disable recording", trace_toggle },
+	{ 'c', "Clear recording", trace_clear },
+	{ 's', "Save VCD file", trace_save },
+	{ 0 }
+};
+
+static void trace_menu() {
+	while (true) {
+		trace_print();
+		printf("\r\n");
+		command = command_prompt(trace_commands, "Select the bus trace action you would like to take", true);
+		if (!command) break;
+		if (command->action) command->action();
+	}
+}
+
+static void init_rom() {
+	// The driver is rebuilt in place on every settings change
+	if (rom) rom->~Device();
+	if (get_config().bus == DEVICE_BUS_PARALLEL) {
+		rom = new (rom_slot) ROM(get_config());
+	} else {
+		rom = new (rom_slot) SerialDevice(get_config());
+	}
+	rom->set_progress(job_yield);
+}
+
+static Command probe_options[] = {
+	{ 's', "Select matching profile" },
+	{ 'd', "Use detected profile" },
+	{ 0 }
+};
+
+static void probe_device() {
+	ROM * parallel = parallel_device();
+	if (!parallel) return;
+
+	printf("Probing address lines...\r\n");
+	bool result = parallel->probe();
+	const rom_probe_stats_t * stats = parallel->get_probe_stats();
+	// Lines are only sorted once something drives the bus
+	if (!result && !(stats->used | stats->mirrored | stats->uncertain)) {
+		printf("No device is driving the data bus.\r\n\r\n");
+		return;
+	}
+	stats->print();
 	printf("\r\n");
-	if (error > 0) {
-		printf("ROM verification failed: %d incorrect bytes out of %d\r\n", error, rom->get_size());
+	if (!result) return;
+
+	// Dumps with either profile cover only the unique content
+	const char * match = find_config(stats->size, stats->enable_high);
+	if (match) {
+		printf("Matches the \"%s\" profile.\r\n\r\n", match);
 	} else {
-		printf("ROM verification succeeded\r\n");
+		printf("No existing profile matches.\r\n\r\n");
 	}
+	command = command_prompt(match ? probe_options : probe_options + 1, "Select the profile you would like to use", true);
+	if (!command) return;
+	if (command->key == 's') {
+		select_config(match);
+	} else {
+		set_detected_config(stats->size, stats->enable_high);
+	}
+	init_rom();
+	print_config();
 	printf("\r\n");
 }
 
 static Command tools_commands[] = {
 	{ 'e', "Erase", erase },
+	{ 'k', "Blank check", blank_check },
 	{ '0', "write all 0 values", write_zeroes },
 	{ '1', "write all 1 values", write_ones },
 	{ '2', "write random values", write_random },
 	{ '3', "write address index", write_index },
+	{ '4', "write checkerboard", write_checkerboard },
+	{ '5', "write inverse checkerboard", write_inverse_checkerboard },
+	{ '6', "write walking ones", write_walking_ones },
+	{ '7', "write walking zeroes", write_walking_zeroes },
+	{ '8', "write address low XOR high", write_address_xor },
+	{ '9', "write address high byte", write_address_high },
+	{ 'v', "verify last pattern", verify_pattern },
+	{ 'a', "full chip test", full_chip_test },
+	{ 'c', "endurance characterization", endurance_test },
+	{ 'b', "Bus trace", trace_menu },
+	{ 'p', "Probe size and address lines", probe_device },
 	{ 0 }
 };
 
@@ -302,11 +724,6 @@ static void show_settings() {
 	xmodem.print_config();
 }
 
-static void init_rom() {
-	if (rom) delete rom;
-	rom = new ROM(get_config());
-}
-
 static void settings_menu() {
 	while (true) {
 		show_settings();
@@ -319,11 +736,26 @@ static void settings_menu() {
 
 // Filesystem
 
+static Command channel_options[] = {
+	{ 'x', "XMODEM" },
+	{ 'u', "USB data channel" },
+	{ 0 }
+};
+
 static void filesystem_transfer() {
 	if ((selected_file = get_file_selection("Select the file you would like to transfer")) != NULL) {
 		printf("Reading \"%s\"...\r\n", selected_file);
 		if (!(image_size = read_file(selected_file, buffer, MAXSIZE))) {
 			printf("Failed to read data from \"%s\".\r\n", selected_file);
+		} else if (!(command = command_prompt(channel_options, "Select how you would like to receive the file", true))) {
+			return;
+		} else if (command->key == 'u') {
+			printf("Ready to transfer \"%s\" on the USB data channel.\r\n", selected_file);
+			if (datalink_send(buffer, image_size)) {
+				printf("\r\nSend transfer complete - delivered %d bytes\r\n", image_size);
+			} else {
+				printf("\r\nData channel send transfer failed\r\n");
+			}
 		} else {
 			printf("Ready to transfer \"%s\". Begin XMODEM transfer...\r\n", selected_file);
 			if (xmodem.send(buffer, image_size)) {
@@ -338,30 +770,62 @@ static void filesystem_transfer() {
 	printf("\r\n");
 }
 
+static void save_upload() {
+	printf("\r\nWriting data to \"%s\"...\r\n", input_buffer);
+	reset_storage_stats();
+	uint32_t start = time_us_32();
+	if (write_file(input_buffer, buffer, image_size)) {
+		printf("Successfully written data to file in %dms.\r\n", (time_us_32() - start) / 1000);
+		get_storage_stats()->print();
+	} else {
+		printf("Failed to write to flash storage.\r\n");
+	}
+	printf("\r\n");
+}
+
 static void filesystem_upload() {
 	// Get filename (and overwrite if exists)
 	if (!get_filename(input_buffer, true)) return;
 	if (file_exists(input_buffer)) delete_file(input_buffer);
 
-	// Receive XMODEM file
-	printf("\r\nReady to receive image. Begin XMODEM transfer... ");
-	if (image_size = xmodem.receive(buffer, MAXSIZE)) {
-		sleep_ms(TRANSFER_DELAY);
+	printf("\r\n");
+	if (!(command = command_prompt(channel_options, "Select how you would like to send the file", true))) return;
+
+	// Receive file
+	if (command->key == 'u') {
+		printf("Ready to receive image on the USB data channel.\r\n");
+		if (!(image_size = datalink_receive(buffer, MAXSIZE))) {
+			printf("\r\nData channel transfer failed\r\n");
+			return;
+		}
 		printf("\r\nTransfer complete!\r\n");
 	} else {
-		sleep_ms(TRANSFER_DELAY);
-		printf("\r\nXMODEM transfer failed\r\n");
-		return;
+		printf("Ready to receive image. Begin XMODEM transfer... ");
+		if (image_size = xmodem.receive(buffer, MAXSIZE)) {
+			sleep_ms(TRANSFER_DELAY);
+			printf("\r\nTransfer complete!\r\n");
+		} else {
+			sleep_ms(TRANSFER_DELAY);
+			printf("\r\nXMODEM transfer failed\r\n");
+			return;
+		}
 	}
 
 	// Write file to flash
-	printf("\r\nWriting data to \"%s\"...\r\n", input_buffer);
-	if (write_file(input_buffer, buffer, image_size)) {
-		printf("Successfully written data to file.\r\n", input_buffer);
-	} else {
-		printf("Failed to write to flash storage.\r\n");
+	save_upload();
+}
+
+static void filesystem_upload_delta() {
+	image_layout = false;
+	if (!(image_size = receive_delta())) {
+		printf("\r\n");
+		return;
 	}
-	printf("\r\n");
+
+	// The base may be overwritten, it is no longer needed once the delta is applied
+	if (!get_filename(input_buffer, true)) return;
+	if (file_exists(input_buffer)) delete_file(input_buffer);
+	save_upload();
 }
 
 static void filesystem_delete() {
@@ -386,11 +850,43 @@ static void filesystem_reformat() {
 	printf("\r\n");
 };
 
+static void drive_stats() {
+	get_fatview_stats()->print();
+	printf("\r\n");
+}
+
+static Command drive_commands[] = {
+	{ 's', "Show statistics", drive_stats },
+	{ 0 }
+};
+
+static void filesystem_drive() {
+	if (!drive_start()) {
+		printf("Failed to start USB drive.\r\n\r\n");
+		return;
+	}
+	printf("Flash storage is available as a USB drive. Copy images onto it, then eject it before leaving this menu.\r\n\r\n");
+
+	// Flash storage belongs to the USB task until the drive is stopped
+	suspend_idle_tasks(true);
+	while (true) {
+		command = command_prompt(drive_commands, drive_active() ? "USB Drive" : "USB Drive (ejected)", true);
+		if (!command) break;
+		if (command->action) command->action();
+	}
+	drive_stop();
+	suspend_idle_tasks(false);
+
+	drive_stats();
+}
+
 static Command filesystem_commands[] = {
 	{ 't', "Transfer file", filesystem_transfer },
 	{ 'u', "Upload file", filesystem_upload },
+	{ 'x', "Upload delta", filesystem_upload_delta },
 	{ 'd', "Delete file", filesystem_delete },
 	{ 'f', "Reformat file system", filesystem_reformat },
+	{ 'm', "USB drive", filesystem_drive },
 	// TODO: Rename
 	{ 0 }
 };
@@ -408,13 +904,159 @@ static void filesystem_menu() {
 	}
 }
 
+// Sessions
+
+static Command resume_options[] = {
+	{ 'y', "Resume programming" },
+	{ 'n', "Discard session" },
+	{ 0 }
+};
+
+static void resume_session() {
+	session_t session;
+	if (!session_pending(&session)) return;
+
+	printf("\r\nFound an interrupted programming session: %d of %d bytes verified on %s", session.checkpoint, session.size, session.device);
+	if (session.image[0]) printf(" from \"%s\"", session.image);
+	printf("\r\n\r\n");
+	command = command_prompt(resume_options, "Would you like to resume the session");
+	if (command->key != 'y') {
+		session_end();
+		return;
+	}
+
+	// Detected profiles don't survive a restart, they are rebuilt from the journaled geometry
+	if (!strcmp(session.device, "Detected")) {
+		set_detected_config(session.device_size, session.address_mask);
+	} else if (!select_config(session.device)) {
+		printf("Unknown device \"%s\", discarding session.\r\n\r\n", session.device);
+		session_end();
+		return;
+	}
+	if (get_config().size != session.device_size || get_config().addressMask != session.address_mask) {
+		printf("Device \"%s\" no longer matches the session, discarding session.\r\n\r\n", session.device);
+		session_end();
+		return;
+	}
+	init_rom();
+
+	image_layout = false;
+	if (!(image_size = session_load(&session, buffer, MAXSIZE))) {
+		printf("Session image is missing or corrupt, discarding session.\r\n\r\n");
+		session_end();
+		return;
+	}
+
+	// Revalidate the last completed page to make sure the same chip is still inserted
+	size_t offset = session.checkpoint, page = rom->get_page_size() ? rom->get_page_size() : BURST_SIZE;
+	if (offset >= page && rom->verify_image(buffer + offset - page, page, offset - page, false)) {
+		printf("Boundary page doesn't match, restarting from the beginning.\r\n");
+		offset = 0;
+	}
+
+	printf("Resuming at address 0x%04X\r\n\r\n", offset);
+	program_buffer(offset, session_progress);
+}
+
+// Emulation
+
+static bool emulate_receive() {
+	if (!receive_image()) return false;
+	// Layout segments are streamed from storage, the responder needs the whole image in memory
+	if (image_layout) {
+		if (image_size > MAXSIZE) image_size = MAXSIZE;
+		for (size_t i = 0; i < image_size; i++) buffer[i] = layout_data(i);
+		image_layout = false;
+		if (!layout_result()) return false;
+	}
+	return true;
+}
+
+static void emulate_reload() {
+	if (!emulate_receive()) return;
+	emulator_reload(buffer, image_size);
+	printf("Now serving %d byte image.\r\n\r\n", image_size);
+}
+
+static Command emulate_commands[] = {
+	{ 'r', "Reload image", emulate_reload },
+	{ 'b', "Benchmark response", emulator_benchmark },
+	{ 0 }
+};
+
+static void emulate() {
+	if (!parallel_device()) return;
+	printf("Load the image to emulate.\r\n");
+	if (!emulate_receive()) return;
+
+	// Hand the bus over to the responder, the ROM driver would otherwise fight the target
+	rom->~Device();
+	rom = NULL;
+	if (!emulator_start(get_config(), buffer, image_size)) {
+		printf("Failed to start emulation.\r\n\r\n");
+		init_rom();
+		return;
+	}
+	printf("Serving %d byte image on the bus. Power up the target system.\r\n\r\n", image_size);
+
+	// Background flash erases would stall the responder
+	suspend_idle_tasks(true);
+	while (true) {
+		command = command_prompt(emulate_commands, "Emulating ROM", true);
+		if (!command) break;
+		if (command->action) command->action();
+	}
+
+	printf("Stopped emulation after %d chip select cycles.\r\n\r\n", emulator_cycles());
+	emulator_stop();
+	suspend_idle_tasks(false);
+	init_rom();
+}
+
+// Production
+
+static void run_production(const char * path) {
+	production_job_t job;
+	printf("Loading job \"%s\"...\r\n", path);
+	if (!production_load(path, &job)) {
+		printf("Failed to load job from \"%s\".\r\n\r\n", path);
+		return;
+	}
+	job.print();
+	printf("\r\n");
+
+	if (!select_config(job.profile)) {
+		printf("Unknown device \"%s\".\r\n\r\n", job.profile);
+		return;
+	}
+	init_rom();
+
+	image_layout = false;
+	if (!(image_size = read_file(job.image, buffer, MAXSIZE))) {
+		printf("Failed to read data from \"%s\".\r\n\r\n", job.image);
+		return;
+	}
+
+	production_run(rom, &job, buffer, image_size);
+	get_production_stats()->print();
+	printf("Results logged to \"%s\".\r\n\r\n", PRODUCTION_LOG_FILE);
+}
+
+static void production_job() {
+	if ((selected_file = get_file_selection("Select the job script")) == NULL) return;
+	run_production(selected_file);
+}
+
 // Main Menu
 
 static Command menu_commands[] = {
 	{ 'w', "Write image", write_image },
 	{ 'r', "Read image", read_image },
+	{ 'd', "Stable dump", read_stable_image },
 	{ 'p', "Read page", read_page },
 	{ 'v', "Verify image", verify_image },
+	{ 'e', "Emulate ROM", emulate },
+	{ 'j', "Production job", production_job },
 	{ 't', "Tools", tools_menu },
 	{ 's', "Settings", settings_menu },
 	{ 'f', "Manage files", filesystem_menu },
@@ -423,13 +1065,24 @@ static Command menu_commands[] = {
 
 int main() {
 	bi_decl(bi_program_description("PicoPROM - ROM programming tool"));
+	console_init();
 
+	buffer = (uint8_t *)arena_alloc("image buffer", MAXSIZE);
+	rom_slot = arena_alloc("device driver", sizeof(ROM) > sizeof(SerialDevice) ? sizeof(ROM) : sizeof(SerialDevice));
 	init_rom();
 	init_filesystem();
 
 	while (true) {
 
-		while (!tud_cdc_connected()) sleep_ms(100);
+		// Without a host, run the stored production job once power has settled
+		uint32_t waiting = time_us_32();
+		while (!tud_cdc_connected()) {
+			if (waiting && time_us_32() - waiting > PRODUCTION_AUTOSTART_MS * 1000) {
+				waiting = 0;
+				if (file_exists(PRODUCTION_FILE)) run_production(PRODUCTION_FILE);
+			}
+			sleep_ms(100);
+		}
 		printf("\r\n\r\nUSB Serial connected\r\n\r\n");
 
 		// Print banner
@@ -437,10 +1090,15 @@ int main() {
 		printf("                 by Cooper Dalrymple, April 2024 & George Foot, February 2021\r\n");
 		printf("                 https://github.com/dcooperdalrymple/picoprom\r\n");
 
+		printf("\r\n");
+		arena_print();
+
 		// Print current settings
 		printf("\r\n");
 		show_settings();
 
+		resume_session();
+
 		while (true) {
 			command = command_prompt(menu_commands, "Main Menu");
 			if (command && command->action) command->action();
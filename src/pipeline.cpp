@@ -0,0 +1,117 @@
+#include "pipeline.hpp"
+
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+
+#include "arena.hpp"
+#include "job.hpp"
+#include "storage.hpp"
+
+static uint8_t (*ring)[PIPELINE_CHUNK_SIZE];
+
+// Chunk counters, head is only written by the reader and tail only by the writer
+static volatile size_t head, tail;
+static volatile bool reader_stop, reader_failed;
+
+static Device * reader_rom;
+static size_t reader_size;
+static pipeline_stats_t stats;
+
+static void reader_loop() {
+    multicore_lockout_victim_init();
+
+    size_t chunks = (reader_size + PIPELINE_CHUNK_SIZE - 1) / PIPELINE_CHUNK_SIZE, offset, length;
+    uint32_t start;
+    for (size_t chunk = 0; chunk < chunks && !reader_stop; chunk++) {
+        if (chunk - tail >= PIPELINE_CHUNKS) {
+            stats.reader_stalls++;
+            while (chunk - tail >= PIPELINE_CHUNKS && !reader_stop) tight_loop_contents();
+            if (reader_stop) break;
+        }
+
+        offset = chunk * PIPELINE_CHUNK_SIZE;
+        length = reader_size - offset < PIPELINE_CHUNK_SIZE ? reader_size - offset : PIPELINE_CHUNK_SIZE;
+        start = time_us_32();
+        if (!reader_rom->read(ring[chunk % PIPELINE_CHUNKS], length, offset, false)) {
+            reader_failed = true;
+            break;
+        }
+        stats.read_us += time_us_32() - start;
+
+        __dmb();
+        head = chunk + 1;
+    }
+
+    // Park until reset, core1 stays a lockout victim while flash writes finish
+    while (true) tight_loop_contents();
+};
+
+bool pipeline_read_file(Device * rom, const char * path) {
+    stats = { 0 };
+    size_t mark = arena_mark();
+    if (!(ring = (uint8_t (*)[PIPELINE_CHUNK_SIZE])arena_alloc("read pipeline", PIPELINE_CHUNKS * PIPELINE_CHUNK_SIZE))) return false;
+    if (!stream_open(path)) {
+        arena_release(mark);
+        return false;
+    }
+
+    reader_rom = rom;
+    reader_size = rom->get_size();
+    head = tail = 0;
+    reader_stop = reader_failed = false;
+
+    // Progress callbacks poll the console, which only core0 may do
+    progress_func_t progress = rom->get_progress();
+    rom->set_progress(NULL);
+
+    uint32_t start = time_us_32(), write_start;
+    size_t chunks = (reader_size + PIPELINE_CHUNK_SIZE - 1) / PIPELINE_CHUNK_SIZE, length;
+    bool result = true;
+
+    multicore_reset_core1();
+    multicore_launch_core1(reader_loop);
+
+    while (tail < chunks) {
+        if (tail == head) {
+            if (reader_failed || !job_yield(tail * PIPELINE_CHUNK_SIZE)) {
+                result = false;
+                break;
+            }
+            stats.writer_stalls++;
+            sleep_us(PAGE_LOAD_TIMEOUT_US);
+            continue;
+        }
+        __dmb();
+
+        length = reader_size - tail * PIPELINE_CHUNK_SIZE < PIPELINE_CHUNK_SIZE ? reader_size - tail * PIPELINE_CHUNK_SIZE : PIPELINE_CHUNK_SIZE;
+        write_start = time_us_32();
+        if (!stream_write(ring[tail % PIPELINE_CHUNKS], length)) {
+            result = false;
+            break;
+        }
+        stats.write_us += time_us_32() - write_start;
+        stats.bytes += length;
+        tail = tail + 1;
+        if (!(stats.bytes & 0x7FF)) printf("%dK ", stats.bytes >> 10);
+
+        if (!job_yield(tail * PIPELINE_CHUNK_SIZE)) {
+            result = false;
+            break;
+        }
+    }
+
+    reader_stop = true;
+    result = stream_close() && result;
+
+    // Reset only after the last flash write so core1 is never stopped mid-lockout
+    multicore_reset_core1();
+    rom->set_progress(progress);
+    arena_release(mark);
+
+    stats.total_us = time_us_32() - start;
+    return result;
+};
+
+const pipeline_stats_t * get_pipeline_stats() {
+    return &stats;
+};
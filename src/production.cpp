@@ -0,0 +1,229 @@
+#include "production.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "digest.hpp"
+#include "pins.hpp"
+#include "storage.hpp"
+
+// Job script format, one directive per line (# starts a comment):
+//   profile <device name>
+//   image <file>
+//   differential          only write pages which differ from the chip
+//   verify                read back each page as it is written
+//   digest [crc32]        check the whole chip against the image digest (and the image against crc32)
+//   count <chips>         stop after a number of chips
+// Numbers may be decimal or 0x prefixed.
+
+typedef enum {
+    LED_WAIT,
+    LED_PASS,
+    LED_FAIL
+} led_state_t;
+
+static production_stats_t stats;
+
+static bool parse_number(const char * text, size_t * value) {
+    char * end;
+    unsigned long result = strtoul(text, &end, 0);
+    if (end == text || *end) return false;
+    *value = (size_t)result;
+    return true;
+};
+
+bool production_load(const char * path, production_job_t * job) {
+    static char text[16 * PRODUCTION_MAX_LINE];
+    size_t size = read_file(path, (uint8_t *)text, sizeof(text) - 1);
+    if (!size) return false;
+    text[size] = 0;
+
+    memset(job, 0, sizeof(production_job_t));
+
+    char * line = text, * next, * tokens[4], * comment;
+    uint8_t count;
+    size_t value, number = 0;
+    while (line && *line) {
+        number++;
+        if ((next = strpbrk(line, "\r\n"))) *next++ = 0;
+        if ((comment = strchr(line, '#'))) *comment = 0;
+        while (*line == ' ' || *line == '\t') line++;
+
+        // Device names may contain spaces
+        if (!strncmp(line, "profile ", 8)) {
+            line += 8;
+            while (*line == ' ' || *line == '\t') line++;
+            for (size = strlen(line); size && (line[size - 1] == ' ' || line[size - 1] == '\t'); size--) line[size - 1] = 0;
+            strncpy(job->profile, line, sizeof(job->profile) - 1);
+            line = next;
+            continue;
+        }
+
+        count = 0;
+        for (char * token = strtok(line, " \t"); token && count < 4; token = strtok(NULL, " \t")) tokens[count++] = token;
+
+        if (!count) {
+            // Empty line
+        } else if (!strcmp(tokens[0], "image") && count == 2 && valid_filename(tokens[1], false)) {
+            strncpy(job->image, tokens[1], LFS_NAME_MAX);
+        } else if (!strcmp(tokens[0], "differential") && count == 1) {
+            job->differential = true;
+        } else if (!strcmp(tokens[0], "verify") && count == 1) {
+            job->verify = true;
+        } else if (!strcmp(tokens[0], "digest") && count <= 2) {
+            job->digest = true;
+            if (count == 2) {
+                if (!parse_number(tokens[1], &value)) return false;
+                job->digest_expected = true;
+                job->expected = value;
+            }
+        } else if (!strcmp(tokens[0], "count") && count == 2 && parse_number(tokens[1], &value)) {
+            job->count = value;
+        } else {
+            printf("Invalid job directive on line %d.\r\n", number);
+            return false;
+        }
+        line = next;
+    }
+
+    if (!job->profile[0] || !job->image[0]) {
+        printf("Job requires a profile and an image.\r\n");
+        return false;
+    }
+    return true;
+};
+
+// Waits for a chip to be inserted or removed, returns false if stopped from the console
+static bool wait_chip(Device * rom, bool present, led_state_t led) {
+    uint8_t matches = 0;
+    uint32_t polls = 0;
+    while (matches < PRODUCTION_DEBOUNCE) {
+        switch (led) {
+            case LED_WAIT:
+                gpio_put(LED_PIN, (polls % 10) == 0);
+                break;
+            case LED_PASS:
+                gpio_put(LED_PIN, true);
+                break;
+            case LED_FAIL:
+                gpio_put(LED_PIN, polls & 1);
+                break;
+        }
+        polls++;
+
+        if (getchar_timeout_us(PRODUCTION_POLL_MS * 1000) == 'q') return false;
+        matches = rom->detect() == present ? matches + 1 : 0;
+    }
+    return true;
+};
+
+static bool check_digest(Device * rom, size_t size, uint32_t digest) {
+    uint8_t data[BURST_SIZE];
+    uint32_t crc = 0;
+    size_t length;
+    for (size_t offset = 0; offset < size; offset += length) {
+        length = size - offset < BURST_SIZE ? size - offset : BURST_SIZE;
+        if (!rom->read(data, length, offset, false)) return false;
+        crc = crc32(data, length, crc);
+    }
+    return crc == digest;
+};
+
+// Stats of the last chip, left empty when a chip didn't need programming
+static rom_write_stats_t chip_stats;
+static bool chip_unchanged;
+
+static bool program_chip(Device * rom, const production_job_t * job, const uint8_t * image, size_t size, uint32_t digest) {
+    size_t error;
+    chip_stats = { 0 };
+
+    // A chip which already holds the image passes as is, the check ends with a full compare
+    chip_unchanged = job->differential && rom->check_image(image, size, 0, false);
+    if (chip_unchanged) {
+        stats.unchanged++;
+        return true;
+    }
+
+    rom->set_differential(job->differential);
+    if (job->verify) {
+        error = rom->write_verify_image(image, size, 0, false);
+    } else {
+        error = rom->write_image(image, size, 0, false) ? 0 : -1;
+    }
+    rom->set_differential(false);
+
+    chip_stats = *rom->get_write_stats();
+    stats.pages += chip_stats.pages;
+    stats.skipped += chip_stats.skipped;
+    stats.retries += chip_stats.retries;
+
+    if (error) return false;
+    return !job->digest || check_digest(rom, size, digest);
+};
+
+static void log_chip(bool pass, uint32_t elapsed) {
+    char line[PRODUCTION_MAX_LINE];
+    if (!file_exists(PRODUCTION_LOG_FILE)) {
+        strcpy(line, "chip,result,time_ms,pages,skipped,retries\n");
+        append_file(PRODUCTION_LOG_FILE, (const uint8_t *)line, strlen(line));
+    }
+    snprintf(line, sizeof(line), "%d,%s,%d,%d,%d,%d\n", stats.chips, chip_unchanged ? "unchanged" : pass ? "pass" : "fail", elapsed / 1000, chip_stats.pages, chip_stats.skipped, chip_stats.retries);
+    append_file(PRODUCTION_LOG_FILE, (const uint8_t *)line, strlen(line));
+};
+
+bool production_run(Device * rom, const production_job_t * job, const uint8_t * image, size_t size) {
+    stats = { 0 };
+    if (size > rom->get_size()) size = rom->get_size();
+
+    uint32_t digest = crc32(image, size);
+    if (job->digest_expected && digest != job->expected) {
+        printf("Image digest 0x%08X doesn't match job digest 0x%08X.\r\n", digest, job->expected);
+        return false;
+    }
+
+    // Progress polling would consume the stop key, chips are written in one go
+    progress_func_t progress = rom->get_progress();
+    rom->set_progress(NULL);
+
+    led_state_t led = LED_WAIT;
+    bool pass;
+    uint32_t start, elapsed;
+    while (!job->count || stats.chips < job->count) {
+        printf("Insert chip %d (q to stop)... ", stats.chips + 1);
+        if (!wait_chip(rom, true, led)) break;
+
+        printf("programming... ");
+        gpio_put(LED_PIN, true);
+        start = time_us_32();
+        pass = program_chip(rom, job, image, size, digest);
+        elapsed = time_us_32() - start;
+
+        stats.chips++;
+        if (pass) {
+            stats.passed++;
+        } else {
+            stats.failed++;
+        }
+        if (!stats.min_us || elapsed < stats.min_us) stats.min_us = elapsed;
+        if (elapsed > stats.max_us) stats.max_us = elapsed;
+        stats.total_us += elapsed;
+        log_chip(pass, elapsed);
+
+        printf("%s in %dms\r\n", chip_unchanged ? "unchanged" : pass ? "pass" : "FAIL", elapsed / 1000);
+        led = pass ? LED_PASS : LED_FAIL;
+
+        printf("Remove chip (q to stop)... ");
+        if (!wait_chip(rom, false, led)) break;
+        printf("removed\r\n");
+        led = LED_WAIT;
+    }
+    printf("\r\n\r\n");
+
+    rom->set_progress(progress);
+    gpio_put(LED_PIN, true);
+    return true;
+};
+
+const production_stats_t * get_production_stats() {
+    return &stats;
+};
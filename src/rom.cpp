@@ -1,33 +1,33 @@
 #include "rom.hpp"
 
-#include "pico/rand.h"
+#include <string.h>
 
-static const uint LED_PIN = 25;
+#include "hardware/sync.h"
 
-static const uint ADDR_MAP[] = { // A0-14
-    12, 11, 10, 9, 8, 7, 6, 5, 28, 27, 22, 26, 4, 2 ,3
-};
+#include "pins.hpp"
+#include "trace.hpp"
 
-static const uint DATA_MAP[] = { // D0-7
-    13, 14, 15, 16, 17, 18, 19, 20
+// Progressively slower pulse delays used to resolve unstable bytes
+static const uint STABLE_DELAYS[] = {
+    1, 2, 5, 10, 20
 };
 
-static const uint CE_PIN = 21;
-static const uint OE_PIN = 0;
-static const uint WE_PIN = 1;
-
-ROM::ROM(rom_config_t config) {
-    this->config = config;
+// One bit per byte read which disagreed between passes
+static uint8_t unstable_map[STABLE_MAX_SIZE / 8];
 
-    gpio_init(LED_PIN);
-	gpio_set_dir(LED_PIN, true);
-	gpio_put(LED_PIN, true);
+ROM::ROM(rom_config_t config) : Device(config) {
+    this->bus_address_valid = false;
+    this->bus_upper_valid = false;
+    this->data_output = false;
+    this->latched = this->config.size > (1 << ADDR_BITS);
+    this->control = !this->config.readonly || this->latched;
+    this->read_stats = { 0 };
+    this->probe_stats = { 0 };
 
     for (uint8_t i = 0; i < sizeof(ADDR_MAP) / sizeof(*ADDR_MAP); i++) {
         gpio_init(ADDR_MAP[i]);
         gpio_set_dir(ADDR_MAP[i], true);
     }
-    this->set_address(this->config.addressMask);
 
     for (uint8_t i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) {
         gpio_init(DATA_MAP[i]);
@@ -38,7 +38,7 @@ ROM::ROM(rom_config_t config) {
 	gpio_set_dir(CE_PIN, true);
 	gpio_put(CE_PIN, !this->config.invertClock);
 
-    if (!this->config.readonly) {
+    if (this->control) {
         gpio_init(OE_PIN);
         gpio_set_dir(OE_PIN, true);
         gpio_put(OE_PIN, true);
@@ -47,12 +47,12 @@ ROM::ROM(rom_config_t config) {
         gpio_set_dir(WE_PIN, true);
         gpio_put(WE_PIN, true);
     }
+
+    // Loading the latch needs the control lines
+    this->set_address(this->config.addressMask);
 };
 
 ROM::~ROM() {
-    gpio_put(LED_PIN, false);
-    gpio_deinit(LED_PIN);
-
     this->set_address(0);
     for (uint8_t i = 0; i < sizeof(ADDR_MAP) / sizeof(*ADDR_MAP); i++) {
         gpio_deinit(ADDR_MAP[i]);
@@ -65,7 +65,7 @@ ROM::~ROM() {
     gpio_put(CE_PIN, false);
     gpio_deinit(CE_PIN);
 
-    if (!this->config.readonly) {
+    if (this->control) {
         gpio_put(OE_PIN, false);
         gpio_deinit(OE_PIN);
 
@@ -74,92 +74,186 @@ ROM::~ROM() {
     }
 };
 
-const rom_config_t * ROM::get_config() const {
-    return &this->config;
+const rom_read_stats_t * ROM::get_read_stats() const {
+    return &this->read_stats;
 };
 
-size_t ROM::get_size() const {
-    return this->config.size;
+const rom_probe_stats_t * ROM::get_probe_stats() const {
+    return &this->probe_stats;
 };
 
-size_t ROM::get_page_size() const {
-    return this->config.pageSize;
+bool ROM::detect() {
+    static const size_t probes[] = { 0x0000, 0x0055, 0x00AA, 0x0155, 0x02AA, 0x07FF };
+    size_t addresses[sizeof(probes) / sizeof(*probes)];
+    for (uint8_t i = 0; i < sizeof(probes) / sizeof(*probes); i++) addresses[i] = probes[i] & (this->config.size - 1);
+    return this->driven(addresses, sizeof(addresses) / sizeof(*addresses));
 };
 
-bool ROM::read(uint8_t * data, size_t size, size_t offset, bool print_status) {
-    if (offset > this->config.size) return false;
-    if (!size) size = this->config.size;
-    if (size > this->config.size - offset) size = this->config.size - offset;
+// Enable lines are found from where the chip drives the bus, then each remaining line is toggled against
+// sampled addresses. A line which never changes the data is mirrored, the highest used line gives the size.
+bool ROM::probe() {
+    const uint32_t lines = (1 << ADDR_BITS) - 1;
+    size_t address = 0, mask = this->config.addressMask;
+    uint32_t state = PROBE_SEED, bit, free;
+    uint16_t counts[256] = { 0 };
+    uint16_t evidence, samples;
+    uint8_t i, x, y;
+    bool differs;
+
+    this->probe_stats = { 0 };
+    this->config.addressMask = 0;
+
+    // Find the lines which select the chip, a second active high enable isn't searched for
+    this->probe_stats.reads += 2;
+    if (!this->driven(&address, 1)) {
+        for (i = 0; i < ADDR_BITS && !this->probe_stats.enable_high; i++) {
+            address = 1 << i;
+            if (this->driven(&address, 1)) this->probe_stats.enable_high = address;
+        }
+        this->probe_stats.reads += 2 * i;
+        if (!this->probe_stats.enable_high) {
+            this->config.addressMask = mask;
+            return false;
+        }
+    }
+    for (i = 0; i < ADDR_BITS; i++) {
+        bit = 1 << i;
+        if (bit & this->probe_stats.enable_high) continue;
+        address = this->probe_stats.enable_high | bit;
+        if (!this->driven(&address, 1)) this->probe_stats.enable_low |= bit;
+        this->probe_stats.reads += 2;
+    }
+    free = lines & ~this->probe_stats.enable_high & ~this->probe_stats.enable_low;
 
-    for (size_t address = offset; address < offset + size; address++) {
-        data[address - offset] = this->read_byte(address);
-        this->status(address, print_status);
+    // The most common value is the fill, pairs which both hold it say nothing about a line
+    for (samples = 0; samples < PROBE_SAMPLES; samples++) {
+        counts[this->read_byte((xorshift32(&state) & free) | this->probe_stats.enable_high)]++;
     }
+    this->probe_stats.reads += PROBE_SAMPLES;
+    for (samples = 1; samples < 256; samples++) {
+        if (counts[samples] > counts[this->probe_stats.fill]) this->probe_stats.fill = samples;
+    }
+
+    for (i = 0; i < ADDR_BITS; i++) {
+        bit = 1 << i;
+        if (!(bit & free)) continue;
+        evidence = 0;
+        differs = false;
+        for (samples = 0; samples < PROBE_MAX_SAMPLES && evidence < PROBE_SAMPLES && !differs; samples++) {
+            address = (xorshift32(&state) & free & ~bit) | this->probe_stats.enable_high;
+            x = this->read_byte(address);
+            y = this->read_byte(address | bit);
+            this->probe_stats.reads += 2;
+            differs = x != y;
+            if (x != this->probe_stats.fill) evidence++;
+        }
+        if (differs) {
+            this->probe_stats.used |= bit;
+        } else if (evidence >= PROBE_SAMPLES) {
+            this->probe_stats.mirrored |= bit;
+        } else {
+            this->probe_stats.uncertain |= bit;
+        }
+    }
+
+    this->config.addressMask = mask;
+
+    // Nothing but the fill anywhere can't be sized
+    bit = this->probe_stats.used | this->probe_stats.uncertain;
+    if (!this->probe_stats.used) return false;
+    for (this->probe_stats.size = 1; bit; bit >>= 1) this->probe_stats.size <<= 1;
     return true;
 };
-bool ROM::read(uint8_t * data, size_t size, size_t offset) {
-    return this->read(data, size, offset, true);
-};
-bool ROM::read(uint8_t * data, size_t size) {
-    return this->read(data, size, 0, true);
-};
-bool ROM::read(uint8_t * data) {
-    return this->read(data, this->config.size, 0, true);
-};
 
-const static uint8_t * _data_image;
-uint8_t data_image(size_t address) {
-    return _data_image[address];
-};
+// A driven data bus reads the same with the data line pulls up or down, an empty socket follows the pulls
+bool ROM::driven(const size_t * addresses, uint8_t count) {
+    uint8_t values[DETECT_MAX_ADDRESSES];
+    bool present = true;
+    uint8_t i, j;
+
+    if (count > DETECT_MAX_ADDRESSES) count = DETECT_MAX_ADDRESSES;
+    for (j = 0; j < 2 && present; j++) {
+        for (i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) gpio_set_pulls(DATA_MAP[i], !j, j);
+        sleep_us(DETECT_SETTLE_US);
+        for (i = 0; i < count; i++) {
+            uint8_t value = this->read_byte(addresses[i]);
+            if (!j) {
+                values[i] = value;
+            } else if (values[i] != value) {
+                present = false;
+                break;
+            }
+        }
+    }
 
-static uint8_t _data_value = 0;
-uint8_t data_value(size_t address) {
-    return _data_value;
+    for (i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) gpio_disable_pulls(DATA_MAP[i]);
+    return present;
 };
 
-uint8_t data_random(size_t address) {
-    return (uint8_t)(get_rand_32() & 0xff);
-};
+bool ROM::read_stable(uint8_t * data, size_t size, size_t offset, bool print_status) {
+    if (offset > this->config.size) return false;
+    if (!size) size = this->config.size;
+    if (size > this->config.size - offset) size = this->config.size - offset;
+    if (size > STABLE_MAX_SIZE) return false;
 
-uint8_t data_index(size_t address) {
-    return (uint8_t)(address & 0xff);
-};
+    this->read_stats = { 0 };
+    memset(unstable_map, 0, sizeof(unstable_map));
 
-bool ROM::write_image(const uint8_t * data, size_t size, size_t offset, bool print_status) {
-    _data_image = data;
-    return this->write(data_image, size, offset, print_status);
-};
-bool ROM::write_image(const uint8_t * data, size_t size, size_t offset) {
-    return this->write_image(data, size, offset, true);
-};
-bool ROM::write_image(const uint8_t * data, size_t size) {
-    return this->write_image(data, size, 0, true);
-};
+    // First pass in Gray-code order at the profile timing, but never inside the access time
+    uint pulse_delay = this->config.pulseDelayUs;
+    if (this->config.pulseDelayUs < STABLE_ACCESS_US) this->config.pulseDelayUs = STABLE_ACCESS_US;
+    if (!this->read(data, size, offset, print_status)) {
+        this->config.pulseDelayUs = pulse_delay;
+        return false;
+    }
 
-bool ROM::write_value(uint8_t value, bool print_status) {
-    _data_value = value;
-    return this->write(data_value, this->config.size, 0, print_status);
-};
-bool ROM::write_value(uint8_t value) {
-    return this->write_value(value, true);
-};
+    // Later passes step linearly at the slowest timing, so bytes which depend on the address transition
+    // or need more time to settle disagree with the first pass
+    size_t address, end = offset + size, next, i;
+    uint8_t check[BURST_SIZE];
+    this->config.pulseDelayUs = STABLE_DELAYS[sizeof(STABLE_DELAYS) / sizeof(*STABLE_DELAYS) - 1];
+    for (uint8_t pass = 1; pass < STABLE_PASSES; pass++) {
+        for (address = offset; address < end; address = next) {
+            next = (address / BURST_SIZE + 1) * BURST_SIZE;
+            if (next > end) next = end;
+            this->begin_read();
+            for (i = 0; i < next - address; i++) check[i] = this->read_next(address + i);
+            this->end_read();
+            for (i = 0; i < next - address; i++) {
+                if (check[i] != data[address - offset + i]) unstable_map[(address - offset + i) >> 3] |= 1 << ((address - offset + i) & 7);
+            }
+            if (this->progress && !this->progress(next)) {
+                this->config.pulseDelayUs = pulse_delay;
+                return false;
+            }
+        }
+    }
 
-bool ROM::write_random(bool print_status) {
-    return this->write(data_random, this->config.size, 0, print_status);
-};
-bool ROM::write_random() {
-    return this->write_random(true);
-};
+    // Re-read only the unstable addresses, slowing down until a majority agrees
+    bool majority;
+    uint8_t d;
+    for (address = offset; address < end; address++) {
+        if (!(unstable_map[(address - offset) >> 3] & (1 << ((address - offset) & 7)))) continue;
+        this->read_stats.unstable++;
+        for (d = 0; d < sizeof(STABLE_DELAYS) / sizeof(*STABLE_DELAYS); d++) {
+            this->config.pulseDelayUs = STABLE_DELAYS[d];
+            data[address - offset] = this->read_vote(address, &majority);
+            if (majority) break;
+        }
+        if (!majority) this->read_stats.unresolved++;
+        if (this->config.pulseDelayUs > this->read_stats.slowest_delay_us) this->read_stats.slowest_delay_us = this->config.pulseDelayUs;
+    }
 
-bool ROM::write_index(bool print_status) {
-    return this->write(data_index, this->config.size, 0, print_status);
+    this->config.pulseDelayUs = pulse_delay;
+    return true;
 };
-bool ROM::write_index() {
-    return this->write_index(true);
+bool ROM::read_stable(uint8_t * data) {
+    return this->read_stable(data, this->config.size, 0, true);
 };
 
-bool ROM::write(data_func_t cb, size_t size, size_t offset, bool print_status) {
+bool ROM::write(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status) {
     if (this->config.readonly || size + offset > this->config.size) return false;
+    if (this->config.sectorSize) return this->write_pages(cb, size, offset, verify, print_status);
     if (this->config.writeProtectDisable) {
         this->write_byte(0x5555, 0xAA);
         this->write_byte(0x2AAA, 0x55);
@@ -169,73 +263,113 @@ bool ROM::write(data_func_t cb, size_t size, size_t offset, bool print_status) {
         this->write_byte(0x5555, 0x20);
         if (this->config.pageDelayMs) sleep_ms(this->config.pageDelayMs);
     }
-    for (size_t address = offset; address < offset + size; address++) {
-        if (this->config.pageSize && (address % this->config.pageSize) == 0) {
-            if (this->config.pageDelayMs) sleep_ms(this->config.pageDelayMs);
-            if (this->config.writeProtect) {
-                // Locking prefix
-                this->write_byte(0x5555, 0xAA);
-                this->write_byte(0x2AAA, 0x55);
-                this->write_byte(0x5555, 0xA0);
+    this->write_stats = { 0 };
+    this->write_stats.verified = offset;
+
+    size_t address = offset, end = offset + size, next, i;
+    size_t chunk = this->config.pageSize ? this->config.pageSize : BURST_SIZE;
+    size_t error, attempt;
+    uint8_t data[BURST_SIZE], check[BURST_SIZE];
+    while (address < end) {
+        next = (address / chunk + 1) * chunk;
+        if (next > end) next = end;
+
+        // Stage data ahead of time so that page loads aren't held up by the data source
+        for (i = 0; i < next - address; i++) data[i] = cb(address + i - offset);
+
+        attempt = 0;
+        if (this->differential) {
+            this->read_burst(check, next - address, address);
+            if (!memcmp(check, data, next - address)) {
+                this->write_stats.skipped++;
+                attempt = WRITE_RETRIES + 1;
             }
         }
-        this->write_byte(address, cb(address - offset));
-        this->status(address, print_status);
-    }
-    if (this->config.pageDelayMs) sleep_ms(this->config.pageDelayMs);
-    return true;
-};
 
-size_t ROM::verify_image(uint8_t * data, size_t size, size_t offset, bool print_status) {
-    _data_image = data;
-    return this->verify(data_image, size, offset, print_status);
-};
-size_t ROM::verify_image(uint8_t * data, size_t size, size_t offset) {
-    return this->verify_image(data, size, offset, true);
-};
-size_t ROM::verify_image(uint8_t * data, size_t size) {
-    return this->verify_image(data, size, 0, true);
-};
-
-size_t ROM::verify_value(uint8_t value, bool print_status) {
-    _data_value = value;
-    return this->verify(data_value, this->config.size, 0, print_status);
-};
-size_t ROM::verify_value(uint8_t value) {
-    return this->verify_value(value, true);
-};
+        for (; attempt <= WRITE_RETRIES; attempt++) {
+            if (this->config.pageSize) {
+                this->write_page(data, next - address, address);
+                if (this->config.pageDelayMs) sleep_ms(this->config.pageDelayMs);
+            } else {
+                for (i = 0; i < next - address; i++) {
+                    if ((!attempt && !this->differential) || check[i] != data[i]) this->write_byte(address + i, data[i]);
+                }
+            }
+            if (!verify) break;
 
-size_t ROM::verify_index(bool print_status) {
-    return this->verify(data_index, this->config.size, 0, print_status);
-};
-size_t ROM::verify_index() {
-    return this->verify_index(true);
-};
+            // Read back while the staged page is still at hand
+            this->read_burst(check, next - address, address);
+            error = 0;
+            for (i = 0; i < next - address; i++) {
+                if (check[i] != data[i]) error++;
+            }
+            if (!error) break;
+            if (attempt == WRITE_RETRIES) {
+                this->write_stats.errors += error;
+                break;
+            }
+            this->write_stats.retries++;
+        }
+        if (this->write_stats.verified == address && (attempt > WRITE_RETRIES || (verify && !error))) this->write_stats.verified = next;
 
-size_t ROM::verify(data_func_t cb, size_t size, size_t offset, bool print_status) {
-    if (size + offset > this->config.size) return -1;
-    size_t error = 0;
-    for (size_t address = offset; address < offset + size; address++) {
-        if (this->read_byte(address) != cb(address - offset)) error += 1;
-        this->status(address, print_status);
+        address = next;
+        this->status(address - 1, print_status);
+        if (this->progress && !this->progress(address)) return false;
     }
-    return error;
-};
-
-void ROM::print() {
-    this->config.print();
+    if (!this->config.pageSize && this->config.pageDelayMs) sleep_ms(this->config.pageDelayMs);
+    return true;
 };
 
-void ROM::status(size_t address, bool output) {
-    gpio_put(LED_PIN, (address & 0x100) != 0);
-    if (output && ((address + 1) & 0x7FF) == 0) printf("%dK ", (address + 1) >> 10);
+void ROM::trace() {
+    if (!trace_enabled) return;
+    uint32_t pins = gpio_get_all();
+    uint16_t state = 0;
+    for (uint8_t i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) {
+        if (pins & (1 << DATA_MAP[i])) state |= 1 << (TRACE_DATA_SHIFT + i);
+    }
+    if (pins & (1 << CE_PIN)) state |= TRACE_CE;
+    if (pins & (1 << OE_PIN)) state |= TRACE_OE;
+    if (pins & (1 << WE_PIN)) state |= TRACE_WE;
+    if (this->data_output) state |= TRACE_DATA_OUT;
+    trace_record(this->bus_address, state);
 };
 
 void ROM::set_address(size_t address) {
     address |= this->config.addressMask;
+    // The latch is only reloaded when the upper bits change, sequential access stays within it
+    if (this->latched && (!this->bus_upper_valid || (address >> ADDR_BITS) != this->bus_upper)) this->latch_upper(address >> ADDR_BITS);
+    // Only drive the lines which differ from the last address on the bus
+    size_t changed = this->bus_address_valid ? address ^ this->bus_address : ~(size_t)0;
     for (uint8_t i = 0; i < sizeof(ADDR_MAP) / sizeof(*ADDR_MAP); i++) {
-        gpio_put(ADDR_MAP[i], address & (1 << i));
+        if (changed & (1 << i)) gpio_put(ADDR_MAP[i], address & (1 << i));
     }
+    this->bus_address = address;
+    this->bus_address_valid = true;
+};
+
+// The latch strobe is OE and WE low together, which no read or write cycle does. The device is deselected
+// and the data bus released meanwhile, then the cycle in progress is put back.
+void ROM::latch_upper(uint8_t upper) {
+    bool ce = gpio_get_out_level(CE_PIN), oe = gpio_get_out_level(OE_PIN), we = gpio_get_out_level(WE_PIN), out = this->data_output;
+    gpio_put(CE_PIN, !this->config.invertClock);
+    this->set_data_direction(false);
+    for (uint8_t i = 0; i < LATCH_BITS; i++) gpio_put(ADDR_MAP[i], upper & (1 << i));
+    this->bus_address_valid = false;
+    this->trace();
+
+    gpio_put(OE_PIN, false);
+    gpio_put(WE_PIN, false);
+    this->trace();
+    if (this->config.pulseDelayUs) busy_wait_us(this->config.pulseDelayUs);
+    gpio_put(WE_PIN, true);
+    gpio_put(OE_PIN, oe);
+    gpio_put(WE_PIN, we);
+
+    if (out) this->set_data_direction(true);
+    gpio_put(CE_PIN, ce);
+    this->trace();
+    this->bus_upper = upper;
+    this->bus_upper_valid = true;
 };
 
 void ROM::set_data_direction(bool out) {
@@ -243,6 +377,7 @@ void ROM::set_data_direction(bool out) {
     for (uint8_t i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) {
         gpio_set_dir(DATA_MAP[i], out);
     }
+    this->data_output = out;
 };
 
 void ROM::set_data(uint8_t value) {
@@ -255,9 +390,9 @@ void ROM::set_data(uint8_t value) {
 
 uint8_t ROM::get_data() {
     uint8_t value = 0;
-    if (!this->config.readonly) this->set_data_direction(false);
+    uint32_t pins = gpio_get_all();
     for (uint8_t i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) {
-        if (gpio_get(DATA_MAP[i])) value += 1 << i;
+        if (pins & (1 << DATA_MAP[i])) value += 1 << i;
     }
     return value;
 };
@@ -269,32 +404,181 @@ bool ROM::write_byte(size_t address, uint8_t value) {
     gpio_put(CE_PIN, true);
     this->set_address(address);
     this->set_data(value);
+    this->trace();
     if (this->config.pulseDelayUs) busy_wait_us(this->config.pulseDelayUs);
     gpio_put(CE_PIN, false);
+    this->trace();
     if (this->config.pulseDelayUs) busy_wait_us(this->config.pulseDelayUs);
     gpio_put(CE_PIN, true);
+    this->trace();
     if (this->config.byteDelayUs) busy_wait_us(this->config.byteDelayUs);
     gpio_put(WE_PIN, true);
+    this->trace();
+    return true;
+};
+
+void ROM::write_page(const uint8_t * data, size_t size, size_t offset) {
+    uint32_t last, now, gap = 0;
+
+    // Interrupts would stretch the time between bytes past tBLC and split the page into two write cycles
+    uint32_t ints = save_and_disable_interrupts();
+    if (this->config.writeProtect) {
+        // Locking prefix
+        this->write_byte(0x5555, 0xAA);
+        this->write_byte(0x2AAA, 0x55);
+        this->write_byte(0x5555, 0xA0);
+    }
+    last = time_us_32();
+    for (size_t i = 0; i < size; i++) {
+        this->write_byte(offset + i, data[i]);
+        now = time_us_32();
+        if (now - last > gap) gap = now - last;
+        last = now;
+    }
+    restore_interrupts(ints);
+
+    this->write_stats.pages++;
+    if (gap >= PAGE_LOAD_TIMEOUT_US) this->write_stats.split_pages++;
+    if (gap > this->write_stats.max_gap_us) this->write_stats.max_gap_us = gap;
+    this->write_stats.total_gap_us += gap;
+};
+
+// JEDEC command prefix, the upper address bits are kept so the latch isn't reloaded
+void ROM::command(size_t address, uint8_t code) {
+    size_t base = address & ~(size_t)0x7FFF;
+    this->write_byte(base | 0x5555, 0xAA);
+    this->write_byte(base | 0x2AAA, 0x55);
+    this->write_byte(base | 0x5555, code);
+};
+
+// DQ6 toggles on every read until a program or erase completes
+bool ROM::wait_toggle(size_t address, uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+    uint8_t last = this->read_byte(address), value;
+    do {
+        value = this->read_byte(address);
+        if (!((value ^ last) & 0x40)) return true;
+        last = value;
+    } while (time_us_32() - start < timeout_us);
+    return false;
+};
+
+// Sector flash programs one byte per command, erased bytes are left alone
+bool ROM::program_page(const uint8_t * data, size_t size, size_t offset) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == 0xFF) continue;
+        this->command(offset + i, 0xA0);
+        this->write_byte(offset + i, data[i]);
+        if (!this->wait_toggle(offset + i, WRITE_POLL_TIMEOUT_US)) return false;
+    }
     return true;
 };
 
+bool ROM::erase_sector(size_t offset) {
+    size_t base = offset & ~(size_t)0x7FFF;
+    this->command(offset, 0x80);
+    this->write_byte(base | 0x5555, 0xAA);
+    this->write_byte(base | 0x2AAA, 0x55);
+    this->write_byte(offset, 0x30);
+    return this->wait_toggle(offset, SECTOR_ERASE_TIMEOUT_US);
+};
+
+// Loads a page and measures its write cycle by data polling, returns 0 on timeout
+uint32_t ROM::write_page_timed(const uint8_t * data, size_t size, size_t offset) {
+    if (this->config.readonly || !this->config.pageSize || !size || size > this->config.pageSize) return 0;
+    if (offset + size > this->config.size) return 0;
+
+    this->write_page(data, size, offset);
+
+    // The device returns the complement of D7 on the last loaded byte until the write cycle is complete
+    uint32_t start = time_us_32(), elapsed;
+    size_t address = offset + size - 1;
+    do {
+        elapsed = time_us_32() - start;
+        if (this->read_byte(address) == data[size - 1]) return elapsed ? elapsed : 1;
+    } while (elapsed < WRITE_POLL_TIMEOUT_US);
+    return 0;
+};
+
 uint8_t ROM::read_byte(size_t address) {
     uint8_t value;
-    if (!this->config.readonly) this->set_data_direction(false);
-    gpio_put(CE_PIN, !this->config.invertClock);
-    if (!this->config.readonly) {
-        gpio_put(OE_PIN, true);
+    this->begin_read();
+    value = this->read_next(address);
+    this->end_read();
+    return value;
+};
+
+uint8_t ROM::read_vote(size_t address, bool * majority) {
+    uint8_t samples[STABLE_VOTES], best = 0, i, j, count, best_count = 0;
+    for (i = 0; i < STABLE_VOTES; i++) samples[i] = this->read_byte(address);
+    for (i = 0; i < STABLE_VOTES; i++) {
+        count = 0;
+        for (j = 0; j < STABLE_VOTES; j++) {
+            if (samples[j] == samples[i]) count++;
+        }
+        if (count > best_count) {
+            best = samples[i];
+            best_count = count;
+        }
+    }
+    *majority = best_count > STABLE_VOTES / 2;
+    return best;
+};
+
+void ROM::begin_read() {
+    if (this->control) {
+        this->set_data_direction(false);
         gpio_put(WE_PIN, true);
     }
+    // Hold the device enabled for the whole burst unless it must be strobed per byte
+    gpio_put(CE_PIN, this->config.strobeRead ? !this->config.invertClock : this->config.invertClock);
+    if (this->control) gpio_put(OE_PIN, this->config.strobeRead);
+    this->trace();
+};
+
+uint8_t ROM::read_next(size_t address) {
+    uint8_t value;
     this->set_address(address);
+    this->trace();
     if (this->config.pulseDelayUs) busy_wait_us(this->config.pulseDelayUs);
+    if (!this->config.strobeRead) {
+        value = this->get_data();
+        this->trace();
+        return value;
+    }
+
     gpio_put(CE_PIN, this->config.invertClock);
-    if (!this->config.readonly) gpio_put(OE_PIN, false);
+    if (this->control) gpio_put(OE_PIN, false);
+    this->trace();
     if (this->config.pulseDelayUs) busy_wait_us(this->config.pulseDelayUs);
     value = this->get_data();
+    this->trace();
     gpio_put(CE_PIN, !this->config.invertClock);
-    if (!this->config.readonly) gpio_put(OE_PIN, true);
-    if (this->config.pulseDelayUs) busy_wait_us(this->config.pulseDelayUs);
-    if (!this->config.readonly) this->set_data_direction(true);
+    if (this->control) gpio_put(OE_PIN, true);
+    this->trace();
     return value;
 };
+
+void ROM::end_read() {
+    gpio_put(CE_PIN, !this->config.invertClock);
+    if (this->control) gpio_put(OE_PIN, true);
+    this->trace();
+    if (this->config.pulseDelayUs) busy_wait_us(this->config.pulseDelayUs);
+    if (this->control) this->set_data_direction(true);
+    this->trace();
+};
+
+void ROM::read_burst(uint8_t * data, size_t size, size_t offset) {
+    size_t i, j;
+    this->begin_read();
+    if (BURST_GRAY && size > 1 && !(size & (size - 1)) && !(offset % size)) {
+        // Aligned power-of-two range, reorder the Gray-code sequence on output
+        for (i = 0; i < size; i++) {
+            j = i ^ (i >> 1);
+            data[j] = this->read_next(offset + j);
+        }
+    } else {
+        for (i = 0; i < size; i++) data[i] = this->read_next(offset + i);
+    }
+    this->end_read();
+};
@@ -0,0 +1,203 @@
+#include "serial.hpp"
+
+#include <string.h>
+
+#include "hardware/dma.h"
+
+#include "pins.hpp"
+
+SerialDevice::SerialDevice(rom_config_t config) : Device(config) {
+    if (this->config.bus == DEVICE_BUS_SPI) {
+        spi_init(SERIAL_SPI, this->config.clockKhz * 1000);
+        spi_set_format(SERIAL_SPI, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+        gpio_set_function(SPI_RX_PIN, GPIO_FUNC_SPI);
+        gpio_set_function(SPI_SCK_PIN, GPIO_FUNC_SPI);
+        gpio_set_function(SPI_TX_PIN, GPIO_FUNC_SPI);
+
+        // Chip select is held by software across the command and its DMA payload
+        gpio_init(SPI_CS_PIN);
+        gpio_set_dir(SPI_CS_PIN, true);
+        gpio_put(SPI_CS_PIN, true);
+
+        this->dma_tx = dma_claim_unused_channel(true);
+        this->dma_rx = dma_claim_unused_channel(true);
+    } else {
+        i2c_init(SERIAL_I2C, this->config.clockKhz * 1000);
+        gpio_set_function(I2C_SDA_PIN, GPIO_FUNC_I2C);
+        gpio_set_function(I2C_SCL_PIN, GPIO_FUNC_I2C);
+        gpio_pull_up(I2C_SDA_PIN);
+        gpio_pull_up(I2C_SCL_PIN);
+    }
+};
+
+SerialDevice::~SerialDevice() {
+    if (this->config.bus == DEVICE_BUS_SPI) {
+        dma_channel_unclaim(this->dma_tx);
+        dma_channel_unclaim(this->dma_rx);
+        spi_deinit(SERIAL_SPI);
+        gpio_deinit(SPI_RX_PIN);
+        gpio_deinit(SPI_CS_PIN);
+        gpio_deinit(SPI_SCK_PIN);
+        gpio_deinit(SPI_TX_PIN);
+    } else {
+        i2c_deinit(SERIAL_I2C);
+        gpio_disable_pulls(I2C_SDA_PIN);
+        gpio_disable_pulls(I2C_SCL_PIN);
+        gpio_deinit(I2C_SDA_PIN);
+        gpio_deinit(I2C_SCL_PIN);
+    }
+};
+
+// I2C devices acknowledge their address, an SPI status read is the same with MISO pulled either way
+bool SerialDevice::detect() {
+    uint8_t header[4], status[2];
+    if (this->config.bus == DEVICE_BUS_I2C) {
+        size_t length = this->put_address(header, 0);
+        return i2c_write_blocking(SERIAL_I2C, this->device_address(0), header, length, false) >= 0;
+    }
+
+    for (uint8_t i = 0; i < 2; i++) {
+        gpio_set_pulls(SPI_RX_PIN, !i, i);
+        sleep_us(DETECT_SETTLE_US);
+        status[i] = this->read_status();
+    }
+    gpio_disable_pulls(SPI_RX_PIN);
+    return status[0] == status[1];
+};
+
+// Parts with one address byte for more than 256 bytes (24C04-24C16) take the rest in the device address
+uint8_t SerialDevice::device_address(size_t address) {
+    return SERIAL_I2C_ADDRESS | ((address >> (8 * this->config.addressBytes)) & 0x07);
+};
+
+size_t SerialDevice::put_address(uint8_t * buffer, size_t address) {
+    for (uint8_t i = 0; i < this->config.addressBytes; i++) {
+        buffer[i] = address >> (8 * (this->config.addressBytes - 1 - i));
+    }
+    return this->config.addressBytes;
+};
+
+// Leaves chip select low for the payload, the caller releases it
+void SerialDevice::command(uint8_t code, size_t address, bool with_address) {
+    uint8_t header[6];
+    size_t length = 1;
+    header[0] = code;
+    if (with_address) length += this->put_address(header + 1, address);
+    if (code == SPI_FAST_READ) header[length++] = 0; // Dummy byte
+    gpio_put(SPI_CS_PIN, false);
+    spi_write_blocking(SERIAL_SPI, header, length);
+};
+
+// Both channels run for every transfer, the receive FIFO is drained while writing and clocked out while reading
+void SerialDevice::transfer(const uint8_t * tx, uint8_t * rx, size_t size) {
+    static const uint8_t fill = 0xFF;
+    static uint8_t discard;
+    dma_channel_config channel = dma_channel_get_default_config(this->dma_tx);
+    channel_config_set_transfer_data_size(&channel, DMA_SIZE_8);
+    channel_config_set_dreq(&channel, spi_get_dreq(SERIAL_SPI, true));
+    channel_config_set_read_increment(&channel, tx != NULL);
+    channel_config_set_write_increment(&channel, false);
+    dma_channel_configure(this->dma_tx, &channel, &spi_get_hw(SERIAL_SPI)->dr, tx ? tx : &fill, size, false);
+
+    channel = dma_channel_get_default_config(this->dma_rx);
+    channel_config_set_transfer_data_size(&channel, DMA_SIZE_8);
+    channel_config_set_dreq(&channel, spi_get_dreq(SERIAL_SPI, false));
+    channel_config_set_read_increment(&channel, false);
+    channel_config_set_write_increment(&channel, rx != NULL);
+    dma_channel_configure(this->dma_rx, &channel, rx ? rx : &discard, &spi_get_hw(SERIAL_SPI)->dr, size, false);
+
+    dma_start_channel_mask((1u << this->dma_tx) | (1u << this->dma_rx));
+    dma_channel_wait_for_finish_blocking(this->dma_rx);
+};
+
+uint8_t SerialDevice::read_status() {
+    uint8_t status;
+    this->command(SPI_READ_STATUS, 0, false);
+    spi_read_blocking(SERIAL_SPI, 0xFF, &status, 1);
+    gpio_put(SPI_CS_PIN, true);
+    return status;
+};
+
+void SerialDevice::write_enable() {
+    this->command(SPI_WRITE_ENABLE, 0, false);
+    gpio_put(SPI_CS_PIN, true);
+};
+
+// Write in progress polling
+bool SerialDevice::wait_ready(uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+    do {
+        if (!(this->read_status() & SPI_STATUS_BUSY)) return true;
+    } while (time_us_32() - start < timeout_us);
+    return false;
+};
+
+// The device doesn't acknowledge its address until the write cycle is complete
+bool SerialDevice::wait_ack(size_t address, uint32_t timeout_us) {
+    uint8_t header[4];
+    size_t length = this->put_address(header, address);
+    uint32_t start = time_us_32();
+    do {
+        if (i2c_write_blocking(SERIAL_I2C, this->device_address(address), header, length, false) >= 0) return true;
+    } while (time_us_32() - start < timeout_us);
+    return false;
+};
+
+bool SerialDevice::write(data_func_t cb, size_t size, size_t offset, bool verify, bool print_status) {
+    // Clear the block protect bits so the whole array takes writes
+    if (this->config.bus == DEVICE_BUS_SPI && this->config.writeProtectDisable && !this->config.readonly) {
+        uint8_t status = 0;
+        this->write_enable();
+        this->command(SPI_WRITE_STATUS, 0, false);
+        spi_write_blocking(SERIAL_SPI, &status, 1);
+        gpio_put(SPI_CS_PIN, true);
+        if (!this->wait_ready(WRITE_POLL_TIMEOUT_US)) return false;
+    }
+    return this->write_pages(cb, size, offset, verify, print_status);
+};
+
+uint8_t SerialDevice::read_byte(size_t address) {
+    uint8_t value;
+    this->read_burst(&value, 1, address);
+    return value;
+};
+
+void SerialDevice::read_burst(uint8_t * data, size_t size, size_t offset) {
+    if (this->config.bus == DEVICE_BUS_I2C) {
+        // Random read, the address write is followed by a repeated start
+        uint8_t header[4];
+        size_t length = this->put_address(header, offset);
+        i2c_write_blocking(SERIAL_I2C, this->device_address(offset), header, length, true);
+        i2c_read_blocking(SERIAL_I2C, this->device_address(offset), data, size, false);
+        return;
+    }
+
+    // Flash has the fast read, EEPROMs only the plain read
+    this->command(this->config.sectorSize ? SPI_FAST_READ : SPI_READ, offset, true);
+    this->transfer(NULL, data, size);
+    gpio_put(SPI_CS_PIN, true);
+};
+
+bool SerialDevice::program_page(const uint8_t * data, size_t size, size_t offset) {
+    if (this->config.bus == DEVICE_BUS_I2C) {
+        uint8_t frame[4 + BURST_SIZE];
+        size_t length = this->put_address(frame, offset);
+        memcpy(frame + length, data, size);
+        if (i2c_write_blocking(SERIAL_I2C, this->device_address(offset), frame, length + size, false) < 0) return false;
+        return this->wait_ack(offset, WRITE_POLL_TIMEOUT_US);
+    }
+
+    this->write_enable();
+    this->command(SPI_PAGE_PROGRAM, offset, true);
+    this->transfer(data, NULL, size);
+    gpio_put(SPI_CS_PIN, true);
+    return this->wait_ready(WRITE_POLL_TIMEOUT_US);
+};
+
+bool SerialDevice::erase_sector(size_t offset) {
+    if (this->config.bus != DEVICE_BUS_SPI || !this->config.sectorSize) return false;
+    this->write_enable();
+    this->command(SPI_SECTOR_ERASE, offset, true);
+    gpio_put(SPI_CS_PIN, true);
+    return this->wait_ready(SERIAL_ERASE_TIMEOUT_US);
+};
@@ -0,0 +1,70 @@
+#include "session.hpp"
+
+#include <string.h>
+
+#include "digest.hpp"
+#include "storage.hpp"
+
+static session_t current;
+static bool active = false;
+
+bool session_begin(const uint8_t * data, size_t size, const rom_config_t * config, const char * source) {
+    active = false;
+    memset(&current, 0, sizeof(session_t));
+    current.magic = SESSION_MAGIC;
+    current.digest = crc32(data, size);
+    current.size = size;
+    current.checkpoint = 0;
+    strncpy(current.device, config->name, sizeof(current.device) - 1);
+    current.device_size = config->size;
+    current.address_mask = config->addressMask;
+
+    // Images already in flash storage are journaled by name, anything transferred is copied so that a
+    // resume doesn't depend on the original transfer
+    if (source && get_file_size(source) >= size) {
+        strncpy(current.image, source, LFS_NAME_MAX);
+        if (file_exists(SESSION_IMAGE_FILE)) delete_file(SESSION_IMAGE_FILE);
+    } else if (!write_file(SESSION_IMAGE_FILE, data, size)) {
+        return false;
+    }
+    if (!update_file(SESSION_FILE, (const uint8_t *)&current, sizeof(session_t))) {
+        if (file_exists(SESSION_IMAGE_FILE)) delete_file(SESSION_IMAGE_FILE);
+        return false;
+    }
+    return active = true;
+};
+
+// The address is the end of the pages verified so far, never the last page written
+bool session_checkpoint(size_t address) {
+    if (!active) return true;
+    if (address < current.size && address - current.checkpoint < SESSION_INTERVAL) return true;
+    current.checkpoint = address;
+    update_file(SESSION_FILE, (const uint8_t *)&current, sizeof(session_t));
+    return true; // Don't abort programming if the journal can't be written
+};
+
+void session_end() {
+    active = false;
+    if (file_exists(SESSION_FILE)) delete_file(SESSION_FILE);
+    if (file_exists(SESSION_IMAGE_FILE)) delete_file(SESSION_IMAGE_FILE);
+};
+
+bool session_pending(session_t * session) {
+    if (get_file_size(SESSION_FILE) != sizeof(session_t)) return false;
+    if (read_file(SESSION_FILE, (uint8_t *)session, sizeof(session_t)) != sizeof(session_t)) return false;
+    session->device[sizeof(session->device) - 1] = 0;
+    session->image[LFS_NAME_MAX] = 0;
+    return session->magic == SESSION_MAGIC && session->checkpoint <= session->size;
+};
+
+size_t session_load(const session_t * session, uint8_t * buffer, size_t buffer_size) {
+    if (session->size > buffer_size) return 0;
+    // A source file changed since the session began fails the digest
+    if (read_file(session->image[0] ? session->image : SESSION_IMAGE_FILE, buffer, buffer_size) < session->size) return 0;
+    if (crc32(buffer, session->size) != session->digest) return 0;
+
+    // Continue journaling the resumed session
+    current = *session;
+    active = true;
+    return session->size;
+};
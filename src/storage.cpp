@@ -1,19 +1,91 @@
 #include "storage.hpp"
 
 #include <lfs.h>
+#include <pico/flash.h>
 #include <hardware/flash.h>
 #include <hardware/sync.h>
 
 #include "picoprom.hpp"
+#include "arena.hpp"
+#include "job.hpp"
 
 // littlefs configuration
 
 static lfs_t lfs;
 static lfs_file_t file;
+static struct lfs_file_config file_cfg;
 static lfs_info info;
 static lfs_dir_t dir;
 
-static char files[MAXFILES][LFS_NAME_MAX+1];
+// Open files take their cache from a pool instead of the littlefs heap allocations
+static pool_t file_caches;
+
+static char (*files)[LFS_NAME_MAX+1];
+
+// Flash operations
+
+static storage_stats_t stats;
+
+// Contiguous littlefs programs are coalesced here and written in one flash operation
+static uint8_t pending[FLASH_BATCH_SIZE];
+static uint32_t pending_offset;
+static size_t pending_size = 0;
+
+typedef struct {
+    uint32_t offset;
+    const uint8_t * data;
+    size_t size;
+} flash_op_t;
+
+static void __no_inline_not_in_flash_func(flash_program_op)(void * param) {
+    flash_op_t * op = (flash_op_t *)param;
+    flash_range_program(op->offset, op->data, op->size);
+};
+
+static void __no_inline_not_in_flash_func(flash_erase_op)(void * param) {
+    flash_op_t * op = (flash_op_t *)param;
+    flash_range_erase(op->offset, op->size);
+};
+
+// Runs with interrupts disabled and the other core locked out
+static bool flash_op(void (*func)(void *), flash_op_t * op, flash_op_stats_t * op_stats) {
+    uint32_t start = time_us_32();
+    int err = flash_safe_execute(func, op, FLASH_LOCKOUT_TIMEOUT_MS);
+    uint32_t elapsed = time_us_32() - start;
+    op_stats->count++;
+    op_stats->bytes += op->size;
+    op_stats->total_us += elapsed;
+    if (elapsed > op_stats->max_us) op_stats->max_us = elapsed;
+    return err == PICO_OK;
+};
+
+// Free blocks are erased in the background while idle so that allocations can skip the erase
+#define BLOCK_COUNT (ROOT_SIZE / FLASH_SECTOR_SIZE)
+static uint8_t erased_map[BLOCK_COUNT / 8];
+static uint8_t used_map[BLOCK_COUNT / 8];
+static bool used_valid = false;
+static lfs_block_t idle_block = 0;
+
+static inline bool block_erased(lfs_block_t block) {
+    return erased_map[block >> 3] & (1 << (block & 7));
+};
+
+static inline void set_block_erased(lfs_block_t block, bool erased) {
+    if (erased) {
+        erased_map[block >> 3] |= 1 << (block & 7);
+    } else {
+        erased_map[block >> 3] &= ~(1 << (block & 7));
+    }
+};
+
+static bool flush_pending() {
+    if (!pending_size) return true;
+    flash_op_t op = { pending_offset, pending, pending_size };
+    pending_size = 0;
+    return flash_op(flash_program_op, &op, &stats.program);
+};
+
+// littlefs configuration
 
 static int lfs_pico_read(const struct lfs_config *cfg, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
     uint8_t *ffs_mem  = (uint8_t *) cfg->context;
@@ -26,6 +98,14 @@ static int lfs_pico_read(const struct lfs_config *cfg, lfs_block_t block, lfs_of
 	// read data
 	memcpy (buffer, &ffs_mem[block*cfg->block_size + off], size);
 
+	// overlay data which hasn't been programmed yet
+	uint32_t start = block*cfg->block_size + off, end = start + size;
+	if (pending_size && start < pending_offset + pending_size && end > pending_offset) {
+		uint32_t from = start > pending_offset ? start : pending_offset;
+		uint32_t to = end < pending_offset + pending_size ? end : pending_offset + pending_size;
+		memcpy ((uint8_t *)buffer + (from - start), &pending[from - pending_offset], to - from);
+	}
+
 	return 0;
 };
 
@@ -37,11 +117,24 @@ static int lfs_pico_prog(const struct lfs_config *cfg, lfs_block_t block, lfs_of
 	LFS_ASSERT (size % cfg->prog_size == 0);
 	LFS_ASSERT (block < cfg->block_count);
 
-	// program data
-	uint32_t ints = save_and_disable_interrupts ();
-	flash_range_program (&ffs_mem[block*cfg->block_size + off]
-		-(uint8_t *)XIP_BASE, (const uint8_t *)buffer, size);
-	restore_interrupts (ints);
+	uint32_t offset = &ffs_mem[block*cfg->block_size + off] - (uint8_t *)XIP_BASE;
+
+	// block is no longer blank and the allocation state has changed
+	set_block_erased(block, false);
+	used_valid = false;
+
+	// start a new batch unless this continues the pending one within the same block
+	if (pending_size && (offset != pending_offset + pending_size || pending_size + size > FLASH_BATCH_SIZE
+		|| offset / cfg->block_size != pending_offset / cfg->block_size)) {
+		if (!flush_pending()) return LFS_ERR_IO;
+	}
+	if (size > FLASH_BATCH_SIZE) {
+		flash_op_t op = { offset, (const uint8_t *)buffer, size };
+		return flash_op(flash_program_op, &op, &stats.program) ? 0 : LFS_ERR_IO;
+	}
+	if (!pending_size) pending_offset = offset;
+	memcpy (&pending[pending_size], buffer, size);
+	pending_size += size;
 
 	return 0;
 };
@@ -52,21 +145,80 @@ static int lfs_pico_erase(const struct lfs_config *cfg, lfs_block_t block) {
 	// check if erase is valid
 	LFS_ASSERT (block < cfg->block_count);
 
-	uint32_t ints = save_and_disable_interrupts ();
-	flash_range_erase (&ffs_mem[block*cfg->block_size]
-		-(uint8_t *)XIP_BASE, cfg->block_size);
-	restore_interrupts (ints);
+	uint32_t offset = &ffs_mem[block*cfg->block_size] - (uint8_t *)XIP_BASE;
+	used_valid = false;
 
-	return 0;
+	// pending data within this block would be erased anyway, only the parts of the batch outside it are kept
+	uint32_t end = offset + cfg->block_size, pending_end = pending_offset + pending_size;
+	if (pending_size && pending_offset < end && pending_end > offset) {
+		if (pending_offset < offset) {
+			flash_op_t op = { pending_offset, pending, offset - pending_offset };
+			if (!flash_op(flash_program_op, &op, &stats.program)) return LFS_ERR_IO;
+		}
+		if (pending_end > end) {
+			memmove (pending, &pending[end - pending_offset], pending_end - end);
+			pending_offset = end;
+			pending_size = pending_end - end;
+		} else {
+			pending_size = 0;
+		}
+	}
+	if (!flush_pending()) return LFS_ERR_IO;
+
+	// already erased in the background
+	if (block_erased(block)) {
+		set_block_erased(block, false);
+		stats.erases_skipped++;
+		return 0;
+	}
+
+	flash_op_t op = { offset, NULL, cfg->block_size };
+	return flash_op(flash_erase_op, &op, &stats.erase) ? 0 : LFS_ERR_IO;
 };
 
 static int lfs_pico_sync(const struct lfs_config *cfg) {
-	// sync does nothing because we aren't backed by anything real
-	return 0;
+	return flush_pending() ? 0 : LFS_ERR_IO;
 };
 
 struct lfs_config cfg;
 
+static int mark_used_block(void * data, lfs_block_t block) {
+    if (block < BLOCK_COUNT) used_map[block >> 3] |= 1 << (block & 7);
+    return 0;
+};
+
+static bool block_blank(lfs_block_t block) {
+    const uint32_t * mem = (const uint32_t *)((uint8_t *)cfg.context + block * cfg.block_size);
+    for (size_t i = 0; i < cfg.block_size / sizeof(uint32_t); i++) {
+        if (mem[i] != 0xFFFFFFFF) return false;
+    }
+    return true;
+};
+
+// Idle task, handles at most one block per call so that input stays responsive
+static void storage_idle() {
+    if (!used_valid) {
+        memset(used_map, 0, sizeof(used_map));
+        if (lfs_fs_traverse(&lfs, mark_used_block, NULL) < 0) return;
+        used_valid = true;
+        return;
+    }
+
+    for (lfs_block_t i = 0; i < BLOCK_COUNT; i++) {
+        lfs_block_t block = (idle_block + i) % BLOCK_COUNT;
+        if (block_erased(block) || (used_map[block >> 3] & (1 << (block & 7)))) continue;
+        idle_block = (block + 1) % BLOCK_COUNT;
+
+        if (!block_blank(block)) {
+            flash_op_t op = { (uint32_t)((uint8_t *)cfg.context + block * cfg.block_size - (uint8_t *)XIP_BASE), NULL, cfg.block_size };
+            if (!flash_op(flash_erase_op, &op, &stats.erase)) return;
+            stats.pre_erased++;
+        }
+        set_block_erased(block, true);
+        return;
+    }
+};
+
 void init_filesystem() {
     // Setup configuration
     memset(&cfg, 0, sizeof(struct lfs_config));
@@ -83,11 +235,20 @@ void init_filesystem() {
     cfg.lookahead_size  = 32;
     cfg.block_cycles    = 256;
 
+    // Caches live in the arena rather than the heap
+    cfg.read_buffer      = arena_alloc("littlefs read cache", cfg.cache_size);
+    cfg.prog_buffer      = arena_alloc("littlefs program cache", cfg.cache_size);
+    cfg.lookahead_buffer = arena_alloc("littlefs lookahead", cfg.lookahead_size);
+    pool_init(&file_caches, "littlefs file caches", cfg.cache_size, STORAGE_OPEN_FILES);
+    files = (char (*)[LFS_NAME_MAX+1])arena_alloc("file list", MAXFILES * (LFS_NAME_MAX+1));
+
     if (lfs_mount(&lfs, &cfg)) {
         // Format if first boot
         lfs_format(&lfs, &cfg);
         lfs_mount(&lfs, &cfg);
     }
+
+    add_idle_task(storage_idle);
 };
 
 bool reformat_filesystem() {
@@ -98,6 +259,14 @@ bool reformat_filesystem() {
     return true;
 };
 
+const storage_stats_t * get_storage_stats() {
+    return &stats;
+};
+
+void reset_storage_stats() {
+    memset(&stats, 0, sizeof(storage_stats_t));
+};
+
 // File helpers
 
 static char invalid_chars[] = {
@@ -136,18 +305,58 @@ bool valid_filename(const char * fn) {
 
 // File operations
 
+static int open_file(lfs_file_t * handle, struct lfs_file_config * config, const char * path, int flags) {
+    memset(config, 0, sizeof(struct lfs_file_config));
+    if (!(config->buffer = pool_alloc(&file_caches))) return LFS_ERR_NOMEM;
+    int err = lfs_file_opencfg(&lfs, handle, path, flags, config);
+    if (err < 0) {
+        pool_free(&file_caches, config->buffer);
+        config->buffer = NULL;
+    }
+    return err;
+};
+
+static int close_file(lfs_file_t * handle, struct lfs_file_config * config) {
+    int err = lfs_file_close(&lfs, handle);
+    pool_free(&file_caches, config->buffer);
+    config->buffer = NULL;
+    return err;
+};
+
 bool write_file(const char * path, const uint8_t * buffer, size_t size) {
     if (file_exists(path)) delete_file(path);
-    lfs_file_open(&lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_EXCL);
+    if (open_file(&file, &file_cfg, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_EXCL) < 0) return false;
     lfs_ssize_t write_size = lfs_file_write(&lfs, &file, buffer, size);
-    lfs_file_close(&lfs, &file);
+    close_file(&file, &file_cfg);
     return write_size > 0;
 };
 
+// Replaces the contents atomically, the old contents remain if interrupted
+bool update_file(const char * path, const uint8_t * buffer, size_t size) {
+    if (open_file(&file, &file_cfg, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) < 0) return false;
+    lfs_ssize_t write_size = lfs_file_write(&lfs, &file, buffer, size);
+    return close_file(&file, &file_cfg) >= 0 && write_size == (lfs_ssize_t)size;
+};
+
+bool append_file(const char * path, const uint8_t * buffer, size_t size) {
+    if (open_file(&file, &file_cfg, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND) < 0) return false;
+    lfs_ssize_t write_size = lfs_file_write(&lfs, &file, buffer, size);
+    return close_file(&file, &file_cfg) >= 0 && write_size == (lfs_ssize_t)size;
+};
+
 size_t read_file(const char * path, uint8_t * buffer, size_t buffer_size) {
-    lfs_file_open(&lfs, &file, path, LFS_O_RDONLY);
+    if (open_file(&file, &file_cfg, path, LFS_O_RDONLY) < 0) return 0;
     lfs_ssize_t size = lfs_file_read(&lfs, &file, buffer, buffer_size);
-    lfs_file_close(&lfs, &file);
+    close_file(&file, &file_cfg);
+    if (size < 0) return 0;
+    return (size_t)size;
+};
+
+size_t read_file(const char * path, uint8_t * buffer, size_t buffer_size, size_t offset) {
+    if (open_file(&file, &file_cfg, path, LFS_O_RDONLY) < 0) return 0;
+    lfs_ssize_t size = -1;
+    if (lfs_file_seek(&lfs, &file, offset, LFS_SEEK_SET) >= 0) size = lfs_file_read(&lfs, &file, buffer, buffer_size);
+    close_file(&file, &file_cfg);
     if (size < 0) return 0;
     return (size_t)size;
 };
@@ -156,6 +365,81 @@ bool delete_file(const char * path) {
     return lfs_remove(&lfs, path) >= 0;
 };
 
+// Replaces new_path if it exists
+bool rename_file(const char * path, const char * new_path) {
+    return lfs_rename(&lfs, path, new_path) >= 0;
+};
+
+bool truncate_file(const char * path, size_t size) {
+    if (open_file(&file, &file_cfg, path, LFS_O_WRONLY) < 0) return false;
+    int err = lfs_file_truncate(&lfs, &file, size);
+    return close_file(&file, &file_cfg) >= 0 && err >= 0;
+};
+
+size_t get_storage_free() {
+    lfs_ssize_t used = lfs_fs_size(&lfs);
+    if (used < 0 || (lfs_size_t)used > cfg.block_count) return 0;
+    return (cfg.block_count - used) * cfg.block_size;
+};
+
+// Streamed writes keep their own handle so other file operations can run in between
+static lfs_file_t stream;
+static struct lfs_file_config stream_cfg;
+static bool stream_valid = false;
+
+bool stream_open(const char * path) {
+    if (stream_valid) return false;
+    if (file_exists(path)) delete_file(path);
+    return stream_valid = open_file(&stream, &stream_cfg, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_EXCL) >= 0;
+};
+
+bool stream_write(const uint8_t * buffer, size_t size) {
+    if (!stream_valid) return false;
+    return lfs_file_write(&lfs, &stream, buffer, size) == (lfs_ssize_t)size;
+};
+
+bool stream_close() {
+    if (!stream_valid) return false;
+    stream_valid = false;
+    return close_file(&stream, &stream_cfg) >= 0;
+};
+
+// Positioned reads keep the file open and only seek when the reads aren't sequential
+static file_reader_t reader = { 0 };
+
+bool reader_open(file_reader_t * reader, const char * path) {
+    reader_close(reader);
+    reader->offset = 0;
+    return reader->valid = open_file(&reader->file, &reader->cfg, path, LFS_O_RDONLY) >= 0;
+};
+bool reader_open(const char * path) {
+    return reader_open(&reader, path);
+};
+
+size_t reader_read(file_reader_t * reader, uint8_t * buffer, size_t size, size_t offset) {
+    if (!reader->valid) return 0;
+    if (offset != reader->offset && lfs_file_seek(&lfs, &reader->file, offset, LFS_SEEK_SET) < 0) return 0;
+    lfs_ssize_t read_size = lfs_file_read(&lfs, &reader->file, buffer, size);
+    if (read_size < 0) {
+        reader->offset = (size_t)-1;
+        return 0;
+    }
+    reader->offset = offset + read_size;
+    return (size_t)read_size;
+};
+size_t reader_read(uint8_t * buffer, size_t size, size_t offset) {
+    return reader_read(&reader, buffer, size, offset);
+};
+
+void reader_close(file_reader_t * reader) {
+    if (!reader->valid) return;
+    reader->valid = false;
+    close_file(&reader->file, &reader->cfg);
+};
+void reader_close() {
+    reader_close(&reader);
+};
+
 // Directory operations
 
 bool valid_dir_item(bool include_dir) {
@@ -164,6 +448,25 @@ bool valid_dir_item(bool include_dir) {
     return true;
 };
 
+// Plain names and sizes of the files which would be listed, without the file list formatting
+bool list_open(const char * path) {
+    return lfs_dir_open(&lfs, &dir, path) >= 0;
+};
+
+bool list_next(char * name, size_t * size) {
+    while (lfs_dir_read(&lfs, &dir, &info) > 0) {
+        if (!valid_dir_item(false)) continue;
+        strcpy(name, info.name);
+        *size = info.size;
+        return true;
+    }
+    return false;
+};
+
+void list_close() {
+    lfs_dir_close(&lfs, &dir);
+};
+
 size_t dir_count(const char * path, bool include_dir) {
     size_t count = 0;
     lfs_dir_open(&lfs, &dir, path);
@@ -261,7 +564,7 @@ uint get_filename(char * buffer, bool overwrite) {
 	do {
 		printf("Enter a valid filename (%d characters max, leave empty to quit): ", LFS_NAME_MAX);
 		do {
-			buffer[len] = getchar();
+			buffer[len] = job_getchar();
 			if (buffer[len] == 13) break; // Carriage return
 			putchar(buffer[len]);
 		} while (len++ < LFS_NAME_MAX);
@@ -0,0 +1,143 @@
+#include "trace.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+#include "pins.hpp"
+
+volatile bool trace_enabled = false;
+
+static trace_event_t events[TRACE_SIZE];
+static size_t head = 0, count = 0;
+static uint32_t last_address;
+static uint16_t last_state;
+
+static uint32_t cycles_per_us = 125;
+static uint32_t systick_span_us;
+static uint64_t cycle_count;
+static uint32_t last_tick, last_us;
+
+// Extend the 24-bit SysTick counter to 64 bits, falling back to the microsecond timer for long gaps
+static uint64_t trace_cycles() {
+    uint32_t tick = systick_hw->cvr, us = time_us_32();
+    if (us - last_us >= systick_span_us) {
+        cycle_count += (uint64_t)(us - last_us) * cycles_per_us;
+    } else {
+        cycle_count += (last_tick - tick) & 0xFFFFFF; // Counts down
+    }
+    last_tick = tick;
+    last_us = us;
+    return cycle_count;
+};
+
+void trace_enable(bool enable) {
+    if (enable && !trace_enabled) {
+        cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+        systick_span_us = 0x800000 / cycles_per_us;
+        systick_hw->rvr = 0xFFFFFF;
+        systick_hw->csr = 0x5; // Enable with processor clock, no interrupt
+        last_tick = systick_hw->cvr;
+        last_us = time_us_32();
+    }
+    trace_enabled = enable;
+};
+
+void trace_clear() {
+    head = 0;
+    count = 0;
+    cycle_count = 0;
+};
+
+size_t trace_count() {
+    return count;
+};
+
+void trace_record(uint32_t address, uint16_t state) {
+    if (!trace_enabled) return;
+    if (count && address == last_address && state == last_state) return; // Only record transitions
+    last_address = address;
+    last_state = state;
+
+    events[head].cycle = trace_cycles();
+    events[head].address = address;
+    events[head].state = state;
+    head = (head + 1) % TRACE_SIZE;
+    if (count < TRACE_SIZE) count++;
+};
+
+// VCD output
+
+static char * vcd_out;
+static size_t vcd_size, vcd_len;
+
+static bool vcd_printf(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(vcd_out + vcd_len, vcd_size - vcd_len, format, args);
+    va_end(args);
+    if (len < 0 || vcd_len + len >= vcd_size) return false;
+    vcd_len += len;
+    return true;
+};
+
+static bool vcd_bits(uint32_t value, uint8_t bits, char id) {
+    char text[33];
+    for (uint8_t i = 0; i < bits; i++) text[i] = (value & (1u << (bits - 1 - i))) ? '1' : '0';
+    text[bits] = 0;
+    return vcd_printf("b%s %c\n", text, id);
+};
+
+static bool vcd_state(uint16_t state, uint16_t changed) {
+    if ((changed & TRACE_CE) && !vcd_printf("%c!\n", (state & TRACE_CE) ? '1' : '0')) return false;
+    if ((changed & TRACE_OE) && !vcd_printf("%c\"\n", (state & TRACE_OE) ? '1' : '0')) return false;
+    if ((changed & TRACE_WE) && !vcd_printf("%c#\n", (state & TRACE_WE) ? '1' : '0')) return false;
+    if ((changed & TRACE_DATA_OUT) && !vcd_printf("%c&\n", (state & TRACE_DATA_OUT) ? '1' : '0')) return false;
+    if ((changed & (0xFF << TRACE_DATA_SHIFT)) && !vcd_bits((state >> TRACE_DATA_SHIFT) & 0xFF, 8, '%')) return false;
+    return true;
+};
+
+size_t trace_vcd(char * out, size_t size) {
+    // The address vector covers the direct lines and whatever latched bits the capture reached
+    size_t i, index;
+    uint32_t used = 0;
+    uint8_t bits = ADDR_BITS;
+    for (i = 0; i < count; i++) used |= events[i].address;
+    while (bits < 32 && (used >> bits)) bits++;
+
+    vcd_out = out;
+    vcd_size = size;
+    vcd_len = 0;
+
+    if (!vcd_printf("$version PicoPROM bus trace $end\n$timescale 1ns $end\n")) return 0;
+    if (!vcd_printf("$scope module picoprom $end\n")) return 0;
+    if (!vcd_printf("$var wire 1 ! CE $end\n$var wire 1 \" OE $end\n$var wire 1 # WE $end\n")) return 0;
+    if (!vcd_printf("$var wire %d $ A $end\n$var wire 8 %% D $end\n$var wire 1 & D_OUT $end\n", bits)) return 0;
+    if (!vcd_printf("$upscope $end\n$enddefinitions $end\n")) return 0;
+
+    size_t last_len;
+    uint64_t start = 0;
+    uint32_t address = 0;
+    uint16_t state = 0;
+    for (i = 0; i < count; i++) {
+        index = (head + TRACE_SIZE - count + i) % TRACE_SIZE;
+        if (!i) start = events[index].cycle;
+        last_len = vcd_len;
+        if (!vcd_printf("#%llu\n", (unsigned long long)((events[index].cycle - start) * 1000 / cycles_per_us))
+            || !vcd_state(events[index].state, i ? state ^ events[index].state : 0xFFFF)
+            || ((!i || address != events[index].address) && !vcd_bits(events[index].address, bits, '$'))) {
+            // Drop the partial event if the output is full
+            vcd_len = last_len;
+            break;
+        }
+        address = events[index].address;
+        state = events[index].state;
+    }
+    out[vcd_len] = 0;
+    return vcd_len;
+};
+
+void trace_print() {
+    printf("Bus trace: %s, %d of %d events recorded\r\n", trace_enabled ? "enabled" : "disabled", count, TRACE_SIZE);
+};
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <tusb.h>
+
+#include "pico/unique_id.h"
+
+#ifndef USB_VID
+#define USB_VID 0x2E8A // Raspberry Pi
+#endif
+
+#ifndef USB_PID
+#define USB_PID 0x000A
+#endif
+
+// Bumped so hosts don't reuse the single interface layout they may have cached
+#define USB_BCD_DEVICE 0x0200
+
+enum {
+    ITF_NUM_CONSOLE = 0,
+    ITF_NUM_CONSOLE_DATA,
+    ITF_NUM_DATALINK,
+    ITF_NUM_DATALINK_DATA,
+    ITF_NUM_DRIVE,
+    ITF_NUM_TOTAL
+};
+
+enum {
+    STRID_LANGID = 0,
+    STRID_MANUFACTURER,
+    STRID_PRODUCT,
+    STRID_SERIAL,
+    STRID_CONSOLE,
+    STRID_DATALINK,
+    STRID_DRIVE
+};
+
+#define EPNUM_CONSOLE_NOTIF 0x81
+#define EPNUM_CONSOLE_OUT 0x02
+#define EPNUM_CONSOLE_IN 0x82
+#define EPNUM_DATALINK_NOTIF 0x83
+#define EPNUM_DATALINK_OUT 0x04
+#define EPNUM_DATALINK_IN 0x84
+#define EPNUM_DRIVE_OUT 0x05
+#define EPNUM_DRIVE_IN 0x85
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + 2 * TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
+
+static const tusb_desc_device_t device_descriptor = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_VID,
+    .idProduct = USB_PID,
+    .bcdDevice = USB_BCD_DEVICE,
+    .iManufacturer = STRID_MANUFACTURER,
+    .iProduct = STRID_PRODUCT,
+    .iSerialNumber = STRID_SERIAL,
+    .bNumConfigurations = 1
+};
+
+static const uint8_t configuration_descriptor[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 250),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CONSOLE, STRID_CONSOLE, EPNUM_CONSOLE_NOTIF, 8, EPNUM_CONSOLE_OUT, EPNUM_CONSOLE_IN, 64),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_DATALINK, STRID_DATALINK, EPNUM_DATALINK_NOTIF, 8, EPNUM_DATALINK_OUT, EPNUM_DATALINK_IN, 64),
+    TUD_MSC_DESCRIPTOR(ITF_NUM_DRIVE, STRID_DRIVE, EPNUM_DRIVE_OUT, EPNUM_DRIVE_IN, 64)
+};
+
+static char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+
+static const char * strings[] = {
+    NULL, // Language is handled separately
+    "Raspberry Pi",
+    "PicoPROM",
+    serial,
+    "PicoPROM Console",
+    "PicoPROM Data",
+    "PicoPROM Storage"
+};
+
+static uint16_t string_descriptor[32];
+
+const uint8_t * tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&device_descriptor;
+};
+
+const uint8_t * tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+    return configuration_descriptor;
+};
+
+const uint16_t * tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    (void)langid;
+    uint8_t len;
+    if (index == STRID_LANGID) {
+        string_descriptor[1] = 0x0409; // English
+        len = 1;
+    } else {
+        if (index >= sizeof(strings) / sizeof(strings[0])) return NULL;
+        if (index == STRID_SERIAL && !serial[0]) pico_get_unique_board_id_string(serial, sizeof(serial));
+
+        const char * str = strings[index];
+        len = strlen(str);
+        if (len > 31) len = 31;
+        for (uint8_t i = 0; i < len; i++) string_descriptor[i + 1] = str[i];
+    }
+
+    // First entry is the byte length and descriptor type
+    string_descriptor[0] = (TUSB_DESC_STRING << 8) | (2 * len + 2);
+    return string_descriptor;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Pin-level model of a parallel device in the socket, driven through the GPIO calls of the ROM engine
+
+typedef struct {
+    // GPIO calls made by the engine
+    size_t puts;
+    size_t directions;
+    size_t samples;
+
+    size_t reads; // Samples taken while the device drove the bus
+    size_t writes; // Completed write cycles
+    size_t contention; // Changes which left the device and the Pico both driving the data bus
+
+    // Flash behind the upper address latch
+    size_t latches;
+    size_t programs;
+    size_t erases;
+    size_t violations; // Cycles the part would have ignored or misread, each one is printed
+} bus_stub_stats_t;
+
+// The device is filled with a repeatable pattern, control lines are undriven
+void bus_stub_reset(size_t size, bool flash);
+void bus_stub_reset(size_t size);
+void bus_stub_set_access_us(uint32_t us);
+uint8_t * bus_stub_memory();
+uint8_t bus_stub_latch();
+bus_stub_stats_t * bus_stub_stats();
+
+// GPIO calls counted in the stats
+size_t bus_stub_operations();
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_SIO = 5
+};
+
+// Provided by the bus model each device test links
+void gpio_init(uint gpio);
+void gpio_deinit(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get_out_level(uint gpio);
+uint32_t gpio_get_all();
+void gpio_pull_up(uint gpio);
+void gpio_disable_pulls(uint gpio);
+void gpio_set_pulls(uint gpio, bool up, bool down);
+void gpio_set_function(uint gpio, enum gpio_function fn);
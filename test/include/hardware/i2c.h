@@ -0,0 +1,14 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#define PICO_ERROR_GENERIC -2
+
+typedef struct i2c_inst i2c_inst_t;
+
+extern i2c_inst_t * i2c0_inst;
+#define i2c0 i2c0_inst
+
+uint i2c_init(i2c_inst_t * i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t * i2c);
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop);
@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t * systick_hw;
@@ -0,0 +1,16 @@
+#pragma once
+// Host stand-in for the littlefs types used in the firmware headers, storage itself is held in memory
+#include <stdint.h>
+#include <stddef.h>
+
+#define LFS_NAME_MAX 255
+
+typedef uint32_t lfs_size_t;
+
+typedef struct {
+    char path[LFS_NAME_MAX+1];
+} lfs_file_t;
+
+struct lfs_file_config {
+    void * buffer;
+};
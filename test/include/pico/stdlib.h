@@ -0,0 +1,17 @@
+#pragma once
+// Host stand-in for the parts of the Pico SDK the tested sources use
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "hardware/gpio.h"
+
+// Simulated microsecond clock, only advanced by sleeps and busy waits
+uint32_t time_us_32();
+uint64_t time_us_64();
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+void busy_wait_us(uint64_t us);
+void busy_wait_us_32(uint32_t us);
+
+static inline void tight_loop_contents() { };
@@ -0,0 +1,23 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// Models of the serial devices behind the SPI and I2C controllers, answering at the byte level
+
+typedef enum {
+    SERIAL_STUB_NONE,
+    SERIAL_STUB_I2C_EEPROM, // 24Cxx, pages wrap and the write cycle is found by acknowledge polling
+    SERIAL_STUB_SPI_EEPROM, // 25xx, bytes are written without erasing
+    SERIAL_STUB_SPI_FLASH // W25Q, programs only clear bits and sectors are erased to 0xFF
+} serial_stub_part_t;
+
+typedef struct {
+    size_t programs;
+    size_t erases;
+    size_t blocking_payload; // SPI program and read data bytes moved by the blocking calls rather than DMA
+    size_t violations; // Commands the part would have ignored or misread, each one is printed
+} serial_stub_stats_t;
+
+// The device is filled with a repeatable pattern, the address bytes are as the part expects them
+void serial_stub_reset(serial_stub_part_t part, size_t size, size_t page_size, size_t sector_size, uint8_t address_bytes);
+uint8_t * serial_stub_memory();
+serial_stub_stats_t * serial_stub_stats();
@@ -0,0 +1,6 @@
+#pragma once
+#include "storage.hpp"
+
+// Flash storage held in memory, files are written through the regular storage.hpp calls
+void storage_stub_reset(size_t free_space);
+size_t storage_stub_files();
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdio.h>
+
+// Each test program is one translation unit, failures are counted and reported at exit
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+static int test_result(const char * name) {
+    printf("%s: %s\n", name, failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+};
@@ -0,0 +1,277 @@
+#include "bus_stub.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "pins.hpp"
+#include "rom.hpp"
+
+// The device is selected by CE low, drives the data bus while OE is low and WE high, and takes a byte on
+// the rising edge of CE or WE while the other is low. With the GPIO released, CE and WE are pulled high
+// and OE follows the board, grounded for read-only parts.
+//
+// Flash sits behind a 74HC573 for A15 and up, transparent while OE and WE are both low and loaded from
+// A0-A7. It takes JEDEC commands instead of plain writes, and toggles DQ6 on every read while busy.
+
+// Reads while busy before a command completes
+#define PROGRAM_POLLS 3
+#define ERASE_POLLS 20
+#define SECTOR_SIZE 4096
+
+static bool level[32], output[32];
+static int8_t pull[32]; // Level an undriven input settles to, -1 when floating
+
+// Address line of each pin, the address is kept as the pins change so the model keeps up with whole device writes
+static int8_t line[32];
+static size_t lines;
+static uint8_t data_outputs;
+static bool last_ce = true, last_we = true, last_le = false;
+static std::vector<uint8_t> memory;
+static bus_stub_stats_t stats;
+
+static bool flash;
+static uint8_t latch;
+static uint8_t stage; // Command prefix bytes seen
+static uint8_t command;
+static uint busy;
+static uint8_t busy_data;
+static bool toggle;
+
+// Reads inside the access time after an address change return the byte at the previous address
+static uint32_t access_us;
+static uint64_t changed_us;
+static size_t last_address;
+static uint8_t stale;
+
+void bus_stub_reset(size_t size, bool has_flash) {
+    memory.resize(size);
+    for (size_t i = 0; i < size; i++) memory[i] = (i * 37) ^ (i >> 8) ^ (i >> 16);
+    memset(level, 0, sizeof(level));
+    memset(output, 0, sizeof(output));
+    memset(pull, -1, sizeof(pull));
+    memset(line, -1, sizeof(line));
+    for (uint8_t i = 0; i < sizeof(ADDR_MAP) / sizeof(*ADDR_MAP); i++) line[ADDR_MAP[i]] = i;
+    lines = 0;
+    data_outputs = 0;
+    last_ce = last_we = true;
+    last_le = false;
+    stats = { 0 };
+    flash = has_flash;
+    latch = 0;
+    stage = 0;
+    command = 0;
+    busy = 0;
+    access_us = 0;
+    last_address = 0;
+};
+void bus_stub_reset(size_t size) {
+    bus_stub_reset(size, false);
+};
+
+void bus_stub_set_access_us(uint32_t us) {
+    access_us = us;
+};
+
+uint8_t * bus_stub_memory() {
+    return memory.data();
+};
+
+uint8_t bus_stub_latch() {
+    return latch;
+};
+
+bus_stub_stats_t * bus_stub_stats() {
+    return &stats;
+};
+
+size_t bus_stub_operations() {
+    return stats.puts + stats.directions + stats.samples;
+};
+
+static void violation(const char * reason, size_t address, uint8_t value) {
+    printf("bus stub: %s at 0x%05zX (0x%02X)\n", reason, address, value);
+    stats.violations++;
+};
+
+static bool ce() {
+    return output[CE_PIN] ? level[CE_PIN] : true;
+};
+
+static bool oe() {
+    return output[OE_PIN] && level[OE_PIN];
+};
+
+static bool we() {
+    return output[WE_PIN] ? level[WE_PIN] : true;
+};
+
+static size_t address() {
+    return (flash ? lines | (size_t)latch << ADDR_BITS : lines) % memory.size();
+};
+
+static uint8_t data() {
+    uint8_t value = 0;
+    for (uint8_t i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) {
+        if (level[DATA_MAP[i]]) value |= 1 << i;
+    }
+    return value;
+};
+
+static bool driving() {
+    return !ce() && !oe() && we();
+};
+
+// SST39SF byte program (AA 55 A0, data) and sector erase (AA 55 80, AA 55 30), the prefix addresses only
+// decode A0-A14
+static void flash_cycle(size_t address, uint8_t value) {
+    size_t low = address & 0x7FFF;
+    if (busy) {
+        violation("write during a program or erase", address, value);
+        return;
+    }
+    if (command == 0xA0) {
+        memory[address] &= value;
+        stats.programs++;
+        busy = PROGRAM_POLLS;
+        busy_data = value;
+        command = 0;
+        return;
+    }
+    if (stage == 0 && low == 0x5555 && value == 0xAA) {
+        stage = 1;
+        return;
+    }
+    if (stage == 1 && low == 0x2AAA && value == 0x55) {
+        stage = 2;
+        return;
+    }
+    if (stage == 2) {
+        stage = 0;
+        if (command == 0x80 && value == 0x30) {
+            memset(&memory[address & ~(size_t)(SECTOR_SIZE - 1)], 0xFF, SECTOR_SIZE);
+            stats.erases++;
+            busy = ERASE_POLLS;
+            busy_data = 0xFF;
+            command = 0;
+            return;
+        }
+        if (low == 0x5555 && (value == 0xA0 || value == 0x80)) {
+            command = value;
+            return;
+        }
+    }
+    violation("write outside a command", address, value);
+    stage = 0;
+    command = 0;
+};
+
+static void update() {
+    if (driving() && data_outputs) stats.contention++;
+
+    bool le = flash && !oe() && !we();
+    if (le) {
+        if (!ce()) violation("latch loaded with the device selected", address(), 0);
+        latch = lines & ((1 << LATCH_BITS) - 1);
+        if (!last_le) stats.latches++;
+    }
+    last_le = le;
+
+    // A write cycle ends on whichever of CE and WE rises first
+    if (!last_ce && !last_we && (ce() || we()) && oe()) {
+        if (flash) {
+            flash_cycle(address(), data());
+        } else {
+            memory[address()] = data();
+        }
+        stats.writes++;
+    }
+
+    size_t current = address();
+    if (current != last_address) {
+        stale = memory[last_address];
+        last_address = current;
+        changed_us = time_us_64();
+    }
+    last_ce = ce();
+    last_we = we();
+};
+
+static void set_output(uint gpio, bool out) {
+    for (uint8_t i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) {
+        if (DATA_MAP[i] == gpio && output[gpio] != out) data_outputs += out ? 1 : -1;
+    }
+    output[gpio] = out;
+};
+
+static void set_level(uint gpio, bool value) {
+    level[gpio] = value;
+    if (line[gpio] >= 0) lines = value ? lines | 1 << line[gpio] : lines & ~(1 << line[gpio]);
+};
+
+void gpio_init(uint gpio) {
+    set_level(gpio, false);
+    set_output(gpio, false);
+    update();
+};
+
+void gpio_deinit(uint gpio) {
+    set_output(gpio, false);
+    update();
+};
+
+void gpio_set_dir(uint gpio, bool out) {
+    stats.directions++;
+    set_output(gpio, out);
+    update();
+};
+
+void gpio_put(uint gpio, bool value) {
+    stats.puts++;
+    set_level(gpio, value);
+    update();
+};
+
+bool gpio_get_out_level(uint gpio) {
+    return level[gpio];
+};
+
+uint32_t gpio_get_all() {
+    uint32_t pins = 0;
+    stats.samples++;
+    for (uint8_t i = 0; i < 32; i++) {
+        if (output[i] ? level[i] : pull[i] > 0) pins |= 1u << i;
+    }
+    if (driving()) {
+        uint8_t value;
+        if (busy) {
+            // DQ6 toggles and DQ7 is the complement of the data until the command completes
+            busy--;
+            toggle = !toggle;
+            value = (toggle ? 0x40 : 0) | (~busy_data & 0x80);
+        } else {
+            value = time_us_64() - changed_us < access_us ? stale : memory[address()];
+        }
+        stats.reads++;
+        for (uint8_t i = 0; i < sizeof(DATA_MAP) / sizeof(*DATA_MAP); i++) {
+            pins &= ~(1u << DATA_MAP[i]);
+            if (value & (1 << i)) pins |= 1u << DATA_MAP[i];
+        }
+    }
+    return pins;
+};
+
+void gpio_pull_up(uint gpio) {
+    pull[gpio] = 1;
+};
+
+void gpio_disable_pulls(uint gpio) {
+    pull[gpio] = -1;
+};
+
+void gpio_set_pulls(uint gpio, bool up, bool down) {
+    pull[gpio] = up ? 1 : (down ? 0 : -1);
+};
+
+void gpio_set_function(uint, enum gpio_function) {
+};
@@ -0,0 +1,248 @@
+#include "fatview.hpp"
+
+#include <string.h>
+
+#include "storage_stub.hpp"
+#include "test.hpp"
+
+#define SECTOR FATVIEW_SECTOR_SIZE
+
+static uint8_t sector[SECTOR], directory[SECTOR];
+static uint8_t fat[FATVIEW_FAT_SECTORS * SECTOR];
+
+// Host side of the volume
+
+static uint32_t cluster_lba(uint16_t cluster) {
+    return FATVIEW_DATA_LBA + cluster - 2;
+};
+
+static uint16_t fat_entry(uint16_t cluster) {
+    uint32_t offset = cluster * 3 / 2;
+    uint16_t value = fat[offset] | (fat[offset + 1] << 8);
+    return cluster & 1 ? value >> 4 : value & 0xFFF;
+};
+
+static bool read_fat(uint8_t copy) {
+    for (uint32_t i = 0; i < FATVIEW_FAT_SECTORS; i++) {
+        if (!fatview_read(FATVIEW_FAT_LBA + copy * FATVIEW_FAT_SECTORS + i, fat + i * SECTOR)) return false;
+    }
+    return true;
+};
+
+static uint8_t checksum(const uint8_t * short_name) {
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < 11; i++) sum = ((sum & 1) << 7) + (sum >> 1) + short_name[i];
+    return sum;
+};
+
+static const uint8_t lfn_offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+static void make_entry(uint8_t * entry, const char * short_name, uint16_t cluster, uint32_t size) {
+    memset(entry, 0, 32);
+    memcpy(entry, short_name, 11);
+    entry[11] = 0x20;
+    entry[26] = cluster & 0xFF;
+    entry[27] = cluster >> 8;
+    for (uint8_t i = 0; i < 4; i++) entry[28 + i] = size >> (i * 8);
+};
+
+// Long name entries for a name, highest order first as they are laid out before the short entry
+static uint8_t make_lfn(uint8_t * entries, const char * name, uint8_t sum) {
+    size_t len = strlen(name), index;
+    uint8_t count = (len + 12) / 13, order;
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t * entry = entries + i * 32;
+        order = count - i;
+        memset(entry, 0, 32);
+        entry[0] = order | (i ? 0 : 0x40);
+        entry[11] = 0x0F;
+        entry[13] = sum;
+        index = (order - 1) * 13;
+        for (uint8_t j = 0; j < 13; j++, index++) {
+            uint16_t c = index < len ? (uint8_t)name[index] : (index == len ? 0 : 0xFFFF);
+            entry[lfn_offsets[j]] = c & 0xFF;
+            entry[lfn_offsets[j] + 1] = c >> 8;
+        }
+    }
+    return count;
+};
+
+static void fill_cluster(uint8_t * data, uint16_t cluster) {
+    for (uint32_t i = 0; i < SECTOR; i++) data[i] = (cluster * 7 + i) & 0xFF;
+};
+
+static bool write_cluster(uint16_t cluster) {
+    fill_cluster(sector, cluster);
+    return fatview_write(cluster_lba(cluster), sector);
+};
+
+// Data the host wrote for a file starting at a cluster
+static bool file_matches(const char * name, uint16_t cluster, uint32_t size) {
+    static uint8_t data[8 * SECTOR], expected[8 * SECTOR];
+    if (get_file_size(name) != size || read_file(name, data, sizeof(data)) != size) return false;
+    for (uint32_t i = 0; i < size; i += SECTOR) fill_cluster(expected + i, cluster + i / SECTOR);
+    return !memcmp(data, expected, size);
+};
+
+static void add_stored(const char * name, size_t size) {
+    static uint8_t data[400 * SECTOR];
+    for (size_t i = 0; i < size; i++) data[i] = i * 13;
+    write_file(name, data, size);
+};
+
+// FAT12 entries pack two clusters into three bytes, chains have to stay intact across FAT sectors
+
+static void test_fat_packing() {
+    storage_stub_reset(FATVIEW_RESERVE + 8 * SECTOR);
+    add_stored("a.bin", 1000); // Clusters 2-3
+    add_stored("b.bin", 0); // No clusters
+    add_stored("big.bin", 400 * SECTOR - 100); // Clusters 4-403, crossing into the second FAT sector
+    add_stored("c.bin", SECTOR); // Cluster 404
+    CHECK(fatview_mount());
+
+    CHECK(read_fat(0));
+    CHECK(fat[0] == 0xF8 && fat[1] == 0xFF && fat[2] == 0xFF);
+    CHECK(fat_entry(2) == 3);
+    CHECK(fat_entry(3) == 0xFFF);
+    bool chained = true;
+    for (uint16_t cluster = 4; cluster < 403; cluster++) chained = chained && fat_entry(cluster) == cluster + 1;
+    CHECK(chained);
+    CHECK(fat_entry(341) == 342 && fat_entry(342) == 343); // Entry 341 straddles the sector boundary
+    CHECK(fat_entry(403) == 0xFFF);
+    CHECK(fat_entry(404) == 0xFFF);
+
+    // Eight free clusters, the rest marked bad to show the real free space
+    CHECK(fat_entry(405) == 0 && fat_entry(412) == 0);
+    CHECK(fat_entry(413) == 0xFF7);
+    CHECK(fat_entry(FATVIEW_CLUSTERS + 1) == 0xFF7);
+
+    // Both copies are the same
+    static uint8_t first[sizeof(fat)];
+    memcpy(first, fat, sizeof(fat));
+    CHECK(read_fat(1));
+    CHECK(!memcmp(first, fat, sizeof(fat)));
+
+    // The last cluster of a file reads the tail and then zeros
+    CHECK(fatview_read(cluster_lba(3), sector));
+    CHECK(sector[0] == (uint8_t)(512 * 13) && sector[487] == (uint8_t)(999 * 13) && sector[488] == 0);
+
+    fatview_unmount();
+};
+
+// Long names are split over entries which count down to the short entry, both when shown and when written
+
+static void test_long_names() {
+    storage_stub_reset(1024 * 1024);
+    add_stored("long-image-name.bin", 100); // Cluster 2, slots 1-3
+    add_stored("lower.rom", 100); // Cluster 3, slot 4
+    CHECK(fatview_mount());
+
+    uint8_t * entries = directory;
+    CHECK(fatview_read(FATVIEW_ROOT_LBA, directory));
+    CHECK(!memcmp(entries, "PICOPROM   ", 11) && entries[11] == 0x08);
+    CHECK(entries[32] == 0x42 && entries[32 + 11] == 0x0F);
+    CHECK(entries[64] == 0x01 && entries[64 + 11] == 0x0F);
+    CHECK(!memcmp(entries + 96, "LONG-I~1BIN", 11));
+    CHECK(entries[32 + 13] == checksum(entries + 96) && entries[64 + 13] == checksum(entries + 96));
+
+    char name[27] = { 0 };
+    for (uint8_t i = 0; i < 26; i++) {
+        const uint8_t * entry = entries + (i < 13 ? 64 : 32);
+        uint16_t c = entry[lfn_offsets[i % 13]] | (entry[lfn_offsets[i % 13] + 1] << 8);
+        if (c == 0xFFFF) break;
+        name[i] = c;
+    }
+    CHECK(!strcmp(name, "long-image-name.bin"));
+
+    // 8.3 names keep their case through the case flags
+    CHECK(!memcmp(entries + 128, "LOWER   ROM", 11) && entries[128 + 12] == 0x18);
+    CHECK(entries[160] == 0);
+
+    // The host adds a long named file after the existing entries
+    CHECK(write_cluster(4));
+    CHECK(write_cluster(5));
+    make_entry(entries + 7 * 32, "COPIED~1BIN", 4, 700);
+    CHECK(make_lfn(entries + 5 * 32, "copied image.bin", checksum(entries + 7 * 32)) == 2);
+
+    // A long name whose checksum doesn't match falls back to the short name
+    CHECK(write_cluster(6));
+    make_entry(entries + 9 * 32, "BADSUM~1BIN", 6, 10);
+    make_lfn(entries + 8 * 32, "bad sum.bin", checksum(entries + 9 * 32) + 1);
+    CHECK(fatview_write(FATVIEW_ROOT_LBA, directory));
+
+    fatview_settle(true);
+    CHECK(file_matches("copied_image.bin", 4, 700)); // Spaces aren't allowed in storage names
+    CHECK(file_matches("BADSUM~1.BIN", 6, 10));
+    CHECK(storage_stub_files() == 4);
+    CHECK(get_fatview_stats()->files_added == 2);
+
+    // The new file is shown under its long name
+    CHECK(fatview_read(FATVIEW_ROOT_LBA, directory));
+    CHECK(entries[5 * 32] == 0x42 && entries[6 * 32] == 0x01);
+    CHECK(!memcmp(entries + 7 * 32, "COPIED~1BIN", 11) && entries[7 * 32 + 26] == 4);
+
+    fatview_unmount();
+};
+
+// Clusters are stored as contiguous runs, with files copied out once named and complete
+
+static void test_runs() {
+    storage_stub_reset(1024 * 1024);
+    CHECK(fatview_mount());
+
+    memset(directory, 0, SECTOR);
+
+    // Described before the data, the data has to follow in order
+    make_entry(directory + 1 * 32, "SEQ     BIN", 2, 3 * SECTOR);
+    CHECK(fatview_write(FATVIEW_ROOT_LBA, directory));
+    CHECK(!write_cluster(3));
+    CHECK(write_cluster(2));
+    CHECK(write_cluster(3));
+    CHECK(write_cluster(3)); // Rewrites of stored data are accepted and dropped
+    CHECK(write_cluster(4));
+
+    // One run holding two files
+    for (uint16_t cluster = 10; cluster < 14; cluster++) CHECK(write_cluster(cluster));
+    make_entry(directory + 2 * 32, "ONE     BIN", 10, 2 * SECTOR);
+    make_entry(directory + 3 * 32, "TWO     BIN", 12, 700);
+
+    // Two runs written alternately, the run which lost the stream is appended to
+    CHECK(write_cluster(20));
+    CHECK(write_cluster(30));
+    CHECK(write_cluster(21));
+    CHECK(write_cluster(31));
+    make_entry(directory + 4 * 32, "X       BIN", 20, 2 * SECTOR);
+    make_entry(directory + 5 * 32, "Y       BIN", 30, 2 * SECTOR);
+
+    // Never completed
+    CHECK(write_cluster(40));
+    make_entry(directory + 6 * 32, "Z       BIN", 40, 4 * SECTOR);
+
+    CHECK(fatview_write(FATVIEW_ROOT_LBA, directory));
+    fatview_settle(true);
+
+    CHECK(file_matches("SEQ.BIN", 2, 3 * SECTOR));
+    CHECK(file_matches("ONE.BIN", 10, 2 * SECTOR));
+    CHECK(file_matches("TWO.BIN", 12, 700));
+    CHECK(file_matches("X.BIN", 20, 2 * SECTOR));
+    CHECK(file_matches("Y.BIN", 30, 2 * SECTOR));
+    CHECK(!file_exists("Z.BIN"));
+    CHECK(get_fatview_stats()->files_added == 5);
+
+    // Stored files can't be written over
+    CHECK(!write_cluster(2));
+    CHECK(get_fatview_stats()->writes_rejected == 1);
+
+    // Only the incomplete upload's run is left, and it's dropped with the volume
+    CHECK(storage_stub_files() == 6);
+    fatview_unmount();
+    CHECK(get_fatview_stats()->uploads_failed == 1);
+    CHECK(storage_stub_files() == 5);
+};
+
+int main() {
+    test_fat_packing();
+    test_long_names();
+    test_runs();
+    return test_result("fatview");
+};
@@ -0,0 +1,132 @@
+#include "rom.hpp"
+
+#include <string.h>
+#include <vector>
+
+#include "bus_stub.hpp"
+#include "config.hpp"
+#include "test.hpp"
+
+#define FLASH_SIZE 524288
+#define SECTOR 4096
+
+static std::vector<uint8_t> image;
+
+static uint8_t image_data(size_t address) {
+    return image[address];
+};
+
+static ROM * make_rom(const char * name) {
+    CHECK(select_config(name));
+    return new ROM(get_config());
+};
+
+static void fill(std::vector<uint8_t> * data, uint32_t seed) {
+    for (size_t i = 0; i < data->size(); i++) (*data)[i] = xorshift32(&seed);
+};
+
+// A latched 512K SST39SF040: sequential reads load the latch once per 32K, writes only erase the sectors
+// which need erased bits and keep the rest of a sector, and erase skips blank sectors
+
+static void test_latched_flash() {
+    bus_stub_reset(FLASH_SIZE, true);
+    bus_stub_stats_t * stats = bus_stub_stats();
+    const uint8_t * memory = bus_stub_memory();
+    ROM * rom = make_rom("SST39SF040");
+    std::vector<uint8_t> data(FLASH_SIZE);
+
+    size_t latches = stats->latches;
+    CHECK(rom->read(data.data(), FLASH_SIZE, 0, false));
+    CHECK(!memcmp(data.data(), memory, FLASH_SIZE));
+    CHECK(stats->latches - latches == FLASH_SIZE / 32768 - 1); // The first 32K was latched when the ROM was set up
+
+    image.resize(FLASH_SIZE);
+    fill(&image, 0x1234);
+    CHECK(rom->write_verify_data(image_data, FLASH_SIZE, 0, false) == 0);
+    CHECK(!memcmp(memory, image.data(), FLASH_SIZE));
+    CHECK(rom->get_write_stats()->erased == FLASH_SIZE / SECTOR);
+    CHECK(rom->check_data(image_data, FLASH_SIZE, 0, false));
+
+    // Nothing is written when the device already matches
+    size_t programs = stats->programs, erases = stats->erases;
+    rom->set_differential(true);
+    CHECK(rom->write_verify_data(image_data, FLASH_SIZE, 0, false) == 0);
+    rom->set_differential(false);
+    CHECK(stats->programs == programs && stats->erases == erases);
+
+    // Inside one sector across the 32K boundary, the rest of the sector is put back
+    std::vector<uint8_t> before(memory, memory + FLASH_SIZE), patch(0x300);
+    size_t offset = 0x7F00;
+    fill(&patch, 0x5678);
+    erases = stats->erases;
+    CHECK(rom->write_verify_image(patch.data(), patch.size(), offset, false) == 0);
+    bool kept = true;
+    for (size_t i = 0; i < FLASH_SIZE; i++) {
+        kept = kept && memory[i] == (i >= offset && i < offset + patch.size() ? patch[i - offset] : before[i]);
+    }
+    CHECK(kept);
+    CHECK(stats->erases - erases == 2);
+
+    // Only the upper half is blank
+    memset(bus_stub_memory() + FLASH_SIZE / 2, 0xFF, FLASH_SIZE / 2);
+    erases = stats->erases;
+    CHECK(rom->erase());
+    printf("\n");
+    CHECK(stats->erases - erases == FLASH_SIZE / 2 / SECTOR);
+    CHECK(rom->get_write_stats()->unerased == FLASH_SIZE / 2 / SECTOR);
+    CHECK(rom->check_value(0xFF, false));
+
+    // Writing over a blank device needs no erase
+    erases = stats->erases;
+    CHECK(rom->write_verify_data(image_data, 0x10000, 0, false) == 0);
+    CHECK(stats->erases == erases);
+    CHECK(!memcmp(memory, image.data(), 0x10000));
+
+    CHECK(stats->contention == 0);
+    CHECK(stats->violations == 0);
+    delete rom;
+};
+
+// A 32K part in the same socket reads through the latch as it was left, and never strobes it
+
+static void test_unlatched() {
+    bus_stub_reset(FLASH_SIZE, true);
+    bus_stub_stats_t * stats = bus_stub_stats();
+    ROM * rom = make_rom("AT28C256");
+    std::vector<uint8_t> data(32768);
+
+    size_t latches = stats->latches;
+    CHECK(rom->read(data.data(), data.size(), 0, false));
+    CHECK(!memcmp(data.data(), bus_stub_memory() + ((size_t)bus_stub_latch() << 15), data.size()));
+    CHECK(stats->latches == latches);
+    CHECK(stats->contention == 0);
+    delete rom;
+};
+
+// A mask ROM slower than the first pass timing, the bytes read too early are found and read again
+
+static void test_stable(uint32_t access_us) {
+    bus_stub_reset(8192);
+    bus_stub_set_access_us(access_us);
+    ROM * rom = make_rom("2364");
+    std::vector<uint8_t> data(8192);
+
+    CHECK(rom->read_stable(data.data(), data.size(), 0, false));
+    CHECK(!memcmp(data.data(), bus_stub_memory(), data.size()));
+    const rom_read_stats_t * stats = rom->get_read_stats();
+    CHECK(stats->unresolved == 0);
+    if (access_us > STABLE_ACCESS_US) {
+        CHECK(stats->unstable > 0);
+    } else {
+        CHECK(stats->unstable == 0);
+    }
+    delete rom;
+};
+
+int main() {
+    test_latched_flash();
+    test_unlatched();
+    test_stable(0);
+    test_stable(3);
+    return test_result("flash");
+};
@@ -0,0 +1,333 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.hpp"
+
+// Runs picoprom-host against pty stand-ins which answer with the firmware's menus, prompts and XMODEM
+
+#define MEMORY_SIZE 32768
+#define IMAGE_SIZE 5000
+
+#define MAIN_MENU "Main Menu:\r\n\tw = Write image\r\n\tr = Read image\r\n\tv = Verify image\r\n\r\nEnter command: "
+#define TRANSFER_MENU "\tx = XMODEM\r\n\tu = USB data channel\r\n\ts = Flash Storage\r\n\r\nEnter command (q to return): "
+
+#define SOH 0x01
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+
+static uint16_t crc16(const uint8_t * data, size_t size) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i] << 8;
+        for (uint8_t j = 0; j < 8; j++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+};
+
+class StandIn {
+
+public:
+    std::string port;
+    std::vector<uint8_t> memory;
+    bool faulty; // Every write leaves one bit wrong
+    bool session; // Starts with an interrupted session to resume
+    size_t writes;
+
+    StandIn(bool faulty, bool session) {
+        this->faulty = faulty;
+        this->session = session;
+        this->writes = 0;
+        this->memory.assign(MEMORY_SIZE, 0xFF);
+        this->stopping = false;
+
+        // The slave side stays open here too, so the host closing its end doesn't hang up the master
+        char name[64];
+        openpty(&this->master, &this->slave, name, NULL, NULL);
+        struct termios tio;
+        tcgetattr(this->slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(this->slave, TCSANOW, &tio);
+        this->port = name;
+        this->thread = std::thread(&StandIn::run, this);
+    };
+
+    ~StandIn() {
+        this->stopping = true;
+        this->thread.join();
+        close(this->master);
+        close(this->slave);
+    };
+
+private:
+    int master;
+    int slave;
+    std::thread thread;
+    std::atomic<bool> stopping;
+
+    void put(const std::string & text) {
+        this->put((const uint8_t *)text.data(), text.size());
+    };
+    void put(const uint8_t * data, size_t size) {
+        ssize_t written;
+        while (size && (written = write(this->master, data, size)) > 0) {
+            data += written;
+            size -= written;
+        }
+    };
+
+    int get(int timeout_ms) {
+        struct pollfd fd = { this->master, POLLIN, 0 };
+        uint8_t c;
+        if (this->stopping || poll(&fd, 1, timeout_ms) <= 0 || read(this->master, &c, 1) != 1) return -1;
+        return c;
+    };
+
+    bool get_exact(uint8_t * data, size_t size) {
+        int c;
+        for (size_t i = 0; i < size; i++) {
+            if ((c = this->get(1000)) < 0) return false;
+            data[i] = c;
+        }
+        return true;
+    };
+
+    // Keys are echoed as the firmware prompts do
+    int get_key() {
+        int c;
+        while ((c = this->get(100)) < 0) {
+            if (this->stopping) return -1;
+        }
+        this->put(std::string(1, (char)c) + "\r\n");
+        return c;
+    };
+
+    bool receive(std::vector<uint8_t> * data) {
+        uint8_t packet[132];
+        int c;
+        data->clear();
+        do {
+            this->put("C");
+        } while ((c = this->get(1000)) < 0 && !this->stopping);
+        while (c == SOH) {
+            if (!this->get_exact(packet, sizeof(packet))) return false;
+            if ((packet[0] ^ packet[1]) == 0xFF && crc16(packet + 2, 128) == ((packet[130] << 8) | packet[131])) {
+                if (packet[0] == (uint8_t)(data->size() / 128 + 1)) data->insert(data->end(), packet + 2, packet + 130);
+                c = ACK;
+            } else {
+                c = NAK;
+            }
+            this->put((const uint8_t *)&c, 1);
+            c = this->get(5000);
+        }
+        if (c != EOT) return false;
+        c = ACK;
+        this->put((const uint8_t *)&c, 1);
+        return true;
+    };
+
+    bool send(const std::vector<uint8_t> & data) {
+        uint8_t packet[133];
+        int c;
+        while ((c = this->get(10000)) != 'C') {
+            if (c < 0) return false;
+        }
+        for (size_t block = 0; block * 128 < data.size(); block++) {
+            packet[0] = SOH;
+            packet[1] = block + 1;
+            packet[2] = ~packet[1];
+            memcpy(packet + 3, data.data() + block * 128, 128);
+            uint16_t crc = crc16(packet + 3, 128);
+            packet[131] = crc >> 8;
+            packet[132] = crc & 0xFF;
+            do {
+                this->put(packet, sizeof(packet));
+            } while ((c = this->get(5000)) == NAK);
+            if (c != ACK) return false;
+        }
+        c = EOT;
+        this->put((const uint8_t *)&c, 1);
+        return this->get(5000) == ACK;
+    };
+
+    bool receive_image(std::vector<uint8_t> * image) {
+        this->put("Select how you would like to transfer the image:\r\n" TRANSFER_MENU);
+        if (this->get_key() != 'x') return false;
+        this->put("Ready to receive image. Begin XMODEM transfer... ");
+        if (!this->receive(image)) {
+            this->put("\r\nXMODEM transfer failed\r\n\r\n");
+            return false;
+        }
+        this->put("\r\nTransfer complete!\r\n\r\n");
+        return true;
+    };
+
+    size_t differences(const std::vector<uint8_t> & image) {
+        size_t count = 0;
+        for (size_t i = 0; i < image.size(); i++) count += this->memory[i] != image[i];
+        return count;
+    };
+
+    void write_image() {
+        std::vector<uint8_t> image;
+        if (!this->receive_image(&image)) return;
+        if (!this->differences(image)) {
+            this->put("Device already contains this image, nothing to write.\r\n\r\n");
+            return;
+        }
+        this->writes++;
+        std::copy(image.begin(), image.end(), this->memory.begin());
+        if (this->faulty) this->memory[5] ^= 0x01;
+        this->put("Writing and verifying device (p to pause, c to cancel)... 2K 4K \r\n");
+        this->verify_result(image);
+    };
+
+    void verify_image() {
+        std::vector<uint8_t> image;
+        if (!this->receive_image(&image)) return;
+        this->put("Verifying ROM contents (p to pause, c to cancel)... \r\n");
+        this->verify_result(image);
+    };
+
+    void verify_result(const std::vector<uint8_t> & image) {
+        size_t errors = this->differences(image);
+        if (errors) {
+            this->put("ROM verification failed: " + std::to_string(errors) + " incorrect bytes out of " + std::to_string(image.size()) + "\r\n\r\n");
+        } else {
+            this->put("ROM verification succeeded in 1ms\r\n\r\n");
+        }
+    };
+
+    void read_image() {
+        this->put("Select how you would like to read the device:\r\n\tx = Read to memory, then transfer\r\n\r\nEnter command (q to return): ");
+        if (this->get_key() != 'x') return;
+        this->put("Reading device contents (p to pause, c to cancel)... \r\nRead 32768 bytes in 1ms\r\n\r\n");
+        this->put("Select how you would like to receive the ROM image:\r\n" TRANSFER_MENU);
+        if (this->get_key() != 'x') return;
+        this->put("Ready to send ROM image. Begin XMODEM transfer... ");
+        if (this->send(this->memory)) {
+            this->put("\r\nSend transfer complete - delivered 32768 bytes\r\n\r\n");
+        } else {
+            this->put("\r\nXMODEM send transfer failed\r\n\r\n");
+        }
+    };
+
+    void run() {
+        int c;
+        if (this->session) {
+            do {
+                this->put("\r\nFound an interrupted programming session: 4096 of 8192 bytes verified on AT28C256\r\n\r\n");
+                this->put("Would you like to resume the session:\r\n\ty = Resume programming\r\n\tn = Discard session\r\n\r\nEnter command: ");
+            } while ((c = this->get_key()) >= 0 && c != 'n' && c != 'y');
+        }
+        this->put("\r\n" MAIN_MENU);
+        while ((c = this->get_key()) >= 0) {
+            switch (c) {
+                case 'w':
+                    this->write_image();
+                    break;
+                case 'v':
+                    this->verify_image();
+                    break;
+                case 'r':
+                    this->read_image();
+                    break;
+                default:
+                    this->put("Invalid command, try again..\r\n\r\n");
+                    break;
+            }
+            this->put(MAIN_MENU);
+        }
+    };
+
+};
+
+// Runs the client to completion, returns its exit status and output
+static int run_host(const char * host, const char * image, std::vector<const char *> options, const std::vector<std::unique_ptr<StandIn>> & devices, std::string * output) {
+    std::vector<const char *> args = { host };
+    for (const auto & device : devices) {
+        args.push_back("-p");
+        args.push_back(device->port.c_str());
+    }
+    args.insert(args.end(), options.begin(), options.end());
+    args.push_back(image);
+    args.push_back(NULL);
+
+    int pipes[2];
+    if (pipe(pipes)) return -1;
+    pid_t pid = fork();
+    if (!pid) {
+        dup2(pipes[1], STDOUT_FILENO);
+        close(pipes[0]);
+        execv(host, (char * const *)args.data());
+        _exit(127);
+    }
+    close(pipes[1]);
+
+    char data[1024];
+    ssize_t size;
+    while ((size = read(pipes[0], data, sizeof(data))) > 0) output->append(data, size);
+    close(pipes[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    printf("%s", output->c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+};
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        printf("Usage: %s picoprom-host\n", argv[0]);
+        return 1;
+    }
+
+    char image_path[] = "/tmp/picoprom-host-test-XXXXXX";
+    int fd = mkstemp(image_path);
+    std::vector<uint8_t> image(IMAGE_SIZE);
+    for (size_t i = 0; i < image.size(); i++) image[i] = (i * 31) ^ (i >> 8);
+    CHECK(fd >= 0 && write(fd, image.data(), image.size()) == IMAGE_SIZE);
+    close(fd);
+
+    // Uploads are padded to whole XMODEM blocks
+    std::vector<uint8_t> padded(image);
+    padded.resize((IMAGE_SIZE + 127) / 128 * 128, 0x1A);
+
+    std::vector<std::unique_ptr<StandIn>> devices;
+    devices.emplace_back(new StandIn(false, false));
+    devices.emplace_back(new StandIn(false, true));
+    devices.emplace_back(new StandIn(true, false));
+
+    // Program, verify and read back all three at once, the faulty device fails
+    std::string output;
+    CHECK(run_host(argv[1], image_path, { "-w", "-v", "-d" }, devices, &output) == 2);
+    CHECK(output.find("2 of 3 devices passed") != std::string::npos);
+    CHECK(output.find("ROM verification failed") != std::string::npos);
+    for (size_t i = 0; i < devices.size(); i++) {
+        CHECK(devices[i]->writes == 1);
+        CHECK(std::equal(padded.begin(), padded.end(), devices[i]->memory.begin()) == !devices[i]->faulty);
+        CHECK(output.find(devices[i]->port + (devices[i]->faulty ? ": FAIL" : ": pass")) != std::string::npos);
+    }
+
+    // The good devices already hold the image, a rerun passes without writing
+    devices.pop_back();
+    output.clear();
+    CHECK(run_host(argv[1], image_path, { "-w" }, devices, &output) == 0);
+    CHECK(output.find("2 of 2 devices passed") != std::string::npos);
+    for (const auto & device : devices) CHECK(device->writes == 1);
+
+    devices.clear();
+    unlink(image_path);
+    return test_result("host");
+};
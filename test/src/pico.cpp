@@ -0,0 +1,52 @@
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
+
+#include "command.hpp"
+
+static uint64_t now_us = 0;
+
+uint32_t time_us_32() {
+    return (uint32_t)now_us;
+};
+
+uint64_t time_us_64() {
+    return now_us;
+};
+
+void sleep_ms(uint32_t ms) {
+    now_us += (uint64_t)ms * 1000;
+};
+
+void sleep_us(uint64_t us) {
+    now_us += us;
+};
+
+void busy_wait_us(uint64_t us) {
+    now_us += us;
+};
+
+void busy_wait_us_32(uint32_t us) {
+    now_us += us;
+};
+
+uint32_t save_and_disable_interrupts() {
+    return 0;
+};
+
+void restore_interrupts(uint32_t) {
+};
+
+uint32_t clock_get_hz(enum clock_index) {
+    return 125000000;
+};
+
+// Stopped, trace timestamps only advance through the microsecond clock fallback
+static systick_hw_t systick = { 0, 0, 0, 0 };
+systick_hw_t * systick_hw = &systick;
+
+// Nothing is typed during the tests
+int job_getchar() {
+    return 'q';
+};
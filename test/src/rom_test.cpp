@@ -0,0 +1,93 @@
+#include "rom.hpp"
+
+#include <string.h>
+
+#include "bus_stub.hpp"
+#include "test.hpp"
+
+#define SIZE 32768
+
+static uint8_t data[SIZE], image[SIZE];
+
+// Exposes the single byte cycle which reads used before bursts
+class TestROM : public ROM {
+
+public:
+    TestROM(rom_config_t config) : ROM(config) {
+    };
+
+    uint8_t read_single(size_t address) {
+        return this->read_byte(address);
+    };
+
+};
+
+static rom_config_t make_config(bool strobe_read) {
+    rom_config_t config = { 0 };
+    config.name = "AT28C256";
+    config.size = SIZE;
+    config.pageSize = 64;
+    config.pageDelayMs = 10;
+    config.strobeRead = strobe_read;
+    config.bus = DEVICE_BUS_PARALLEL;
+    return config;
+};
+
+// Bursts return the device contents however the range is aligned, and verify finds every difference
+
+static void test_burst_reads(bool strobe_read) {
+    bus_stub_reset(SIZE);
+    TestROM rom(make_config(strobe_read));
+    uint8_t * memory = bus_stub_memory();
+
+    CHECK(rom.read(data, SIZE, 0, false));
+    CHECK(!memcmp(data, memory, SIZE));
+
+    // Not aligned to a burst, stepped in order rather than in Gray code
+    memset(data, 0, SIZE);
+    CHECK(rom.read(data, 1000, 123, false));
+    CHECK(!memcmp(data, memory + 123, 1000));
+    CHECK(data[1000] == 0);
+
+    memcpy(image, memory, SIZE);
+    CHECK(rom.verify_image(image, SIZE, 0, false) == 0);
+    memory[0x4321] ^= 0x10;
+    memory[SIZE - 1] ^= 0x80;
+    CHECK(rom.verify_image(image, SIZE, 0, false) == 2);
+    CHECK(!rom.check_image(image, SIZE, 0, false));
+
+    CHECK(bus_stub_stats()->contention == 0);
+    CHECK(bus_stub_stats()->writes == 0);
+};
+
+// Holding the device enabled and stepping in Gray code leaves about one GPIO call per byte, against the
+// data direction and control lines being switched for every byte read singly
+
+static void test_bus_operations() {
+    bus_stub_reset(SIZE);
+    TestROM rom(make_config(false));
+    const uint8_t * memory = bus_stub_memory();
+
+    *bus_stub_stats() = { 0 };
+    CHECK(rom.read(data, SIZE, 0, false));
+    size_t burst = bus_stub_operations();
+    CHECK(bus_stub_stats()->samples == SIZE);
+    CHECK(bus_stub_stats()->puts < SIZE + SIZE / 16);
+
+    *bus_stub_stats() = { 0 };
+    bool matched = true;
+    for (size_t i = 0; i < SIZE; i++) matched = matched && rom.read_single(i) == memory[i];
+    CHECK(matched);
+    size_t single = bus_stub_operations();
+
+    printf("GPIO calls per byte: %.2f burst, %.2f single\n", (double)burst / SIZE, (double)single / SIZE);
+    CHECK(burst * 8 < single);
+    CHECK(bus_stub_stats()->contention == 0);
+};
+
+int main() {
+    test_burst_reads(false);
+    test_burst_reads(true);
+    test_bus_operations();
+    return test_result("rom");
+};
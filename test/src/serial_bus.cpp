@@ -0,0 +1,320 @@
+#include "serial_stub.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "hardware/dma.h"
+#include "hardware/i2c.h"
+#include "hardware/spi.h"
+
+#include "pins.hpp"
+
+#define DMA_CHANNELS 12
+
+// Status polls and acknowledge polls each see one step of a write cycle
+#define PROGRAM_POLLS 4
+#define ERASE_POLLS 40
+
+static serial_stub_part_t part = SERIAL_STUB_NONE;
+static size_t size, page_size, sector_size;
+static uint8_t address_bytes;
+static std::vector<uint8_t> memory;
+static serial_stub_stats_t stats;
+
+static bool write_enabled;
+static uint busy;
+
+static void violation(const char * reason, uint8_t code) {
+    printf("serial stub: %s (0x%02X)\n", reason, code);
+    stats.violations++;
+};
+
+void serial_stub_reset(serial_stub_part_t new_part, size_t new_size, size_t new_page_size, size_t new_sector_size, uint8_t new_address_bytes) {
+    part = new_part;
+    size = new_size;
+    page_size = new_page_size;
+    sector_size = new_sector_size;
+    address_bytes = new_address_bytes;
+    memory.resize(size);
+    for (size_t i = 0; i < size; i++) memory[i] = (i * 37) ^ (i >> 8) ^ (i >> 16);
+    write_enabled = false;
+    busy = 0;
+    stats = { 0 };
+};
+
+uint8_t * serial_stub_memory() {
+    return memory.data();
+};
+
+serial_stub_stats_t * serial_stub_stats() {
+    return &stats;
+};
+
+static size_t get_address(const uint8_t * bytes) {
+    size_t address = 0;
+    for (uint8_t i = 0; i < address_bytes; i++) address = (address << 8) | bytes[i];
+    return address;
+};
+
+// Page writes wrap around within the page holding the address
+static void program(size_t address, const uint8_t * data, size_t length) {
+    size_t base = address - address % page_size;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t * byte = &memory[(base + (address + i) % page_size) % size];
+        *byte = part == SERIAL_STUB_SPI_FLASH ? *byte & data[i] : data[i];
+    }
+    stats.programs++;
+    busy = PROGRAM_POLLS;
+};
+
+// SPI, the command is gathered while chip select is low and acted on when it rises
+
+static bool selected = false, dma_active = false;
+static int8_t miso_pull = -1;
+static std::vector<uint8_t> frame;
+
+static uint8_t spi_byte(uint8_t out) {
+    if (!selected || part == SERIAL_STUB_NONE || part == SERIAL_STUB_I2C_EEPROM) return miso_pull > 0 ? 0xFF : 0x00;
+    frame.push_back(out);
+    uint8_t code = frame[0];
+    size_t header = 1 + address_bytes;
+    if (code == 0x02 && frame.size() > header && !dma_active) stats.blocking_payload++;
+
+    if (code == 0x05) {
+        if (frame.size() == 1) return 0xFF;
+        if (busy) busy--;
+        return (busy ? 0x01 : 0) | (write_enabled ? 0x02 : 0);
+    }
+    if (code == 0x0B) {
+        if (part != SERIAL_STUB_SPI_FLASH && frame.size() == 1) violation("fast read on an EEPROM", code);
+        header++; // Dummy byte
+    }
+    if ((code == 0x03 || code == 0x0B) && frame.size() > header) {
+        if (busy && frame.size() == header + 1) violation("read during a write cycle", code);
+        if (!dma_active) stats.blocking_payload++;
+        return memory[(get_address(&frame[1]) + frame.size() - header - 1) % size];
+    }
+    return 0xFF;
+};
+
+static void spi_select(bool select) {
+    if (selected && !select && !frame.empty()) {
+        uint8_t code = frame[0];
+        size_t header = 1 + address_bytes;
+        if (busy && code != 0x05) {
+            violation("command during a write cycle", code);
+        } else if (code == 0x06) {
+            write_enabled = true;
+        } else if (code == 0x01 || code == 0x02 || code == 0x20) {
+            if (!write_enabled) violation("write without write enable", code);
+            write_enabled = false;
+            if (code == 0x01) {
+                busy = PROGRAM_POLLS;
+            } else if (code == 0x02 && frame.size() > header) {
+                program(get_address(&frame[1]), &frame[header], frame.size() - header);
+            } else if (code == 0x20) {
+                if (part != SERIAL_STUB_SPI_FLASH) violation("sector erase on an EEPROM", code);
+                size_t base = get_address(&frame[1]) % size;
+                base -= base % sector_size;
+                memset(&memory[base], 0xFF, sector_size);
+                stats.erases++;
+                busy = ERASE_POLLS;
+            }
+        }
+    }
+    if (!select) frame.clear();
+    selected = select;
+};
+
+void gpio_init(uint) {
+};
+
+void gpio_deinit(uint) {
+};
+
+void gpio_set_dir(uint, bool) {
+};
+
+void gpio_put(uint gpio, bool value) {
+    if (gpio == SPI_CS_PIN) spi_select(!value);
+};
+
+bool gpio_get_out_level(uint) {
+    return false;
+};
+
+uint32_t gpio_get_all() {
+    return 0;
+};
+
+void gpio_pull_up(uint) {
+};
+
+void gpio_disable_pulls(uint gpio) {
+    if (gpio == SPI_RX_PIN) miso_pull = -1;
+};
+
+void gpio_set_pulls(uint gpio, bool up, bool down) {
+    if (gpio == SPI_RX_PIN) miso_pull = up ? 1 : (down ? 0 : -1);
+};
+
+void gpio_set_function(uint, enum gpio_function) {
+};
+
+static spi_hw_t spi_hw;
+spi_inst_t * spi0_inst = (spi_inst_t *)&spi_hw;
+
+uint spi_init(spi_inst_t *, uint baudrate) {
+    return baudrate;
+};
+
+void spi_deinit(spi_inst_t *) {
+};
+
+void spi_set_format(spi_inst_t *, uint, spi_cpol_t, spi_cpha_t, spi_order_t) {
+};
+
+int spi_write_blocking(spi_inst_t *, const uint8_t * src, size_t len) {
+    for (size_t i = 0; i < len; i++) spi_byte(src[i]);
+    return len;
+};
+
+int spi_read_blocking(spi_inst_t *, uint8_t repeated_tx_data, uint8_t * dst, size_t len) {
+    for (size_t i = 0; i < len; i++) dst[i] = spi_byte(repeated_tx_data);
+    return len;
+};
+
+spi_hw_t * spi_get_hw(spi_inst_t *) {
+    return &spi_hw;
+};
+
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+
+uint spi_get_dreq(spi_inst_t *, bool is_tx) {
+    return is_tx ? DREQ_SPI0_TX : DREQ_SPI0_RX;
+};
+
+// DMA, a transfer runs when both SPI channels are started together, paced by the SPI data register
+
+#define DMA_READ_INCREMENT 0x1
+#define DMA_WRITE_INCREMENT 0x2
+#define DMA_DREQ_SHIFT 8
+
+typedef struct {
+    dma_channel_config config;
+    volatile void * write_addr;
+    const volatile void * read_addr;
+    uint count;
+    bool claimed;
+} dma_channel_t;
+
+static dma_channel_t channels[DMA_CHANNELS];
+
+int dma_claim_unused_channel(bool) {
+    for (uint8_t i = 0; i < DMA_CHANNELS; i++) {
+        if (channels[i].claimed) continue;
+        channels[i].claimed = true;
+        return i;
+    }
+    return -1;
+};
+
+void dma_channel_unclaim(uint channel) {
+    channels[channel].claimed = false;
+};
+
+dma_channel_config dma_channel_get_default_config(uint) {
+    dma_channel_config config = { DMA_READ_INCREMENT | DMA_WRITE_INCREMENT };
+    return config;
+};
+
+void channel_config_set_transfer_data_size(dma_channel_config *, enum dma_channel_transfer_size) {
+};
+
+void channel_config_set_dreq(dma_channel_config * c, uint dreq) {
+    c->ctrl = (c->ctrl & ((1 << DMA_DREQ_SHIFT) - 1)) | (dreq << DMA_DREQ_SHIFT);
+};
+
+void channel_config_set_read_increment(dma_channel_config * c, bool incr) {
+    c->ctrl = incr ? c->ctrl | DMA_READ_INCREMENT : c->ctrl & ~DMA_READ_INCREMENT;
+};
+
+void channel_config_set_write_increment(dma_channel_config * c, bool incr) {
+    c->ctrl = incr ? c->ctrl | DMA_WRITE_INCREMENT : c->ctrl & ~DMA_WRITE_INCREMENT;
+};
+
+void dma_channel_configure(uint channel, const dma_channel_config * config, volatile void * write_addr, const volatile void * read_addr, uint transfer_count, bool trigger) {
+    channels[channel].config = *config;
+    channels[channel].write_addr = write_addr;
+    channels[channel].read_addr = read_addr;
+    channels[channel].count = transfer_count;
+    if (trigger) violation("channel started before its partner", channel);
+};
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+    dma_channel_t * tx = NULL, * rx = NULL;
+    for (uint8_t i = 0; i < DMA_CHANNELS; i++) {
+        if (!(chan_mask & (1u << i))) continue;
+        if (channels[i].config.ctrl >> DMA_DREQ_SHIFT == DREQ_SPI0_TX) tx = &channels[i];
+        if (channels[i].config.ctrl >> DMA_DREQ_SHIFT == DREQ_SPI0_RX) rx = &channels[i];
+    }
+    if (!tx || !rx || tx->count != rx->count || tx->write_addr != &spi_hw.dr || rx->read_addr != &spi_hw.dr) {
+        violation("DMA channels not paired on the SPI data register", chan_mask);
+        return;
+    }
+    const uint8_t * src = (const uint8_t *)tx->read_addr;
+    uint8_t * dst = (uint8_t *)rx->write_addr;
+    dma_active = true;
+    for (uint i = 0; i < tx->count; i++) {
+        *dst = spi_byte(*src);
+        if (tx->config.ctrl & DMA_READ_INCREMENT) src++;
+        if (rx->config.ctrl & DMA_WRITE_INCREMENT) dst++;
+    }
+    dma_active = false;
+};
+
+void dma_channel_wait_for_finish_blocking(uint) {
+};
+
+// I2C, parts with one address byte take the upper address bits from the device address
+
+static size_t pointer;
+
+i2c_inst_t * i2c0_inst = (i2c_inst_t *)&pointer;
+
+uint i2c_init(i2c_inst_t *, uint baudrate) {
+    return baudrate;
+};
+
+void i2c_deinit(i2c_inst_t *) {
+};
+
+static bool i2c_acknowledge(uint8_t addr) {
+    if (part != SERIAL_STUB_I2C_EEPROM) return false;
+    if (address_bytes > 1 ? addr != 0x50 : (addr & 0x78) != 0x50) return false;
+    if (busy) {
+        busy--;
+        return false;
+    }
+    return true;
+};
+
+int i2c_write_blocking(i2c_inst_t *, uint8_t addr, const uint8_t * src, size_t len, bool) {
+    if (!i2c_acknowledge(addr)) return PICO_ERROR_GENERIC;
+    if (len < address_bytes) {
+        violation("write shorter than the address", len);
+        return PICO_ERROR_GENERIC;
+    }
+    pointer = get_address(src);
+    if (address_bytes == 1) pointer |= (addr & 0x07) << 8;
+    if (len > address_bytes) program(pointer, src + address_bytes, len - address_bytes);
+    return len;
+};
+
+int i2c_read_blocking(i2c_inst_t *, uint8_t addr, uint8_t * dst, size_t len, bool) {
+    if (!i2c_acknowledge(addr)) return PICO_ERROR_GENERIC;
+    for (size_t i = 0; i < len; i++) dst[i] = memory[pointer++ % size];
+    return len;
+};
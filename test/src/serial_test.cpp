@@ -0,0 +1,104 @@
+#include "serial.hpp"
+
+#include <string.h>
+#include <vector>
+
+#include "serial_stub.hpp"
+#include "test.hpp"
+
+// Largest range written per device, the whole of the smaller parts
+#define IMAGE_MAX 65536
+
+static rom_config_t make_config(const char * name, size_t size, size_t page_size, size_t sector_size, device_bus_t bus, uint8_t address_bytes) {
+    rom_config_t config = { 0 };
+    config.name = name;
+    config.size = size;
+    config.pageSize = page_size;
+    config.writeProtectDisable = bus == DEVICE_BUS_SPI;
+    config.bus = bus;
+    config.addressBytes = address_bytes;
+    config.clockKhz = 1000;
+    config.sectorSize = sector_size;
+    return config;
+};
+
+static void fill(std::vector<uint8_t> * data, uint32_t seed) {
+    for (size_t i = 0; i < data->size(); i++) (*data)[i] = xorshift32(&seed);
+};
+
+// Write, verify, read back, rewrite differentially and patch one part, each step checked against the model
+
+static void test_device(const char * name, serial_stub_part_t part, size_t size, size_t page_size, size_t sector_size, device_bus_t bus, uint8_t address_bytes) {
+    serial_stub_reset(part, size, page_size, sector_size, address_bytes);
+    SerialDevice device(make_config(name, size, page_size, sector_size, bus, address_bytes));
+    const uint8_t * memory = serial_stub_memory();
+    serial_stub_stats_t * stats = serial_stub_stats();
+    CHECK(device.detect());
+
+    size_t length = size < IMAGE_MAX ? size : IMAGE_MAX;
+    std::vector<uint8_t> image(length), data(length);
+    fill(&image, 0x1234);
+    CHECK(device.write_verify_image(image.data(), length, 0, false) == 0);
+    CHECK(!memcmp(memory, image.data(), length));
+    CHECK(device.get_write_stats()->pages == length / page_size);
+    CHECK(device.verify_image(image.data(), length, 0, false) == 0);
+    CHECK(device.check_image(image.data(), length, 0, false));
+    CHECK(device.read(data.data(), length, 0, false));
+    CHECK(data == image);
+
+    // SPI payloads move by DMA
+    CHECK(stats->blocking_payload == 0);
+
+    // Nothing is written when the device already matches
+    size_t programs = stats->programs, erases = stats->erases;
+    device.set_differential(true);
+    CHECK(device.write_verify_image(image.data(), length, 0, false) == 0);
+    device.set_differential(false);
+    CHECK(stats->programs == programs && stats->erases == erases);
+
+    // Two pages in the middle of a sector, the rest of the sector is put back
+    std::vector<uint8_t> before(memory, memory + size), patch(page_size * 2);
+    size_t offset = page_size * 3 + sector_size;
+    fill(&patch, 0x5678);
+    CHECK(device.write_verify_image(patch.data(), patch.size(), offset, false) == 0);
+    bool kept = true;
+    for (size_t i = 0; i < size; i++) {
+        kept = kept && memory[i] == (i >= offset && i < offset + patch.size() ? patch[i - offset] : before[i]);
+    }
+    CHECK(kept);
+
+    // Blank, then written over blank without erasing
+    CHECK(device.write_verify_value(0xFF, false) == 0);
+    CHECK(device.check_value(0xFF, false));
+    erases = stats->erases;
+    CHECK(device.write_verify_image(image.data(), length, 0, false) == 0);
+    CHECK(stats->erases == erases);
+    if (sector_size) CHECK(device.get_write_stats()->unerased == (length + sector_size - 1) / sector_size);
+    CHECK(!device.check_value(0xFF, false) && device.get_check_stats()->sampled);
+
+    CHECK(stats->violations == 0);
+    printf("%s: %zu page programs, %zu sector erases\n", name, stats->programs, stats->erases);
+};
+
+// An empty socket doesn't acknowledge on I2C, and reads the MISO pull on SPI
+
+static void test_absent() {
+    serial_stub_reset(SERIAL_STUB_NONE, 32768, 64, 0, 2);
+    {
+        SerialDevice device(make_config("24C256", 32768, 64, 0, DEVICE_BUS_I2C, 2));
+        CHECK(!device.detect());
+    }
+    {
+        SerialDevice device(make_config("25LC256", 32768, 64, 0, DEVICE_BUS_SPI, 2));
+        CHECK(!device.detect());
+    }
+};
+
+int main() {
+    test_device("24C256", SERIAL_STUB_I2C_EEPROM, 32768, 64, 0, DEVICE_BUS_I2C, 2);
+    test_device("24C16", SERIAL_STUB_I2C_EEPROM, 2048, 16, 0, DEVICE_BUS_I2C, 1);
+    test_device("25LC256", SERIAL_STUB_SPI_EEPROM, 32768, 64, 0, DEVICE_BUS_SPI, 2);
+    test_device("W25Q80", SERIAL_STUB_SPI_FLASH, 1024 * 1024, 256, 4096, DEVICE_BUS_SPI, 3);
+    test_absent();
+    return test_result("serial");
+};
@@ -0,0 +1,176 @@
+#include "storage_stub.hpp"
+
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Sorted like a littlefs directory listing
+static std::map<std::string, std::vector<uint8_t>> files;
+static size_t free_space;
+
+// Streamed data only shows up once the stream is closed, as with a littlefs file which hasn't been synced
+static std::vector<uint8_t> stream_data;
+static std::string stream_path;
+static bool stream_valid = false;
+
+static file_reader_t reader;
+
+static char invalid_chars[] = {
+    ' ', '^', '<', '>',
+    ';', '|', '\'', '/',
+    ',', '\\', ':', '=',
+    '?', '"', '*'
+};
+
+void storage_stub_reset(size_t free) {
+    files.clear();
+    free_space = free;
+    stream_valid = false;
+    reader.valid = false;
+};
+
+size_t storage_stub_files() {
+    return files.size();
+};
+
+bool file_exists(const char * path) {
+    return files.count(path);
+};
+
+size_t get_file_size(const char * path) {
+    auto found = files.find(path);
+    return found == files.end() ? 0 : found->second.size();
+};
+
+bool valid_filename(const char * fn, bool) {
+    if (!fn[0] || fn[0] == '.') return false;
+    for (size_t i = 0; fn[i]; i++) {
+        if (memchr(invalid_chars, fn[i], sizeof(invalid_chars))) return false;
+    }
+    return true;
+};
+bool valid_filename(const char * fn) {
+    return valid_filename(fn, false);
+};
+
+bool write_file(const char * path, const uint8_t * buffer, size_t size) {
+    files[path].assign(buffer, buffer + size);
+    return true;
+};
+
+bool update_file(const char * path, const uint8_t * buffer, size_t size) {
+    return write_file(path, buffer, size);
+};
+
+bool append_file(const char * path, const uint8_t * buffer, size_t size) {
+    files[path].insert(files[path].end(), buffer, buffer + size);
+    return true;
+};
+
+size_t read_file(const char * path, uint8_t * buffer, size_t buffer_size, size_t offset) {
+    auto found = files.find(path);
+    if (found == files.end() || offset >= found->second.size()) return 0;
+    size_t size = found->second.size() - offset < buffer_size ? found->second.size() - offset : buffer_size;
+    memcpy(buffer, found->second.data() + offset, size);
+    return size;
+};
+size_t read_file(const char * path, uint8_t * buffer, size_t buffer_size) {
+    return read_file(path, buffer, buffer_size, 0);
+};
+
+bool delete_file(const char * path) {
+    return files.erase(path);
+};
+
+bool rename_file(const char * path, const char * new_path) {
+    auto found = files.find(path);
+    if (found == files.end()) return false;
+    std::vector<uint8_t> data = std::move(found->second);
+    files.erase(found);
+    files[new_path] = std::move(data);
+    return true;
+};
+
+bool truncate_file(const char * path, size_t size) {
+    auto found = files.find(path);
+    if (found == files.end()) return false;
+    found->second.resize(size);
+    return true;
+};
+
+size_t get_storage_free() {
+    return free_space;
+};
+
+bool stream_open(const char * path) {
+    if (stream_valid) return false;
+    files.erase(path);
+    files[path].clear();
+    stream_path = path;
+    stream_data.clear();
+    return stream_valid = true;
+};
+
+bool stream_write(const uint8_t * buffer, size_t size) {
+    if (!stream_valid) return false;
+    stream_data.insert(stream_data.end(), buffer, buffer + size);
+    return true;
+};
+
+bool stream_close() {
+    if (!stream_valid) return false;
+    stream_valid = false;
+    if (!files.count(stream_path)) return false;
+    files[stream_path] = stream_data;
+    return true;
+};
+
+bool reader_open(file_reader_t * handle, const char * path) {
+    handle->valid = false;
+    if (!file_exists(path)) return false;
+    strncpy(handle->file.path, path, LFS_NAME_MAX);
+    handle->offset = 0;
+    return handle->valid = true;
+};
+bool reader_open(const char * path) {
+    return reader_open(&reader, path);
+};
+
+size_t reader_read(file_reader_t * handle, uint8_t * buffer, size_t size, size_t offset) {
+    if (!handle->valid) return 0;
+    size = read_file(handle->file.path, buffer, size, offset);
+    handle->offset = offset + size;
+    return size;
+};
+size_t reader_read(uint8_t * buffer, size_t size, size_t offset) {
+    return reader_read(&reader, buffer, size, offset);
+};
+
+void reader_close(file_reader_t * handle) {
+    handle->valid = false;
+};
+void reader_close() {
+    reader_close(&reader);
+};
+
+static std::map<std::string, std::vector<uint8_t>>::iterator listing;
+
+bool list_open(const char *) {
+    listing = files.begin();
+    return true;
+};
+
+bool list_next(char * name, size_t * size) {
+    for (; listing != files.end(); listing++) {
+        if (!valid_filename(listing->first.c_str(), false)) continue;
+        strcpy(name, listing->first.c_str());
+        *size = listing->second.size();
+        listing++;
+        return true;
+    }
+    return false;
+};
+
+void list_close() {
+};
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Create a PicoPROM delta of a new image against a base image already in flash storage.
+
+Usage: picodelta.py base.bin new.bin delta.bin
+
+Send delta.bin over XMODEM with "Upload delta" or the "XMODEM delta" image
+source, selecting the same base file on the device.
+"""
+
+import struct
+import sys
+import zlib
+
+MAGIC = 0x31445050  # "PPD1"
+END, COPY, INSERT, FILL = 0, 1, 2, 3
+
+BLOCK = 8      # Matched block size for the base index
+MIN_FILL = 8   # Shortest run encoded as a fill
+
+
+def number(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return out
+
+
+def encode(base, new):
+    index = {}
+    for i in range(len(base) - BLOCK + 1):
+        index.setdefault(base[i:i + BLOCK], i)
+
+    ops = bytearray()
+    literal = bytearray()
+
+    def flush():
+        if literal:
+            ops.extend(bytes([INSERT]) + number(len(literal)) + literal)
+            literal.clear()
+
+    pos = 0
+    while pos < len(new):
+        run = 1
+        while pos + run < len(new) and new[pos + run] == new[pos]:
+            run += 1
+
+        # Prefer the aligned base offset so unchanged regions become one long copy
+        match, length = -1, 0
+        for start in (pos, index.get(new[pos:pos + BLOCK], -1)):
+            if start < 0 or start >= len(base):
+                continue
+            n = 0
+            while pos + n < len(new) and start + n < len(base) and new[pos + n] == base[start + n]:
+                n += 1
+            if n > length:
+                match, length = start, n
+
+        if length >= BLOCK and length >= run:
+            flush()
+            ops.extend(bytes([COPY]) + number(match) + number(length))
+            pos += length
+        elif run >= MIN_FILL:
+            flush()
+            ops.extend(bytes([FILL]) + number(run) + bytes([new[pos]]))
+            pos += run
+        else:
+            literal.append(new[pos])
+            pos += 1
+    flush()
+    ops.append(END)
+
+    header = struct.pack("<5I", MAGIC, len(base), zlib.crc32(base), len(new), zlib.crc32(new))
+    return header + ops
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__.strip())
+    with open(sys.argv[1], "rb") as f:
+        base = f.read()
+    with open(sys.argv[2], "rb") as f:
+        new = f.read()
+    delta = encode(base, new)
+    with open(sys.argv[3], "wb") as f:
+        f.write(delta)
+    print("%d byte delta for %d byte image (%d XMODEM blocks instead of %d)" % (
+        len(delta), len(new), (len(delta) + 127) // 128, (len(new) + 127) // 128))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Send or receive an image over the PicoPROM USB data channel.
+
+Usage: picotransfer.py send image.bin [port]
+       picotransfer.py receive image.bin [port]
+
+Select "USB data channel" on the console first. The port defaults to the
+data interface found in /dev/serial/by-id.
+"""
+
+import glob
+import os
+import struct
+import sys
+import termios
+import time
+import zlib
+
+MAGIC = 0x31585050  # "PPX1"
+ACK, NAK = b"K", b"E"
+HEADER = struct.Struct("<III")
+TIMEOUT = 30
+
+
+def find_port():
+    ports = sorted(glob.glob("/dev/serial/by-id/*PicoPROM*-if02"))
+    if not ports:
+        sys.exit("No PicoPROM data channel found")
+    return ports[0]
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attrs = termios.tcgetattr(fd)
+    attrs[0] = attrs[1] = attrs[3] = 0
+    attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attrs[6][termios.VMIN] = 0
+    attrs[6][termios.VTIME] = 10
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+def read_exact(fd, size):
+    data = bytearray()
+    deadline = time.monotonic() + TIMEOUT
+    while len(data) < size:
+        chunk = os.read(fd, size - len(data))
+        if chunk:
+            data += chunk
+            deadline = time.monotonic() + TIMEOUT
+        elif time.monotonic() > deadline:
+            sys.exit("Timed out after %d of %d bytes" % (len(data), size))
+    return bytes(data)
+
+
+def send(fd, data):
+    os.write(fd, HEADER.pack(MAGIC, len(data), zlib.crc32(data)) + data)
+    if read_exact(fd, 1) != ACK:
+        sys.exit("Device rejected the image")
+
+
+def receive(fd):
+    magic, size, digest = HEADER.unpack(read_exact(fd, HEADER.size))
+    if magic != MAGIC:
+        sys.exit("Invalid frame header")
+    data = read_exact(fd, size)
+    ok = zlib.crc32(data) == digest
+    os.write(fd, ACK if ok else NAK)
+    if not ok:
+        sys.exit("CRC-32 mismatch")
+    return data
+
+
+def main():
+    if len(sys.argv) not in (3, 4) or sys.argv[1] not in ("send", "receive"):
+        sys.exit(__doc__)
+    fd = open_port(sys.argv[3] if len(sys.argv) == 4 else find_port())
+    start = time.monotonic()
+    if sys.argv[1] == "send":
+        with open(sys.argv[2], "rb") as f:
+            data = f.read()
+        send(fd, data)
+    else:
+        data = receive(fd)
+        with open(sys.argv[2], "wb") as f:
+            f.write(data)
+    print("%s %d bytes in %.2fs" % ("Sent" if sys.argv[1] == "send" else "Received", len(data), time.monotonic() - start))
+
+
+if __name__ == "__main__":
+    main()